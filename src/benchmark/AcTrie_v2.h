@@ -35,6 +35,7 @@
 
 #include "benchmark.h"
 #include "win_iconv.h"
+#include "flat_map.h"
 
 namespace v2 {
 
@@ -66,7 +67,12 @@ public:
     #pragma pack(push, 1)
 
     struct State {
+#if 1
+        // The children are a sorted array, see FlatMap.
+        typedef FlatMap<std::uint32_t, ident_t> map_type;
+#else
         typedef std::map<std::uint32_t, ident_t> map_type;
+#endif
 
         ident_t                 fail_link;
         union {
@@ -30,15 +30,33 @@
 #include <set>
 #include <map>
 #include <unordered_map>
+#include <unordered_set>
+#include <queue>
+#include <memory>
 #include <functional>
 #include <utility>
 #include <algorithm>
 #include <type_traits>
 
+#include "support/bitscan_forward.h"
+
 #include "benchmark.h"
 #include "win_iconv.h"
 #include "utf8_utils.h"
 #include "AcTrie_utf8.h"
+#include "trie_file.h"
+#include "byte_prefilter.h"
+
+#ifndef DAT_PREFETCH
+#if defined(_MSC_VER)
+#include <xmmintrin.h>
+#define DAT_PREFETCH(addr)  _mm_prefetch((const char *)(addr), _MM_HINT_T0)
+#elif defined(__GNUC__) || defined(__clang__)
+#define DAT_PREFETCH(addr)  __builtin_prefetch((const void *)(addr), 0, 3)
+#else
+#define DAT_PREFETCH(addr)  ((void)(addr))
+#endif
+#endif // DAT_PREFETCH
 
 namespace utf8 {
 
@@ -72,13 +90,53 @@ public:
     static const std::uint32_t kOverFlowLable = kMaxAscii;
     static const std::uint32_t kMaxLabel = 0x0010FFFFu;
 
-    static const std::uint32_t kPatternIdMask = 0x7FFFFFFFu;
+    static const std::uint32_t kPatternIdMask = 0x1FFFFFFFu;
+    static const std::uint32_t kHasOutputMask = 0x20000000u;
     static const std::uint32_t kHasChildMask = 0x40000000u;
     static const std::uint32_t kIsFinalMask = 0x80000000u;
     static const std::uint32_t kIsFreeMask = 0x80000000u;
 
     static const std::uint32_t kSignMask = 0x80000000u;
 
+    // In the split layout, the has_output flag is the top bit of HotState::base.
+    static const std::uint32_t kHotOutputMask = 0x80000000u;
+    static const std::uint32_t kHotBaseMask = 0x7FFFFFFFu;
+
+    static const size_type kDefaultDfaMaxBytes = 256 * 1024 * 1024;
+
+    // A word of the free cells is closed after so many failed bases, see find_base().
+    static const std::uint32_t kMaxWordFails = 16;
+
+    // The sections of the trie file, see save() and load().
+    enum FileSection {
+        kSectionParams = 1,
+        kSectionStates,
+        kSectionOverflowLabels,
+        kSectionOutputLinks,
+        kSectionDepths,
+        kSectionHotStates,
+        kSectionLabelTable,
+        kSectionOverflowLabelTable,
+        kSectionDfaAlphabet,
+        kSectionDfaOverflowAlphabet,
+        kSectionDfaTable,
+        kSectionDfaStates,
+        kSectionDfaOutputLinks,
+        kSectionDfaDepths,
+        kSectionPrefilter,
+        kSectionColdStates
+    };
+
+    enum FileParam {
+        kParamFirstFreeId,
+        kParamLabelRemap,
+        kParamLabelWindow,
+        kParamSplitLayout,
+        kParamDfaAlphabetSize,
+        kParamTombstones,
+        kMaxFileParam
+    };
+
     #pragma pack(push, 1)
 
     struct State {
@@ -97,23 +155,49 @@ public:
               union {
                 std::uint32_t   identifier;
                 struct {
-                  std::uint32_t pattern_id : 30;
+                  std::uint32_t pattern_id : 29;
+                  std::uint32_t has_output : 1;
                   std::uint32_t has_child  : 1;
                   std::uint32_t is_final   : 1;
                 };
               };
-              ident_t           reserve;
+              ident_t           fail_link;
             };
         };
 #if 1
         State() noexcept : is_free(0), extend(0) {
         }
 #else
-        State() noexcept : base(0), check(0), identifier(0), reserve(0) {
+        State() noexcept : base(0), check(0), identifier(0), fail_link(0) {
         }
 #endif
     };
 
+    //
+    // The split (structure-of-arrays) layout: the transition fields of State.
+    // The failure link is also read per label by the AC matcher, so it stays here.
+    //
+    struct HotState {
+        ident_t base;
+        ident_t check;
+        ident_t fail_link;
+    };
+
+    //
+    // The split layout: the metadata of State, it's only read at the outputs.
+    //
+    struct ColdState {
+        union {
+            std::uint32_t       identifier;
+            struct {
+              std::uint32_t     pattern_id : 29;
+              std::uint32_t     has_output : 1;
+              std::uint32_t     has_child  : 1;
+              std::uint32_t     is_final   : 1;
+            };
+        };
+    };
+
     struct MatchInfo {
         std::uint32_t end;
         std::uint32_t pattern_id;
@@ -130,19 +214,107 @@ public:
 
     typedef State state_type;
 
+    //
+    // The matching status of a text stream: a slice in match_interleaved(), or the
+    // text fed piece by piece to match_stream(). label and skip are only used by
+    // match_interleaved(), the decided matches of a slice are kept in match_list.
+    //
+    struct MatchStream {
+        const uchar_type *          text;
+        const uchar_type *          last;
+        ident_t                     cur;
+        std::uint32_t               label;
+        std::uint32_t               skip;
+        bool                        has_pending;
+        std::uint32_t               min_begin;
+        MatchInfoEx                 pending;
+        std::vector<MatchInfoEx>    deferred;
+        std::vector<MatchInfoEx>    match_list;
+
+        MatchStream() : text(nullptr), last(nullptr), cur(kRootIdent), label(0), skip(0),
+                        has_pending(false), min_begin(0) {
+        }
+    };
+
 private:
-    std::vector<state_type> states_;
+    trie_file::MappedVector<state_type> states_;
     std::unordered_map<std::uint64_t, std::uint32_t> overflow_labels_;
+    trie_file::MappedVector<ident_t> output_links_;
+    trie_file::MappedVector<std::uint32_t> depths_;
+
+    // The split layout: states_ is moved into hot_states_ (base, check and fail_link)
+    // and cold_states_ (pattern_id and the flags), then states_ is empty.
+    bool use_split_layout_;
+    trie_file::MappedVector<HotState> hot_states_;
+    trie_file::MappedVector<ColdState> cold_states_;
 
     ident_t first_free_id_;
     AcTireT acTrie_;
 
+    // The dead states since the last build: they are not final and no key passes
+    // through them, they are left by online_erase() and dropped by compact().
+    size_type tombstones_;
+
+    // The indexes of the online updates, they are built by the first update after
+    // build() or load(). child_first_[s] is the first child of s, child_next_ links
+    // the siblings. fail_first_[s] is the first state whose failure link is s,
+    // fail_next_ and fail_prev_ link the states of the same failure link.
+    // overflow_states_ is the label of each child in overflow_labels_.
+    std::vector<ident_t> child_first_;
+    std::vector<ident_t> child_next_;
+    std::vector<ident_t> fail_first_;
+    std::vector<ident_t> fail_next_;
+    std::vector<ident_t> fail_prev_;
+    std::unordered_map<ident_t, std::uint32_t> overflow_states_;
+
+    // The free cells while building, a bit per state, 1 is free.
+    std::vector<std::uint64_t> free_bits_;
+    std::vector<std::uint64_t> free_words_;
+    std::vector<std::uint64_t> free_groups_;
+    std::vector<std::uint8_t> free_fails_;
+    std::vector<std::uint32_t> child_offsets_;
+
+    // The label remapping: the code points of the dictionary are ranked by the
+    // frequency, label_table_[code_point] is the rank + 1, 0 is not in the dictionary.
+    bool use_label_remap_;
+    std::uint32_t label_window_;
+    trie_file::MappedVector<std::uint16_t> label_table_;
+    std::unordered_map<std::uint32_t, std::uint32_t> overflow_label_table_;
+    std::unordered_map<std::uint32_t, std::uint64_t> label_samples_;
+
+    // The full DFA mode: dfa_table_[state * dfa_alphabet_size_ + label_class] is
+    // the next state, the states are the AC trie identifiers.
+    bool use_dfa_;
+    size_type dfa_max_bytes_;
+    size_type dfa_alphabet_size_;
+    size_type dfa_table_bytes_;
+    trie_file::MappedVector<std::uint32_t> dfa_alphabet_;
+    std::unordered_map<std::uint32_t, std::uint32_t> dfa_overflow_alphabet_;
+    trie_file::MappedVector<ident_t> dfa_table_;
+    trie_file::MappedVector<state_type> dfa_states_;
+    trie_file::MappedVector<ident_t> dfa_output_links_;
+    trie_file::MappedVector<std::uint32_t> dfa_depths_;
+
+    // The first bytes and the first byte pairs of the keys, the matcher skips
+    // to the next candidate by it when it's at the root.
+    bool use_prefilter_;
+    BytePrefilter prefilter_;
+
+    // The loaded trie file, the arrays above are the views of it.
+    std::shared_ptr<trie_file::Reader> trie_file_;
+
 public:
-    DAT() : first_free_id_(kFirstFreeIdent) {
+    DAT() : use_split_layout_(false), first_free_id_(kFirstFreeIdent), tombstones_(0),
+            use_label_remap_(false), label_window_(kMaxAscii),
+            use_dfa_(false), dfa_max_bytes_(kDefaultDfaMaxBytes), dfa_alphabet_size_(0),
+            dfa_table_bytes_(0), use_prefilter_(false) {
         this->create_root();
     }
 
-    DAT(size_type capacity) : first_free_id_(kFirstFreeIdent) {
+    DAT(size_type capacity) : use_split_layout_(false), first_free_id_(kFirstFreeIdent), tombstones_(0),
+            use_label_remap_(false), label_window_(kMaxAscii),
+            use_dfa_(false), dfa_max_bytes_(kDefaultDfaMaxBytes), dfa_alphabet_size_(0),
+            dfa_table_bytes_(0), use_prefilter_(false) {
         if (capacity != 0) {
             this->states_.reserve(capacity);
         }
@@ -152,11 +324,11 @@ public:
     virtual ~DAT() {}
 
     ident_t max_state_id() const {
-        return static_cast<ident_t>(this->states_.size());
+        return static_cast<ident_t>(this->size());
     }
 
     ident_t last_state_id() const {
-        return static_cast<ident_t>(this->states_.size() - 1);
+        return static_cast<ident_t>(this->size() - 1);
     }
 
 #ifdef _DEBUG
@@ -206,20 +378,28 @@ public:
 #endif // _DEBUG
 
     size_type size() const {
-        return this->states_.size();
+        return (this->has_split_layout() ? this->hot_states_.size() : this->states_.size());
     }
 
+    // The states are only in the AoS layout, see has_split_layout().
     State & states(size_type index) {
+        assert(!this->has_split_layout());
         return this->states_[index];
     }
 
     const State & states(size_type index) const {
+        assert(!this->has_split_layout());
         return this->states_[index];
     }
 
     inline bool is_free_state(ident_t index) const {
-        const State & state = this->states_[index];
-        return (state.is_free == 0);
+        if (this->has_split_layout()) {
+            const HotState & hot_state = this->hot_states_[index];
+            return (((hot_state.base & kHotBaseMask) | hot_state.check) == 0);
+        } else {
+            const State & state = this->states_[index];
+            return (state.is_free == 0);
+        }
     }
 
     ident_t first_free_id() const {
@@ -238,6 +418,129 @@ public:
         return this->acTrie_.has_overflow_labels();
     }
 
+    //
+    // If the label remapping is on, build() ranks the code points of the dictionary
+    // (and of the samples) by the frequency, the most frequent one is label 1.
+    // Each base only spans the alphabet size, instead of the 64K code points.
+    //
+    void set_label_remap(bool use_remap) {
+        this->use_label_remap_ = use_remap;
+    }
+
+    bool use_label_remap() const {
+        return this->use_label_remap_;
+    }
+
+    std::uint32_t label_window() const {
+        return this->label_window_;
+    }
+
+    //
+    // Count the code points of a corpus sample, it's used to rank the labels.
+    //
+    void add_label_sample(const char * text, size_type length) {
+        const char * text_last = text + length;
+        while (text < text_last) {
+            std::size_t skip;
+            std::uint32_t code_point = utf8_decode(text, skip);
+            this->label_samples_[code_point]++;
+            text += skip;
+        }
+    }
+
+    void add_label_sample(const std::string & text) {
+        this->add_label_sample(text.c_str(), text.size());
+    }
+
+    void clear_label_samples() {
+        this->label_samples_.clear();
+    }
+
+    //
+    // In the full DFA mode, build() also precomputes the next state of every
+    // (state, label) in the dictionary alphabet, so a label is exactly one
+    // transition. If the table is larger than max_bytes, it falls back to the
+    // failure links.
+    //
+    void set_dfa_mode(bool use_dfa, size_type max_bytes = kDefaultDfaMaxBytes) {
+        this->use_dfa_ = use_dfa;
+        this->dfa_max_bytes_ = max_bytes;
+    }
+
+    bool use_dfa() const {
+        return this->use_dfa_;
+    }
+
+    bool has_dfa() const {
+        return !this->dfa_table_.empty();
+    }
+
+    //
+    // The DFA table size of the last build, even if it's larger than max_bytes and
+    // isn't built, and its blow-up over the DAT size.
+    //
+    size_type dfa_table_bytes() const {
+        return this->dfa_table_bytes_;
+    }
+
+    double dfa_blow_up() const {
+        size_type dat_bytes = this->dat_bytes();
+        return ((double)this->dfa_table_bytes_ / (double)(dat_bytes != 0 ? dat_bytes : 1));
+    }
+
+    //
+    // In the split layout, build() moves base, check and fail_link of every state
+    // into a dense array of 12 bytes, and pattern_id and the flags into a parallel
+    // array of 4 bytes, the 16 bytes states are released. The matchers walk the
+    // dense array and only read the other one at the outputs. The online updates
+    // move the states back to the AoS layout, compact() splits them again.
+    //
+    void set_split_layout(bool use_split) {
+        this->use_split_layout_ = use_split;
+    }
+
+    bool use_split_layout() const {
+        return this->use_split_layout_;
+    }
+
+    bool has_split_layout() const {
+        return !this->hot_states_.empty();
+    }
+
+    //
+    // If the prefilter is on, build() also collects the first bytes and the first
+    // byte pairs of the keys. When the matcher is at the root without a pending
+    // match, it jumps to the next position which can begin a key by a SIMD scan,
+    // instead of decoding every label. It pays off if the keys are sparse.
+    //
+    void set_prefilter(bool use_prefilter) {
+        this->use_prefilter_ = use_prefilter;
+    }
+
+    bool use_prefilter() const {
+        return this->use_prefilter_;
+    }
+
+    bool has_prefilter() const {
+        return !this->prefilter_.empty();
+    }
+
+    size_type dat_bytes() const {
+        return (this->states_.size() * sizeof(state_type) +
+                this->hot_states_.size() * sizeof(HotState) +
+                this->cold_states_.size() * sizeof(ColdState) +
+                this->output_links_.size() * sizeof(ident_t) +
+                this->depths_.size() * sizeof(std::uint32_t));
+    }
+
+    size_type dfa_bytes() const {
+        return (this->dfa_table_.size() * sizeof(ident_t) +
+                this->dfa_alphabet_.size() * sizeof(std::uint32_t) +
+                this->dfa_states_.size() * sizeof(state_type) +
+                this->dfa_output_links_.size() * sizeof(ident_t) +
+                this->dfa_depths_.size() * sizeof(std::uint32_t));
+    }
+
     void clear() {
         this->clear_ac_trie();
         this->clear_trie();
@@ -251,9 +554,120 @@ public:
         capacity = (capacity < 2) ? 2: capacity;
 
         this->overflow_labels_.clear();
+        this->output_links_.clear();
+        this->depths_.clear();
+        this->hot_states_.clear();
+        this->cold_states_.clear();
+        this->clear_dfa();
+        this->dfa_table_bytes_ = 0;
+        this->prefilter_.clear();
+        this->clear_update_index();
         this->states_.clear();
         this->states_.reserve(capacity);
         this->create_root();
+        this->tombstones_ = 0;
+        this->trie_file_.reset();
+    }
+
+    static const char * file_kind() {
+        return "utf8::DAT";
+    }
+
+    //
+    // The build options which change the trie file, it's a part of the cache key.
+    //
+    std::uint64_t file_options() const {
+        return ((this->use_label_remap_ ? 1u : 0u) |
+                (this->use_split_layout_ ? 2u : 0u) |
+                (this->use_dfa_ ? 4u : 0u) |
+                (this->use_prefilter_ ? 8u : 0u));
+    }
+
+    std::uint64_t file_dict_hash() const {
+        return (this->trie_file_ ? this->trie_file_->header().dict_hash : 0);
+    }
+
+    //
+    // Save the built trie, the AC trie is not needed after load().
+    //
+    bool save(const std::string & path, std::uint64_t dict_hash = 0) const {
+        std::uint64_t params[kMaxFileParam];
+        params[kParamFirstFreeId] = this->first_free_id_;
+        params[kParamLabelRemap] = this->use_label_remap_ ? 1 : 0;
+        params[kParamLabelWindow] = this->label_window_;
+        params[kParamSplitLayout] = this->use_split_layout_ ? 1 : 0;
+        params[kParamDfaAlphabetSize] = this->dfa_alphabet_size_;
+        params[kParamTombstones] = this->tombstones_;
+
+        trie_file::Writer writer(file_kind(), dict_hash);
+        writer.add(kSectionParams, params, sizeof(std::uint64_t), kMaxFileParam);
+        writer.add(kSectionStates, this->states_);
+        writer.add(kSectionOverflowLabels, this->overflow_labels_);
+        writer.add(kSectionOutputLinks, this->output_links_);
+        writer.add(kSectionDepths, this->depths_);
+        writer.add(kSectionHotStates, this->hot_states_);
+        writer.add(kSectionLabelTable, this->label_table_);
+        writer.add(kSectionOverflowLabelTable, this->overflow_label_table_);
+        writer.add(kSectionDfaAlphabet, this->dfa_alphabet_);
+        writer.add(kSectionDfaOverflowAlphabet, this->dfa_overflow_alphabet_);
+        writer.add(kSectionDfaTable, this->dfa_table_);
+        writer.add(kSectionDfaStates, this->dfa_states_);
+        writer.add(kSectionDfaOutputLinks, this->dfa_output_links_);
+        writer.add(kSectionDfaDepths, this->dfa_depths_);
+        writer.add(kSectionPrefilter, this->prefilter_.bits());
+        writer.add(kSectionColdStates, this->cold_states_);
+        return writer.save(path);
+    }
+
+    //
+    // Load a saved trie, the arrays are used in place in the mapped file (or in
+    // the read buffer if use_mmap is false). Only the hash maps of the labels
+    // above 0xFFFF are rebuilt, they are usually empty.
+    //
+    bool load(const std::string & path, bool use_mmap = true) {
+        std::shared_ptr<trie_file::Reader> reader = std::make_shared<trie_file::Reader>();
+        if (!reader->open(path, file_kind(), use_mmap))
+            return false;
+
+        std::vector<std::uint64_t> params;
+        if (!reader->read(kSectionParams, params) || params.size() < kMaxFileParam)
+            return false;
+
+        this->clear();
+        std::vector<std::uint64_t> prefilter_bits;
+        bool succeeded = (reader->attach(kSectionStates, this->states_) &&
+                          reader->read(kSectionOverflowLabels, this->overflow_labels_) &&
+                          reader->attach(kSectionOutputLinks, this->output_links_) &&
+                          reader->attach(kSectionDepths, this->depths_) &&
+                          reader->attach(kSectionHotStates, this->hot_states_) &&
+                          reader->attach(kSectionLabelTable, this->label_table_) &&
+                          reader->read(kSectionOverflowLabelTable, this->overflow_label_table_) &&
+                          reader->attach(kSectionDfaAlphabet, this->dfa_alphabet_) &&
+                          reader->read(kSectionDfaOverflowAlphabet, this->dfa_overflow_alphabet_) &&
+                          reader->attach(kSectionDfaTable, this->dfa_table_) &&
+                          reader->attach(kSectionDfaStates, this->dfa_states_) &&
+                          reader->attach(kSectionDfaOutputLinks, this->dfa_output_links_) &&
+                          reader->attach(kSectionDfaDepths, this->dfa_depths_) &&
+                          reader->read(kSectionPrefilter, prefilter_bits) &&
+                          this->prefilter_.assign(prefilter_bits) &&
+                          reader->attach(kSectionColdStates, this->cold_states_));
+        if (!succeeded || (this->cold_states_.size() != this->hot_states_.size()) ||
+            (this->size() <= kRootIdent)) {
+            this->clear();
+            return false;
+        }
+
+        this->first_free_id_ = (ident_t)params[kParamFirstFreeId];
+        this->use_label_remap_ = (params[kParamLabelRemap] != 0);
+        this->label_window_ = (std::uint32_t)params[kParamLabelWindow];
+        this->use_split_layout_ = (params[kParamSplitLayout] != 0);
+        this->use_dfa_ = !this->dfa_table_.empty();
+        this->use_prefilter_ = !this->prefilter_.empty();
+        this->dfa_alphabet_size_ = (size_type)params[kParamDfaAlphabetSize];
+        this->dfa_table_bytes_ = this->dfa_table_.size() * sizeof(ident_t);
+        this->tombstones_ = (size_type)params[kParamTombstones];
+        this->trie_file_ = reader;
+        return true;
     }
 
     bool insert(const uchar_type * pattern, size_type length, std::uint32_t id) {
@@ -282,6 +696,177 @@ public:
         }
     }
 
+    bool is_built() const {
+        return !this->output_links_.empty();
+    }
+
+    size_type tombstones() const {
+        return this->tombstones_;
+    }
+
+    //
+    // The online updates of the built trie, the AC trie is not needed. insert()
+    // is the key of the next build(), online_insert() changes the built states:
+    // the new states are put into the free cells, if the cell of a new child is
+    // used, the children of the parent are moved to a new base. Then the failure
+    // links which can reach the new states are fixed in depth order. The prefilter
+    // is updated in place, the split layout is moved back to the AoS layout.
+    // Return false if the key exists or the trie isn't built.
+    //
+    bool online_insert(const uchar_type * pattern, size_type length, std::uint32_t id) {
+        if (!this->is_built() || length == 0)
+            return false;
+
+        this->merge_split_layout();
+
+        // The labels are checked first, the trie isn't changed by a failed insert.
+        std::vector<std::uint32_t> code_points;
+        std::vector<std::uint32_t> encode_lens;
+        uchar_type * text = (uchar_type *)pattern;
+        uchar_type * text_last = (uchar_type *)pattern + length;
+        while (text < text_last) {
+            std::size_t skip;
+            std::uint32_t code_point = utf8_decode((const char *)text, skip);
+            text += skip;
+            code_points.push_back(code_point);
+            encode_lens.push_back((std::uint32_t)skip);
+        }
+        if (!this->can_add_labels(code_points))
+            return false;
+
+        ident_t cur = this->root();
+        size_type pos = 0;
+        while (pos < code_points.size()) {
+            std::uint32_t label = this->map_label(code_points[pos]);
+            if (this->use_label_remap_ && (label == 0))
+                break;
+            ident_t child = this->next_state(cur, label);
+            if (child == kInvalidIdent)
+                break;
+            cur = child;
+            pos++;
+        }
+
+        if ((pos == code_points.size()) && (this->states_[cur].is_final != 0))
+            return false;
+
+        this->prepare_update();
+
+        // The dead states on the path are used by the key again.
+        this->tombstones_ -= this->count_dead_path(cur);
+
+        if (pos == code_points.size()) {
+            // A tombstone or an inner state, only the output links are changed.
+            State & leaf_state = this->states_[cur];
+            leaf_state.pattern_id = id & kPatternIdMask;
+            leaf_state.is_final = 1;
+            this->update_has_output(cur);
+            this->relink_outputs(cur);
+        } else {
+            ident_t last_state = cur;
+            std::vector<ident_t> new_states;
+            std::vector<std::uint32_t> new_labels;
+            while (pos < code_points.size()) {
+                std::uint32_t label = this->add_label(code_points[pos]);
+                ident_t child = this->add_child(cur, label);
+                this->states_[cur].has_child = 1;
+                this->depths_[child] = this->depths_[cur] + encode_lens[pos];
+                new_states.push_back(child);
+                new_labels.push_back(label);
+                cur = child;
+                pos++;
+            }
+
+            State & leaf_state = this->states_[cur];
+            leaf_state.pattern_id = id & kPatternIdMask;
+            leaf_state.is_final = 1;
+            this->relink_states(last_state, new_states, new_labels);
+        }
+
+        if (this->has_prefilter())
+            this->prefilter_.add_key((const std::uint8_t *)pattern, length);
+        return true;
+    }
+
+    bool online_insert(const char_type * pattern, size_type length, std::uint32_t id) {
+        return this->online_insert((const uchar_type *)pattern, length, id);
+    }
+
+    bool online_insert(const schar_type * pattern, size_type length, std::uint32_t id) {
+        return this->online_insert((const uchar_type *)pattern, length, id);
+    }
+
+    bool online_insert(const std::string & pattern, std::uint32_t id) {
+        return this->online_insert(pattern.c_str(), pattern.size(), id);
+    }
+
+    //
+    // Remove a key from the built trie, its final state isn't an output any more,
+    // but the states are kept. The states which no other key passes through become
+    // tombstones. Return false if there is no key.
+    //
+    bool online_erase(const uchar_type * pattern, size_type length) {
+        if (!this->is_built() || length == 0)
+            return false;
+
+        this->merge_split_layout();
+
+        uchar_type * text = (uchar_type *)pattern;
+        uchar_type * text_last = (uchar_type *)pattern + length;
+
+        ident_t cur = this->root();
+        while (text < text_last) {
+            std::size_t skip;
+            std::uint32_t label = this->map_label(utf8_decode((const char *)text, skip));
+            text += skip;
+            if (this->use_label_remap_ && (label == 0))
+                return false;
+            cur = this->next_state(cur, label);
+            if (cur == kInvalidIdent)
+                return false;
+        }
+        if (this->states_[cur].is_final == 0)
+            return false;
+
+        this->prepare_update();
+        this->states_[cur].is_final = 0;
+        this->update_has_output(cur);
+        this->relink_outputs(cur);
+        this->tombstones_ += this->count_dead_path(cur);
+        return true;
+    }
+
+    bool online_erase(const char_type * pattern, size_type length) {
+        return this->online_erase((const uchar_type *)pattern, length);
+    }
+
+    bool online_erase(const schar_type * pattern, size_type length) {
+        return this->online_erase((const uchar_type *)pattern, length);
+    }
+
+    bool online_erase(const std::string & pattern) {
+        return this->online_erase(pattern.c_str(), pattern.size());
+    }
+
+    //
+    // Rebuild the trie from the keys in it, the tombstones and the cells which
+    // are left by the moved children are dropped, the build options are kept.
+    //
+    void compact() {
+        if (!this->is_built())
+            return;
+
+        std::vector<std::pair<std::string, std::uint32_t>> key_list;
+        this->merge_split_layout();
+        this->collect_keys(key_list);
+
+        this->clear();
+        for (auto iter = key_list.begin(); iter != key_list.end(); ++iter) {
+            this->insert(iter->first, iter->second);
+        }
+        this->build();
+    }
+
     inline ident_t find_first_free_state() {
         ident_t first = this->first_free_id();
         ident_t next = this->find_next_free_state(first);
@@ -300,166 +885,592 @@ public:
         return kInvalidIdent;
     }
 
-    inline void build() {
-        if (!this->has_overflow_labels())
-            this->build_no_overflow();
-        else
-            this->build_overflow();
+    //
+    // The free cell bitmap of the build, a bit per cell, 1 is free. The cells after
+    // the last state are always free, and the used cells are never freed again.
+    // free_words_ has a bit per word of free_bits_, 1 is the word is open: it has
+    // a free cell and it's not closed yet, free_groups_ has a bit per word of
+    // free_words_, so the used runs are skipped by 4096 or 256K cells per step. Like the blocks of darts-clone, a word is closed after
+    // kMaxWordFails bases in it are rejected, its free cells are still used by
+    // the other children, but the word is not searched for the base again.
+    //
+    void init_free_cells() {
+        this->free_bits_.clear();
+        this->free_words_.clear();
+        this->free_groups_.clear();
+        this->free_fails_.clear();
+        this->resize_free_cells(this->states_.size());
+        for (size_type cell = 0; cell < kFirstFreeIdent; cell++) {
+            this->use_free_cell((ident_t)cell);
+        }
+        this->set_first_free_id(kFirstFreeIdent);
     }
 
-    void build_no_overflow() {
-        std::vector<ident_t> ac_queue;
-        std::vector<ident_t> queue;
-        ac_queue.reserve(this->acTrie_.size());
-        queue.reserve(this->acTrie_.size());
+    void release_free_cells() {
+        std::vector<std::uint64_t>().swap(this->free_bits_);
+        std::vector<std::uint64_t>().swap(this->free_words_);
+        std::vector<std::uint64_t>().swap(this->free_groups_);
+        std::vector<std::uint8_t>().swap(this->free_fails_);
+        std::vector<std::uint32_t>().swap(this->child_offsets_);
+    }
 
-        size_type state_capacity = (size_type)((double)this->acTrie_.size() * 1.1);
-        if (state_capacity < (kFirstFreeIdent + kMaxAscii))
-            state_capacity = (kFirstFreeIdent + kMaxAscii) + 1024;
-        this->clear_trie(state_capacity);
-        this->states_.resize(this->acTrie_.size());
+    void resize_free_cells(size_type new_size) {
+        size_type words = new_size / 64 + 1;
+        if (words > this->free_bits_.size()) {
+            this->free_bits_.resize(words, ~std::uint64_t(0));
+            this->free_words_.resize(words / 64 + 1, ~std::uint64_t(0));
+            this->free_groups_.resize(words / 64 / 64 + 1, ~std::uint64_t(0));
+            this->free_fails_.resize(words, 0);
+        }
+    }
 
-        ident_t root_ac = this->acTrie_.root();
-        ac_queue.push_back(root_ac);
+    void resize_states(size_type new_size) {
+        if (new_size > this->states_.size()) {
+            this->states_.resize(new_size);
+            this->resize_free_cells(new_size);
+        }
+    }
 
-        ident_t root = this->root();
-        queue.push_back(root);
+    inline bool is_free_cell(ident_t cell) const {
+        size_type index = cell / 64;
+        return ((index >= this->free_bits_.size()) ||
+                ((this->free_bits_[index] & (std::uint64_t(1) << (cell % 64))) != 0));
+    }
 
-        size_type head = 0;
-        size_type first_children = 0;
-        while (likely(head < ac_queue.size())) {
-            ident_t cur_ac = ac_queue[head];
-            AcState & cur_ac_state = this->acTrie_.states(cur_ac);
+    inline void use_free_cell(ident_t cell) {
+        assert(this->is_free_cell(cell));
+        size_type index = cell / 64;
+        this->free_bits_[index] &= ~(std::uint64_t(1) << (cell % 64));
+        if (this->free_bits_[index] == 0)
+            this->close_free_word(index);
+    }
 
-            ident_t cur = queue[head++];
-            State * cur_state = &this->states_[cur];
+    inline void close_free_word(size_type index) {
+        size_type summary = index / 64;
+        this->free_words_[summary] &= ~(std::uint64_t(1) << (index % 64));
+        if (this->free_words_[summary] == 0)
+            this->free_groups_[summary / 64] &= ~(std::uint64_t(1) << (summary % 64));
+    }
 
-            std::size_t nums_child = cur_ac_state.children.size();
-            cur_state->identifier = cur_ac_state.identifier;
-            //cur_state->pattern_id = cur_ac_state.pattern_id;
-            //cur_state->is_final = cur_ac_state.is_final;
-            cur_state->has_child = (nums_child != 0) ? 1 : 0;
-            cur_state->reserve = 0;
+    inline bool is_open_word(size_type index) const {
+        size_type summary = index / 64;
+        return ((summary >= this->free_words_.size()) ||
+                ((this->free_words_[summary] & (std::uint64_t(1) << (index % 64))) != 0));
+    }
 
-            if (nums_child > 0) {
-                if (head == 1) {
-                    first_children = nums_child;
-                }
-                // Find [min, max] label
-                std::uint32_t min_label = kMaxAscii - 1;
-                std::uint32_t max_label = 0;
-                for (auto iter = cur_ac_state.children.begin();
-                    iter != cur_ac_state.children.end(); ++iter) {
-                    std::uint32_t label = iter->first;
-                    if (label < min_label) {
-                        min_label = label;
-                    }
-                    if (label > max_label) {
-                        max_label = label;
-                    }
-                }
+    //
+    // A base in the word is rejected, close the word if it fails too many times.
+    //
+    inline void fail_free_word(size_type index) {
+        if (index < this->free_fails_.size()) {
+            if (++this->free_fails_[index] >= kMaxWordFails)
+                this->close_free_word(index);
+        }
+    }
 
-                // Search base value
-                bool base_found = false;
-                ident_t first_free = this->find_first_free_state();
-                ident_t base = first_free - min_label;
-                if (!this->is_valid_base(base)) {
-                    first_free = kFirstFreeIdent + min_label;
-                    first_free = this->find_next_free_state(first_free);
-                }
-                do {
-                    if (first_free != kInvalidIdent) {
-                        bool search_next_base = false;
-                        base = first_free - min_label;
-                        for (auto iter = cur_ac_state.children.begin();
-                            iter != cur_ac_state.children.end(); ++iter) {
-                            std::uint32_t label = iter->first;
-                            assert(label < kOverFlowLable);
-                            ident_t child = base + label;
-                            if (child < this->states_.size()) {
-                                if (!this->is_free_state(child)) {
-                                    first_free = this->find_next_free_state(first_free + 1);
-                                    if ((first_children != size_type(-1)) && (head > first_children + 1)) {
-                                        this->set_first_free_id(first_free);
-                                        first_children = size_type(-1);
-                                    }
-                                    search_next_base = true;
-                                    break;
-                                }
-                            } else {
-                                std::uint32_t label_size = max_label - min_label + 1;
-                                size_type newCapacity = base + kMaxAscii;
-                                this->states_.resize(newCapacity);
-                                cur_state = &this->states_[cur];
-                                break;
-                            }
-                        }
-                        base_found = !search_next_base;
-                    } else {
-                        base = (ident_t)this->states_.size() - min_label;
-                        std::uint32_t label_size = max_label - min_label + 1;
-                        size_type newCapacity = this->states_.size() + kMaxAscii;
-                        this->states_.resize(newCapacity);
-                        cur_state = &this->states_[cur];
-                        base_found = true;
-                        break;
-                    }
-                } while (!base_found);
+    //
+    // The free bits of the 64 cells [first, first + 64).
+    //
+    inline std::uint64_t free_cell_window(size_type first) const {
+        size_type index = first / 64;
+        std::uint32_t shift = (std::uint32_t)(first % 64);
+        std::uint64_t low_bits = (index < this->free_bits_.size()) ?
+                                 this->free_bits_[index] : ~std::uint64_t(0);
+        if (shift == 0)
+            return low_bits;
+        std::uint64_t high_bits = (index + 1 < this->free_bits_.size()) ?
+                                  this->free_bits_[index + 1] : ~std::uint64_t(0);
+        return ((low_bits >> shift) | (high_bits << (64 - shift)));
+    }
 
-                assert(base_found);
-                cur_state->base = base;
+    //
+    // Return the first open word at or after index.
+    //
+    inline size_type next_free_word(size_type index) const {
+        size_type summary = index / 64;
+        if (summary >= this->free_words_.size())
+            return index;
+        std::uint64_t bits = this->free_words_[summary] & (~std::uint64_t(0) << (index % 64));
+        if (bits == 0) {
+            summary = this->next_free_summary(summary + 1);
+            if (summary >= this->free_words_.size())
+                return (summary * 64);
+            bits = this->free_words_[summary];
+        }
+        return (summary * 64 + first_set_bit(bits));
+    }
 
-                // Travel all children
-                for (auto iter = cur_ac_state.children.begin();
-                    iter != cur_ac_state.children.end(); ++iter) {
-                    std::uint32_t label = iter->first;
+    //
+    // Return the first word of free_words_ at or after summary which has an open word.
+    //
+    inline size_type next_free_summary(size_type summary) const {
+        size_type group = summary / 64;
+        if (group >= this->free_groups_.size())
+            return summary;
+        std::uint64_t bits = this->free_groups_[group] & (~std::uint64_t(0) << (summary % 64));
+        while (bits == 0) {
+            if (++group >= this->free_groups_.size())
+                return (group * 64);
+            bits = this->free_groups_[group];
+        }
+        return (group * 64 + first_set_bit(bits));
+    }
 
-                    ident_t child_ac = iter->second;
-                    AcState & child_ac_state = this->acTrie_.states(child_ac);
-                    assert(this->acTrie_.is_valid_id(child_ac));
+    //
+    // Return the first free cell of the open words at or after first.
+    //
+    inline ident_t next_free_cell(ident_t first) const {
+        size_type index = first / 64;
+        if (index >= this->free_bits_.size())
+            return first;
+        std::uint64_t bits = this->free_bits_[index] & (~std::uint64_t(0) << (first % 64));
+        if (bits == 0 || !this->is_open_word(index)) {
+            index = this->next_free_word(index + 1);
+            if (index >= this->free_bits_.size())
+                return (ident_t)(index * 64);
+            bits = this->free_bits_[index];
+        }
+        return (ident_t)(index * 64 + first_set_bit(bits));
+    }
 
-                    ident_t child = base + label;
-                    assert(this->is_valid_child(child));
-                    assert(this->is_free_state(child));
+    static inline std::uint32_t first_set_bit(std::uint64_t bits) {
+        assert(bits != 0);
+        unsigned long index;
+        std::uint32_t low_bits = (std::uint32_t)bits;
+        if (low_bits != 0) {
+            __BitScanForward(index, low_bits);
+            return (std::uint32_t)index;
+        } else {
+            __BitScanForward(index, (std::uint32_t)(bits >> 32));
+            return (std::uint32_t)index + 32;
+        }
+    }
 
-                    State & child_state = this->states_[child];
-                    assert(child_state.base == 0);
-                    child_state.check = cur;
-                    child_state.identifier = child_ac_state.identifier;
+    //
+    // Find a base that all (base + label) of the children are free. The bases are
+    // tried 64 at a time: a bit of the mask is the cell of the min label child,
+    // it's ANDed with the free bits at the offset of each other child, so a full
+    // word is rejected at once, and the used or closed words are skipped by
+    // free_words_, so a run of nearly full words is not searched for every state.
+    // The cells after the last state are free, so it always stops, then the states
+    // are only grown to (base + max_label), build_links() pads the rest of the labels.
+    // If HasOverflow is true, the labels above kOverFlowLable are skipped,
+    // they are placed by overflow_labels_.
+    //
+    template <bool HasOverflow>
+    ident_t find_base(const AcState & ac_state, std::uint32_t min_label, std::uint32_t max_label) {
+        this->set_first_free_id(this->next_free_cell(this->first_free_id()));
+
+        size_type first = this->first_free_id();
+        if (first < (size_type)kFirstFreeIdent + min_label)
+            first = (size_type)kFirstFreeIdent + min_label;
+
+        std::vector<std::uint32_t> & offsets = this->child_offsets_;
+        offsets.clear();
+        for (auto iter = ac_state.children.begin(); iter != ac_state.children.end(); ++iter) {
+            std::uint32_t label = HasOverflow ? iter->first : this->map_label(iter->first);
+            if ((HasOverflow && label >= kOverFlowLable) || label == min_label)
+                continue;
+            offsets.push_back(label - min_label);
+        }
+
+        size_type cell = first & ~size_type(63);
+        std::uint64_t mask = 0;
+        if (this->is_open_word(cell / 64))
+            mask = this->free_cell_window(cell) & (~std::uint64_t(0) << (first % 64));
+        do {
+            if (mask != 0) {
+                for (size_type i = 0; i < offsets.size(); i++) {
+                    mask &= this->free_cell_window(cell + offsets[i]);
+                    if (mask == 0) {
+                        // The child which rejects a word is likely to reject the next one.
+                        std::swap(offsets[0], offsets[i]);
+                        break;
+                    }
+                }
+                if (mask != 0)
+                    break;
+                this->fail_free_word(cell / 64);
+            }
+            cell = this->next_free_word(cell / 64 + 1) * 64;
+            mask = this->free_cell_window(cell);
+        } while (1);
+
+        ident_t base = (ident_t)(cell + first_set_bit(mask) - min_label);
+        this->resize_states((size_type)base + max_label + 1);
+        return base;
+    }
+
+    inline void build() {
+        // The remapped labels are always less than kOverFlowLable.
+        if (this->use_label_remap_ && this->build_label_table())
+            this->build_no_overflow();
+        else if (!this->has_overflow_labels())
+            this->build_no_overflow();
+        else
+            this->build_overflow();
+
+        if (this->use_dfa_)
+            this->build_dfa();
+        if (this->use_prefilter_)
+            this->build_prefilter();
+        // The DFA is built from the AoS states, so the states are split at last.
+        if (this->use_split_layout_)
+            this->build_split_layout();
+    }
+
+    //
+    // The keys are the paths of the AC trie, the first byte pair is in the first
+    // label, or in the first two labels if the first one is ASCII.
+    //
+    void build_prefilter() {
+        this->prefilter_.clear();
+
+        const AcState & root_ac_state = this->acTrie_.states(this->acTrie_.root());
+        for (auto iter = root_ac_state.children.begin(); iter != root_ac_state.children.end(); ++iter) {
+            char utf8[8];
+            std::size_t utf8_len = utf8_encode(iter->first, utf8);
+            if (utf8_len >= 2) {
+                this->prefilter_.add_pair((std::uint8_t)utf8[0], (std::uint8_t)utf8[1]);
+                continue;
+            }
+
+            const AcState & child_ac_state = this->acTrie_.states(iter->second);
+            if (child_ac_state.is_final != 0) {
+                this->prefilter_.add_first((std::uint8_t)utf8[0]);
+                continue;
+            }
+            for (auto child_iter = child_ac_state.children.begin();
+                 child_iter != child_ac_state.children.end(); ++child_iter) {
+                char next_utf8[8];
+                utf8_encode(child_iter->first, next_utf8);
+                this->prefilter_.add_pair((std::uint8_t)utf8[0], (std::uint8_t)next_utf8[0]);
+            }
+        }
+    }
+
+    void build_split_layout() {
+        size_type num_states = this->states_.size();
+        this->hot_states_.clear();
+        this->hot_states_.resize(num_states);
+        this->cold_states_.clear();
+        this->cold_states_.resize(num_states);
+        for (size_type i = 0; i < num_states; i++) {
+            const State & state = this->states_[i];
+            HotState & hot_state = this->hot_states_[i];
+            assert((state.base & kHotOutputMask) == 0);
+            hot_state.base = state.base | ((state.has_output != 0) ? kHotOutputMask : 0);
+            hot_state.check = state.check;
+            hot_state.fail_link = state.fail_link;
+            this->cold_states_[i].identifier = state.identifier;
+        }
+        this->states_.clear();
+        this->states_.shrink_to_fit();
+    }
+
+    //
+    // Move the split states back to the AoS layout, before the states are changed.
+    //
+    void merge_split_layout() {
+        if (!this->has_split_layout())
+            return;
+
+        size_type num_states = this->hot_states_.size();
+        this->states_.clear();
+        this->states_.resize(num_states);
+        for (size_type i = 0; i < num_states; i++) {
+            const HotState & hot_state = this->hot_states_[i];
+            State & state = this->states_[i];
+            state.base = hot_state.base & kHotBaseMask;
+            state.check = hot_state.check;
+            state.fail_link = hot_state.fail_link;
+            state.identifier = this->cold_states_[i].identifier;
+        }
+        this->hot_states_.clear();
+        this->hot_states_.shrink_to_fit();
+        this->cold_states_.clear();
+        this->cold_states_.shrink_to_fit();
+    }
+
+    void clear_label_table() {
+        this->label_window_ = kMaxAscii;
+        this->label_table_.clear();
+        this->overflow_label_table_.clear();
+    }
+
+    //
+    // Rank the code points of the dictionary by the frequency: the count of the trie
+    // edges with the label, plus the count in the samples. Return false if there are
+    // too many labels, then the code points are used as the labels.
+    //
+    bool build_label_table() {
+        this->clear_label_table();
+
+        std::unordered_map<std::uint32_t, std::uint64_t> label_counts;
+        AcTireT & acTrie = this->acTrie_;
+        for (ident_t ac = acTrie.root(); ac < (ident_t)acTrie.size(); ac++) {
+            AcState & ac_state = acTrie.states(ac);
+            for (auto iter = ac_state.children.begin(); iter != ac_state.children.end(); ++iter) {
+                label_counts[iter->first]++;
+            }
+        }
+
+        // The label 0 is reserved for the code points which are not in the dictionary.
+        if (label_counts.size() + 1 > kMaxAscii) {
+            this->use_label_remap_ = false;
+            return false;
+        }
+
+        std::vector<std::pair<std::uint64_t, std::uint32_t>> ranking;
+        ranking.reserve(label_counts.size());
+        for (auto iter = label_counts.begin(); iter != label_counts.end(); ++iter) {
+            std::uint64_t count = iter->second;
+            auto sample_iter = this->label_samples_.find(iter->first);
+            if (sample_iter != this->label_samples_.end())
+                count += sample_iter->second;
+            ranking.push_back(std::make_pair(count, iter->first));
+        }
+        std::sort(ranking.begin(), ranking.end(),
+            [](const std::pair<std::uint64_t, std::uint32_t> & lhs,
+               const std::pair<std::uint64_t, std::uint32_t> & rhs) {
+                return ((lhs.first > rhs.first) ||
+                        ((lhs.first == rhs.first) && (lhs.second < rhs.second)));
+            });
+
+        this->label_table_.resize(kMaxAscii, 0);
+        std::uint32_t label = 1;
+        for (auto iter = ranking.begin(); iter != ranking.end(); ++iter) {
+            std::uint32_t code_point = iter->second;
+            if (code_point < kMaxAscii)
+                this->label_table_[code_point] = (std::uint16_t)label;
+            else
+                this->overflow_label_table_.insert(std::make_pair(code_point, label));
+            label++;
+        }
+        this->label_window_ = label;
+        return true;
+    }
+
+    inline std::uint32_t map_label(std::uint32_t code_point) const {
+        if (likely(!this->use_label_remap_)) {
+            return code_point;
+        } else if (likely(code_point < kMaxAscii)) {
+            return this->label_table_[code_point];
+        } else {
+            auto iter = this->overflow_label_table_.find(code_point);
+            return (iter != this->overflow_label_table_.end()) ? iter->second : 0;
+        }
+    }
+
+    void clear_dfa() {
+        this->dfa_alphabet_size_ = 0;
+        this->dfa_alphabet_.clear();
+        this->dfa_overflow_alphabet_.clear();
+        this->dfa_table_.clear();
+        this->dfa_states_.clear();
+        this->dfa_output_links_.clear();
+        this->dfa_depths_.clear();
+    }
+
+    //
+    // Build the full DFA from the AC trie, it must be called after the failure
+    // links are built. Return false if the table is larger than dfa_max_bytes_.
+    //
+    bool build_dfa() {
+        this->clear_dfa();
+
+        AcTireT & acTrie = this->acTrie_;
+        size_type ac_size = acTrie.size();
+        ident_t root_ac = acTrie.root();
+
+        // Label class 0 is the labels which are not in the dictionary alphabet.
+        std::uint32_t num_classes = 1;
+        this->dfa_alphabet_.resize(kMaxAscii, 0);
+        for (ident_t ac = root_ac; ac < (ident_t)ac_size; ac++) {
+            AcState & ac_state = acTrie.states(ac);
+            for (auto iter = ac_state.children.begin(); iter != ac_state.children.end(); ++iter) {
+                std::uint32_t label = iter->first;
+                if (label < kMaxAscii) {
+                    if (this->dfa_alphabet_[label] == 0)
+                        this->dfa_alphabet_[label] = num_classes++;
+                } else {
+                    if (this->dfa_overflow_alphabet_.count(label) == 0)
+                        this->dfa_overflow_alphabet_.insert(std::make_pair(label, num_classes++));
+                }
+            }
+        }
+
+        size_type table_bytes = ac_size * num_classes * sizeof(ident_t);
+        this->dfa_table_bytes_ = table_bytes;
+        if (table_bytes > this->dfa_max_bytes_) {
+            this->clear_dfa();
+            return false;
+        }
+
+        this->dfa_alphabet_size_ = num_classes;
+        this->dfa_table_.resize(ac_size * num_classes, root_ac);
+        this->dfa_states_.resize(ac_size);
+        this->dfa_output_links_.resize(ac_size, ident_t(kInvalidIdent));
+        this->dfa_depths_.resize(ac_size, 0);
+
+        std::vector<ident_t> queue;
+        queue.reserve(ac_size);
+        queue.push_back(root_ac);
+
+        // In BFS order, the row of the failure link is always done before.
+        size_type head = 0;
+        while (likely(head < queue.size())) {
+            ident_t cur = queue[head++];
+            AcState & cur_ac_state = acTrie.states(cur);
+            ident_t * row = &this->dfa_table_[cur * num_classes];
+
+            State & cur_state = this->dfa_states_[cur];
+            cur_state.pattern_id = cur_ac_state.pattern_id;
+            cur_state.is_final = cur_ac_state.is_final;
+            cur_state.has_child = (cur_ac_state.children.size() != 0) ? 1 : 0;
+
+            if (likely(cur != root_ac)) {
+                ident_t fail = cur_ac_state.fail_link;
+                assert(acTrie.is_valid_id(fail));
+                std::memcpy(row, &this->dfa_table_[fail * num_classes], num_classes * sizeof(ident_t));
+
+                const State & fail_state = this->dfa_states_[fail];
+                cur_state.fail_link = fail;
+                this->dfa_output_links_[cur] = (fail_state.is_final != 0) ? fail : this->dfa_output_links_[fail];
+                cur_state.has_output = ((cur_state.is_final != 0) ||
+                                        (this->dfa_output_links_[cur] != kInvalidIdent)) ? 1 : 0;
+            }
+
+            for (auto iter = cur_ac_state.children.begin();
+                iter != cur_ac_state.children.end(); ++iter) {
+                std::uint32_t label = iter->first;
+                ident_t child = iter->second;
+                row[this->dfa_label_class(label)] = child;
+                this->dfa_depths_[child] = this->dfa_depths_[cur] + (std::uint32_t)unicode_encode_len(label);
+                queue.push_back(child);
+            }
+        }
+
+        return true;
+    }
+
+    void build_no_overflow() {
+        std::vector<ident_t> ac_queue;
+        std::vector<ident_t> queue;
+        std::vector<std::uint32_t> depth_queue;
+        ac_queue.reserve(this->acTrie_.size());
+        queue.reserve(this->acTrie_.size());
+        depth_queue.reserve(this->acTrie_.size());
+
+        size_type state_capacity = (size_type)((double)this->acTrie_.size() * 1.1);
+        if (state_capacity < (kFirstFreeIdent + this->label_window_))
+            state_capacity = (kFirstFreeIdent + this->label_window_) + 1024;
+        this->clear_trie(state_capacity);
+        this->states_.resize(this->acTrie_.size());
+        this->init_free_cells();
+
+        ident_t root_ac = this->acTrie_.root();
+        ac_queue.push_back(root_ac);
+
+        ident_t root = this->root();
+        queue.push_back(root);
+        depth_queue.push_back(0);
+
+        size_type head = 0;
+        while (likely(head < ac_queue.size())) {
+            ident_t cur_ac = ac_queue[head];
+            AcState & cur_ac_state = this->acTrie_.states(cur_ac);
+
+            ident_t cur = queue[head++];
+            State * cur_state = &this->states_[cur];
+
+            std::size_t nums_child = cur_ac_state.children.size();
+            cur_state->identifier = cur_ac_state.identifier;
+            //cur_state->pattern_id = cur_ac_state.pattern_id;
+            //cur_state->is_final = cur_ac_state.is_final;
+            cur_state->has_child = (nums_child != 0) ? 1 : 0;
+            cur_state->fail_link = 0;
+
+            if (nums_child > 0) {
+                // Find [min, max] label
+                std::uint32_t min_label = kMaxAscii - 1;
+                std::uint32_t max_label = 0;
+                for (auto iter = cur_ac_state.children.begin();
+                    iter != cur_ac_state.children.end(); ++iter) {
+                    std::uint32_t label = this->map_label(iter->first);
+                    if (label < min_label) {
+                        min_label = label;
+                    }
+                    if (label > max_label) {
+                        max_label = label;
+                    }
+                }
+
+                // Search base value
+                ident_t base = this->template find_base<false>(cur_ac_state, min_label, max_label);
+                cur_state = &this->states_[cur];
+                cur_state->base = base;
+
+                // Travel all children
+                for (auto iter = cur_ac_state.children.begin();
+                    iter != cur_ac_state.children.end(); ++iter) {
+                    std::uint32_t label = this->map_label(iter->first);
+
+                    ident_t child_ac = iter->second;
+                    AcState & child_ac_state = this->acTrie_.states(child_ac);
+                    assert(this->acTrie_.is_valid_id(child_ac));
+
+                    ident_t child = base + label;
+                    assert(this->is_valid_child(child));
+                    assert(this->is_free_state(child));
+
+                    State & child_state = this->states_[child];
+                    assert(child_state.base == 0);
+                    this->use_free_cell(child);
+                    child_state.check = cur;
+                    child_state.identifier = child_ac_state.identifier;
                     //child_state.is_final = child_ac_state.is_final;
                     //child_state.pattern_id = child_ac_state.pattern_id;
                     child_state.has_child = (child_ac_state.children.size() != 0) ? 1 : 0;
-                    child_state.reserve = 0;
+                    child_state.fail_link = 0;
 
                     ac_queue.push_back(child_ac);
                     queue.push_back(child);
+                    depth_queue.push_back(depth_queue[head - 1] +
+                                          (std::uint32_t)unicode_encode_len(iter->first));
                 }
             } else {
                 assert(cur_state->base == 0);
             }
         }
+
+        this->release_free_cells();
+        this->build_links(ac_queue, queue, depth_queue);
     }
 
     void build_overflow() {
         std::vector<ident_t> ac_queue;
         std::vector<ident_t> queue;
+        std::vector<std::uint32_t> depth_queue;
         ac_queue.reserve(this->acTrie_.size());
         queue.reserve(this->acTrie_.size());
+        depth_queue.reserve(this->acTrie_.size());
 
         size_type state_capacity = (size_type)((double)this->acTrie_.size() * 1.1);
         if (state_capacity < (kFirstFreeIdent + kMaxAscii))
             state_capacity = (kFirstFreeIdent + kMaxAscii) + 1024;
         this->clear_trie(state_capacity);
         this->states_.resize(this->acTrie_.size());
+        this->init_free_cells();
 
         ident_t root_ac = this->acTrie_.root();
         ac_queue.push_back(root_ac);
 
         ident_t root = this->root();
         queue.push_back(root);
+        depth_queue.push_back(0);
 
         size_type head = 0;
-        size_type first_children = 0;
         while (likely(head < ac_queue.size())) {
             ident_t cur_ac = ac_queue[head];
             AcState & cur_ac_state = this->acTrie_.states(cur_ac);
@@ -472,12 +1483,9 @@ public:
             //cur_state->pattern_id = cur_ac_state.pattern_id;
             //cur_state->is_final = cur_ac_state.is_final;
             cur_state->has_child = (nums_child != 0) ? 1 : 0;
-            cur_state->reserve = 0;
+            cur_state->fail_link = 0;
 
             if (nums_child > 0) {
-                if (head == 1) {
-                    first_children = nums_child;
-                }
                 // Find [min, max] label
                 std::uint32_t min_label = kMaxAscii - 1;
                 std::uint32_t max_label = 0;
@@ -487,60 +1495,14 @@ public:
                     if (label < min_label) {
                         min_label = label;
                     }
-                    if (label > max_label) {
+                    if (label > max_label && label < kOverFlowLable) {
                         max_label = label;
                     }
                 }
 
                 // Search base value
-                bool base_found = false;
-                ident_t first_free = this->find_first_free_state();
-                ident_t base = first_free - min_label;
-                if (!this->is_valid_base(base)) {
-                    first_free = kFirstFreeIdent + min_label;
-                    first_free = this->find_next_free_state(first_free);
-                }
-                do {
-                    if (first_free != kInvalidIdent) {
-                        bool search_next_base = false;
-                        base = first_free - min_label;
-                        for (auto iter = cur_ac_state.children.begin();
-                            iter != cur_ac_state.children.end(); ++iter) {
-                            std::uint32_t label = iter->first;
-                            if (label >= kOverFlowLable)
-                                continue;
-                            ident_t child = base + label;
-                            if (child < this->states_.size()) {
-                                if (!this->is_free_state(child)) {
-                                    first_free = this->find_next_free_state(first_free + 1);
-                                    if ((first_children != size_type(-1)) && (head > first_children + 1)) {
-                                        this->set_first_free_id(first_free);
-                                        first_children = size_type(-1);
-                                    }
-                                    search_next_base = true;
-                                    break;
-                                }
-                            } else {
-                                std::uint32_t label_size = max_label - min_label + 1;
-                                size_type newCapacity = base + kMaxAscii;
-                                this->states_.resize(newCapacity);
-                                cur_state = &this->states_[cur];
-                                break;
-                            }
-                        }
-                        base_found = !search_next_base;
-                    } else {
-                        base = (ident_t)this->states_.size() - min_label;
-                        std::uint32_t label_size = max_label - min_label + 1;
-                        size_type newCapacity = this->states_.size() + kMaxAscii;
-                        this->states_.resize(newCapacity);
-                        cur_state = &this->states_[cur];
-                        base_found = true;
-                        break;
-                    }
-                } while (!base_found);
-
-                assert(base_found);
+                ident_t base = this->template find_base<true>(cur_ac_state, min_label, max_label);
+                cur_state = &this->states_[cur];
                 cur_state->base = base;
 
                 // Travel all children
@@ -558,8 +1520,8 @@ public:
                         assert(this->is_valid_child(child));
                         assert(this->is_free_state(child));
                     } else {
-                        first_free = this->find_first_free_state();
-                        child = first_free;
+                        child = this->next_free_cell(this->first_free_id());
+                        this->resize_states((size_type)child + 1);
                         std::uint64_t ident_and_label = ((std::uint64_t)cur << 32u) | label;
                         assert(this->overflow_labels_.count(ident_and_label) == 0);
                         this->overflow_labels_.insert(std::make_pair(ident_and_label, child));
@@ -567,25 +1529,103 @@ public:
 
                     State & child_state = this->states_[child];
                     assert(child_state.base == 0);
+                    this->use_free_cell(child);
                     child_state.check = cur;
                     child_state.identifier = child_ac_state.identifier;
                     //child_state.is_final = child_ac_state.is_final;
                     //child_state.pattern_id = child_ac_state.pattern_id;
                     child_state.has_child = (child_ac_state.children.size() != 0) ? 1 : 0;
-                    child_state.reserve = 0;
+                    child_state.fail_link = 0;
 
                     ac_queue.push_back(child_ac);
                     queue.push_back(child);
+                    depth_queue.push_back(depth_queue[head - 1] +
+                                          (std::uint32_t)unicode_encode_len(label));
                 }
             } else {
                 assert(cur_state->base == 0);
             }
         }
+
+        this->release_free_cells();
+        this->build_links(ac_queue, queue, depth_queue);
+    }
+
+    inline std::uint32_t dfa_label_class(std::uint32_t label) const {
+        if (likely(label < kMaxAscii)) {
+            return this->dfa_alphabet_[label];
+        } else {
+            auto iter = this->dfa_overflow_alphabet_.find(label);
+            return (iter != this->dfa_overflow_alphabet_.end()) ? iter->second : 0;
+        }
+    }
+
+    inline ident_t dfa_next_state(ident_t cur, std::uint32_t label) const {
+        return this->dfa_table_[cur * this->dfa_alphabet_size_ + this->dfa_label_class(label)];
+    }
+
+    //
+    // Return the child of cur by label, or kInvalidIdent if there is no such child.
+    //
+    inline ident_t next_state(ident_t cur, std::uint32_t label) const {
+        if (likely(label < kOverFlowLable)) {
+            ident_t child = this->states_[cur].base + label;
+            assert(child < this->max_state_id());
+            return (this->states_[child].check == cur) ? child : ident_t(kInvalidIdent);
+        } else {
+            std::uint64_t ident_and_label = ((std::uint64_t)cur << 32u) | label;
+            auto iter = this->overflow_labels_.find(ident_and_label);
+            return (iter != this->overflow_labels_.end()) ? iter->second : ident_t(kInvalidIdent);
+        }
+    }
+
+    inline ident_t hot_next_state(ident_t cur, std::uint32_t label) const {
+        if (likely(label < kOverFlowLable)) {
+            ident_t child = (this->hot_states_[cur].base & kHotBaseMask) + label;
+            assert(child < this->max_state_id());
+            return (this->hot_states_[child].check == cur) ? child : ident_t(kInvalidIdent);
+        } else {
+            std::uint64_t ident_and_label = ((std::uint64_t)cur << 32u) | label;
+            auto iter = this->overflow_labels_.find(ident_and_label);
+            return (iter != this->overflow_labels_.end()) ? iter->second : ident_t(kInvalidIdent);
+        }
+    }
+
+    //
+    // The fields of a state in the AoS or the split layout, the metadata is read from
+    // states (it's states_ or dfa_states_) in the AoS layout.
+    //
+    template <bool SplitLayout>
+    inline ident_t state_base(ident_t id) const {
+        return (SplitLayout ? (this->hot_states_[id].base & kHotBaseMask) : this->states_[id].base);
+    }
+
+    template <bool SplitLayout>
+    inline ident_t state_check(ident_t id) const {
+        return (SplitLayout ? this->hot_states_[id].check : this->states_[id].check);
+    }
+
+    template <bool SplitLayout>
+    inline ColdState cold_state(const state_type * states, ident_t id) const {
+        ColdState cold_state;
+        cold_state.identifier = SplitLayout ? this->cold_states_[id].identifier : states[id].identifier;
+        return cold_state;
     }
 
     inline
     bool match_tail(ident_t root, const uchar_type * first,
                     const uchar_type * last, MatchInfo & matchInfo) {
+        if (this->has_split_layout())
+            return this->template match_tail_impl<true>(root, first, last, matchInfo);
+        else
+            return this->template match_tail_impl<false>(root, first, last, matchInfo);
+    }
+
+    template <bool SplitLayout>
+    inline
+    bool match_tail_impl(ident_t root, const uchar_type * first,
+                         const uchar_type * last, MatchInfo & matchInfo) {
+        const state_type * states = this->states_.data();
         uchar_type * text_first = (uchar_type *)first;
         uchar_type * text_last = (uchar_type *)last;
         uchar_type * text = text_first;
@@ -596,14 +1636,13 @@ public:
         ident_t cur = root;
         while (text < text_last) {
             std::size_t skip;
-            std::uint32_t label = utf8_decode((const char *)text, skip);
+            std::uint32_t label = this->map_label(utf8_decode((const char *)text, skip));
             assert(this->is_valid_child(cur));
-            State & cur_state = this->states_[cur];
-            ident_t base = cur_state.base;
+            ident_t base = this->template state_base<SplitLayout>(cur);
             ident_t child = base + label;
             assert(this->is_valid_child(child));
-            State & child_state = this->states_[child];
-            if (unlikely(child_state.check == cur)) {
+            if (unlikely(this->template state_check<SplitLayout>(child) == cur)) {
+                ColdState child_state = this->template cold_state<SplitLayout>(states, child);
                 cur = child;
                 text += skip;
                 if (child_state.is_final != 0) {
@@ -614,6 +1653,7 @@ public:
                 if (child_state.has_child == 0)
                     break;
             } else {
+                ColdState cur_state = this->template cold_state<SplitLayout>(states, cur);
                 if ((cur != root) && (cur_state.is_final != 0)) {
                     matchInfo.end        = (std::uint32_t)(text - text_first);
                     matchInfo.pattern_id = cur_state.pattern_id;
@@ -641,6 +1681,17 @@ public:
     inline
     bool match_tail_fast(ident_t root, const uchar_type * first,
                          const uchar_type * last, MatchInfo & matchInfo) {
+        if (this->has_split_layout())
+            return this->template match_tail_fast_impl<true>(root, first, last, matchInfo);
+        else
+            return this->template match_tail_fast_impl<false>(root, first, last, matchInfo);
+    }
+
+    template <bool SplitLayout>
+    inline
+    bool match_tail_fast_impl(ident_t root, const uchar_type * first,
+                              const uchar_type * last, MatchInfo & matchInfo) {
+        const state_type * states = this->states_.data();
         uchar_type * text_first = (uchar_type *)first;
         uchar_type * text_last = (uchar_type *)last;
         uchar_type * text = text_first;
@@ -651,17 +1702,16 @@ public:
         ident_t cur = root;
         while (text < text_last) {
             std::size_t skip;
-            std::uint32_t label = utf8_decode((const char *)text, skip);
+            std::uint32_t label = this->map_label(utf8_decode((const char *)text, skip));
             assert(this->is_valid_child(cur));
-            State & cur_state = this->states_[cur];
-            ident_t base = cur_state.base;
+            ident_t base = this->template state_base<SplitLayout>(cur);
             ident_t child = base + label;
             assert(this->is_valid_child(child));
-            State & child_state = this->states_[child];
-            if (unlikely(child_state.check == cur)) {
+            if (unlikely(this->template state_check<SplitLayout>(child) == cur)) {
                 cur = child;
                 text += skip;
             } else {
+                ColdState cur_state = this->template cold_state<SplitLayout>(states, cur);
                 if ((cur != root) && (cur_state.is_final != 0)) {
                     matchInfo.end        = (std::uint32_t)(text - text_first);
                     matchInfo.pattern_id = cur_state.pattern_id;
@@ -692,6 +1742,23 @@ public:
     // See: https://zhuanlan.zhihu.com/p/191644920 (The code is a little similar to Article 1.)
     //
     bool match_one(const uchar_type * first, const uchar_type * last, MatchInfo & matchInfo) {
+        if (this->has_split_layout())
+            return this->template match_one_impl<true>(first, last, matchInfo);
+        else
+            return this->template match_one_impl<false>(first, last, matchInfo);
+    }
+
+    bool match_one(const char_type * first, const char_type * last, MatchInfo & matchInfo) {
+        return this->match_one((const uchar_type *)first, (const uchar_type *)last, matchInfo);
+    }
+
+    bool match_one(const schar_type * first, const schar_type * last, MatchInfo & matchInfo) {
+        return this->match_one((const uchar_type *)first, (const uchar_type *)last, matchInfo);
+    }
+
+    template <bool SplitLayout>
+    bool match_one_impl(const uchar_type * first, const uchar_type * last, MatchInfo & matchInfo) {
+        const state_type * states = this->states_.data();
         uchar_type * text_first = (uchar_type *)first;
         uchar_type * text_last = (uchar_type *)last;
         uchar_type * text = text_first;
@@ -704,18 +1771,16 @@ public:
 
         while (text < text_last) {
             std::size_t skip;
-            std::uint32_t label = utf8_decode((const char *)text, skip);
+            std::uint32_t label = this->map_label(utf8_decode((const char *)text, skip));
             text += skip;
 
 RestartMatching:
             assert(this->is_valid_id(cur));
             assert((cur == root) || ((cur != root) && !this->is_free_state(cur)));
-            State & cur_state = this->states_[cur];
-            ident_t base = cur_state.base;
+            ident_t base = this->template state_base<SplitLayout>(cur);
             ident_t child = base + label;
             assert(this->is_valid_child(child));
-            State & child_state = this->states_[child];
-            if (likely(child_state.check != cur)) {
+            if (likely(this->template state_check<SplitLayout>(child) != cur)) {
                 // Mismatch, restart matching status
                 if (unlikely(cur != root)) {
                     cur = root;
@@ -723,6 +1788,7 @@ RestartMatching:
                 }
             } else {
                 // Match next word (Label)
+                ColdState child_state = this->template cold_state<SplitLayout>(states, child);
                 cur = child;
                 if (unlikely(child_state.is_final != 0)) {
                     // Matched
@@ -731,7 +1797,7 @@ RestartMatching:
                     if (unlikely(child_state.has_child != 0)) {
                         // If a sub suffix exists, match the continous longest suffixs.
                         MatchInfo matchInfo1;
-                        bool matched1 = this->match_tail_fast(cur, text, text_last, matchInfo1);
+                        bool matched1 = this->template match_tail_fast_impl<SplitLayout>(cur, text, text_last, matchInfo1);
                         if (matched1) {
                             matchInfo.end       += matchInfo1.end;
                             matchInfo.pattern_id = matchInfo1.pattern_id;
@@ -745,17 +1811,31 @@ RestartMatching:
         return matched;
     }
 
-    bool match_one(const char_type * first, const char_type * last, MatchInfo & matchInfo) {
-        return this->match_one((const uchar_type *)first, (const uchar_type *)last, matchInfo);
+    void match_one(const uchar_type * first, const uchar_type * last,
+                   std::vector<MatchInfoEx> & match_list,
+                   const on_hit_callback & onHit_callback) {
+        if (this->has_split_layout())
+            this->template match_one_impl<true>(first, last, match_list, onHit_callback);
+        else
+            this->template match_one_impl<false>(first, last, match_list, onHit_callback);
     }
 
-    bool match_one(const schar_type * first, const schar_type * last, MatchInfo & matchInfo) {
-        return this->match_one((const uchar_type *)first, (const uchar_type *)last, matchInfo);
+    void match_one(const char_type * first, const char_type * last,
+                   std::vector<MatchInfoEx> & match_list,
+                   const on_hit_callback & onHit_callback) {
+        return this->match_one((const uchar_type *)first, (const uchar_type *)last, match_list, onHit_callback);
     }
 
-    void match_one(const uchar_type * first, const uchar_type * last,
+    void match_one(const schar_type * first, const schar_type * last,
                    std::vector<MatchInfoEx> & match_list,
                    const on_hit_callback & onHit_callback) {
+        return this->match_one((const uchar_type *)first, (const uchar_type *)last, match_list, onHit_callback);
+    }
+
+    template <bool SplitLayout>
+    void match_one_impl(const uchar_type * first, const uchar_type * last,
+                        std::vector<MatchInfoEx> & match_list,
+                        const on_hit_callback & onHit_callback) {
         if (unlikely(!onHit_callback)) {
             printf("utf8::DAT<T>::match_one(): onHit_callback is required.\n\n");
             return;
@@ -764,6 +1844,8 @@ RestartMatching:
         match_list.clear();
         assert(onHit_callback);
 
+        const state_type * states = this->states_.data();
+
         uchar_type * text_first = (uchar_type *)first;
         uchar_type * text_last = (uchar_type *)last;
         uchar_type * text = text_first;
@@ -776,18 +1858,16 @@ RestartMatching:
 MatchNextWord:
         while (text < text_last) {
             std::size_t skip;
-            std::uint32_t label = utf8_decode((const char *)text, skip);
+            std::uint32_t label = this->map_label(utf8_decode((const char *)text, skip));
             text += skip;
 
 //RestartMatching:
             assert(this->is_valid_id(cur));
             assert((cur == root) || ((cur != root) && !this->is_free_state(cur)));
-            State & cur_state = this->states_[cur];
-            ident_t base = cur_state.base;
+            ident_t base = this->template state_base<SplitLayout>(cur);
             ident_t child = base + label;
             assert(this->is_valid_child(child));
-            State & child_state = this->states_[child];
-            if (likely(child_state.check != cur)) {
+            if (likely(this->template state_check<SplitLayout>(child) != cur)) {
                 // Mismatch, restart matching status and recheck first word (label).
                 if (unlikely(cur != root)) {
                     cur = root;
@@ -800,6 +1880,7 @@ MatchNextWord:
                 }
             } else {
                 // Matched first word (Label)
+                ColdState child_state = this->template cold_state<SplitLayout>(states, child);
                 cur = child;
                 if (text_save == nullptr)
                     text_save = text;                
@@ -818,7 +1899,7 @@ MatchNextWord:
                     if (unlikely(child_state.has_child != 0)) {
                         // If a sub suffix exists, match the continous longest suffixs.
                         MatchInfo matchInfo1;
-                        bool matched1 = this->match_tail(cur, text, text_last, matchInfo1);
+                        bool matched1 = this->template match_tail_impl<SplitLayout>(cur, text, text_last, matchInfo1);
                         if (matched1) {
                             matchInfo.end       += matchInfo1.end;
                             matchInfo.pattern_id = matchInfo1.pattern_id;
@@ -838,111 +1919,1181 @@ MatchNextWord:
         }
     }
 
-    void match_one(const char_type * first, const char_type * last,
+    void match_one(const uchar_type * first, const uchar_type * last,
                    std::vector<MatchInfoEx> & match_list,
-                   const on_hit_callback & onHit_callback) {
-        return this->match_one((const uchar_type *)first, (const uchar_type *)last, match_list, onHit_callback);
+                   const std::vector<int> & length_list) {
+        if (this->has_dfa())
+            this->template match_leftmost_longest<false, true, false>(first, last, match_list, length_list);
+        else if (this->has_split_layout())
+            this->template match_leftmost_longest<false, false, true>(first, last, match_list, length_list);
+        else
+            this->template match_leftmost_longest<false, false, false>(first, last, match_list, length_list);
     }
 
-    void match_one(const schar_type * first, const schar_type * last,
+    void match_one(const char_type * first, const char_type * last,
                    std::vector<MatchInfoEx> & match_list,
-                   const on_hit_callback & onHit_callback) {
-        return this->match_one((const uchar_type *)first, (const uchar_type *)last, match_list, onHit_callback);
+                   const std::vector<int> & length_list) {
+        return this->match_one((const uchar_type *)first, (const uchar_type *)last, match_list, length_list);
     }
 
-    void match_one(const uchar_type * first, const uchar_type * last,
+    void match_one(const schar_type * first, const schar_type * last,
                    std::vector<MatchInfoEx> & match_list,
                    const std::vector<int> & length_list) {
-        match_list.clear();
+        return this->match_one((const uchar_type *)first, (const uchar_type *)last, match_list, length_list);
+    }
 
-        uchar_type * text_first = (uchar_type *)first;
-        uchar_type * text_last = (uchar_type *)last;
-        uchar_type * text = text_first;
-        uchar_type * text_save = nullptr;
-        assert(text_first <= text_last);
+    //
+    // Match the whole chunk in one pass, '\n' is a hard reset label: the matching
+    // status is reset at every line end, just like one match_one() per line,
+    // but there is no per-line memchr() and call. The match offsets are from first.
+    //
+    void match_chunk(const uchar_type * first, const uchar_type * last,
+                     std::vector<MatchInfoEx> & match_list,
+                     const std::vector<int> & length_list) {
+        if (this->has_dfa())
+            this->template match_leftmost_longest<true, true, false>(first, last, match_list, length_list);
+        else if (this->has_split_layout())
+            this->template match_leftmost_longest<true, false, true>(first, last, match_list, length_list);
+        else
+            this->template match_leftmost_longest<true, false, false>(first, last, match_list, length_list);
+    }
 
-        ident_t root = this->root();
-        ident_t cur = root;
+    void match_chunk(const char_type * first, const char_type * last,
+                     std::vector<MatchInfoEx> & match_list,
+                     const std::vector<int> & length_list) {
+        return this->match_chunk((const uchar_type *)first, (const uchar_type *)last, match_list, length_list);
+    }
 
-MatchNextWord:
-        while (text < text_last) {
-            std::size_t skip;
-            std::uint32_t label = utf8_decode((const char *)text, skip);
-            text += skip;
+    void match_chunk(const schar_type * first, const schar_type * last,
+                     std::vector<MatchInfoEx> & match_list,
+                     const std::vector<int> & length_list) {
+        return this->match_chunk((const uchar_type *)first, (const uchar_type *)last, match_list, length_list);
+    }
 
-//RestartMatching:
-            assert(this->is_valid_id(cur));
-            assert((cur == root) || ((cur != root) && !this->is_free_state(cur)));
+    //
+    // The same result as match_chunk(), but the chunk is cut into K slices at the line
+    // ends and the K streams are advanced in turn, one label per step. After a step,
+    // the next state of the stream is prefetched, it's loaded while the other streams
+    // are stepping, so the cache misses of the K dependent chains are overlapped.
+    //
+    template <size_type K>
+    void match_chunk_interleaved(const uchar_type * first, const uchar_type * last,
+                                 std::vector<MatchInfoEx> & match_list,
+                                 const std::vector<int> & length_list) {
+        if (this->has_dfa())
+            this->template match_interleaved<K, true, false>(first, last, match_list, length_list);
+        else if (this->has_split_layout())
+            this->template match_interleaved<K, false, true>(first, last, match_list, length_list);
+        else
+            this->template match_interleaved<K, false, false>(first, last, match_list, length_list);
+    }
+
+    template <size_type K>
+    void match_chunk_interleaved(const char_type * first, const char_type * last,
+                                 std::vector<MatchInfoEx> & match_list,
+                                 const std::vector<int> & length_list) {
+        return this->template match_chunk_interleaved<K>((const uchar_type *)first, (const uchar_type *)last,
+                                                         match_list, length_list);
+    }
+
+    template <size_type K>
+    void match_chunk_interleaved(const schar_type * first, const schar_type * last,
+                                 std::vector<MatchInfoEx> & match_list,
+                                 const std::vector<int> & length_list) {
+        return this->template match_chunk_interleaved<K>((const uchar_type *)first, (const uchar_type *)last,
+                                                         match_list, length_list);
+    }
+
+    //
+    // Match a text which is fed piece by piece, the result is the same as match_chunk()
+    // of the whole text, but no byte is read twice. [first, last) is the next piece,
+    // it must end at a UTF-8 char boundary, and the offsets are from base. The decided
+    // matches are appended to match_list, the others are kept in the stream until the
+    // next piece or finish_stream().
+    //
+    void match_stream(MatchStream & stream, const uchar_type * base,
+                      const uchar_type * first, const uchar_type * last,
+                      std::vector<MatchInfoEx> & match_list,
+                      const std::vector<int> & length_list) {
+        stream.text = first;
+        stream.last = last;
+        if (this->has_dfa())
+            this->template match_leftmost_longest<true, true, false>(stream, base, match_list, length_list);
+        else if (this->has_split_layout())
+            this->template match_leftmost_longest<true, false, true>(stream, base, match_list, length_list);
+        else
+            this->template match_leftmost_longest<true, false, false>(stream, base, match_list, length_list);
+    }
+
+    void match_stream(MatchStream & stream, const char_type * base,
+                      const char_type * first, const char_type * last,
+                      std::vector<MatchInfoEx> & match_list,
+                      const std::vector<int> & length_list) {
+        return this->match_stream(stream, (const uchar_type *)base, (const uchar_type *)first,
+                                  (const uchar_type *)last, match_list, length_list);
+    }
+
+    //
+    // The end of the text, all the matches are decided.
+    //
+    void finish_stream(MatchStream & stream, std::vector<MatchInfoEx> & match_list) {
+        while (stream.has_pending) {
+            this->commit_pending(match_list, stream.pending, stream.has_pending,
+                                 stream.deferred, stream.min_begin);
+        }
+        stream.cur = this->root();
+        stream.min_begin = 0;
+    }
+
+    //
+    // The text before the returned offset is decided: the current state and the
+    // pending match can't reach back before it, so no new match can begin there.
+    //
+    std::uint32_t stream_decided(const MatchStream & stream, const void * base) const {
+        std::uint32_t pos = (std::uint32_t)(stream.text - (const uchar_type *)base);
+        std::uint32_t depth = this->has_dfa() ? this->dfa_depths_[stream.cur] : this->depths_[stream.cur];
+        std::uint32_t decided = pos - depth;
+        if (stream.has_pending && (stream.pending.begin < decided))
+            decided = stream.pending.begin;
+        return std::max(decided, stream.min_begin);
+    }
+
+    //
+    // The head of the stream buffer is dropped, the offsets in the stream move back.
+    //
+    void rebase_stream(MatchStream & stream, std::uint32_t offset) const {
+        if (stream.has_pending) {
+            assert(stream.pending.begin >= offset);
+            stream.pending.begin -= offset;
+            stream.pending.end -= offset;
+        }
+        for (auto iter = stream.deferred.begin(); iter != stream.deferred.end(); ++iter) {
+            assert(iter->begin >= offset);
+            iter->begin -= offset;
+            iter->end -= offset;
+        }
+        stream.min_begin = (stream.min_begin > offset) ? (stream.min_begin - offset) : 0;
+    }
+
+private:
+    //
+    // Map the failure links of the AC trie to the DAT states, and set the output links
+    // (the nearest final state on the failure chain) and the depths (in bytes).
+    // ac_queue[i] and queue[i] are the same state in BFS order, so the failure link
+    // of a state always points to a shallower state which has been linked.
+    //
+    void build_links(const std::vector<ident_t> & ac_queue,
+                     const std::vector<ident_t> & queue,
+                     const std::vector<std::uint32_t> & depth_queue) {
+        assert(ac_queue.size() == queue.size());
+        assert(ac_queue.size() == depth_queue.size());
+
+        this->acTrie_.build();
+
+        std::vector<ident_t> ac_to_dat(this->acTrie_.size(), ident_t(kInvalidIdent));
+        for (size_type i = 0; i < ac_queue.size(); i++) {
+            ac_to_dat[ac_queue[i]] = queue[i];
+        }
+
+        // Make sure that (base + label) of any state is always in range.
+        ident_t max_base = 0;
+        for (auto iter = queue.begin(); iter != queue.end(); ++iter) {
+            ident_t base = this->states_[*iter].base;
+            if (base > max_base)
+                max_base = base;
+        }
+        if (this->states_.size() < (size_type)max_base + this->label_window_) {
+            this->states_.resize((size_type)max_base + this->label_window_);
+        }
+
+        this->output_links_.clear();
+        this->output_links_.resize(this->states_.size(), ident_t(kInvalidIdent));
+        this->depths_.clear();
+        this->depths_.resize(this->states_.size(), 0);
+
+        ident_t root = this->root();
+        State & root_state = this->states_[root];
+        root_state.fail_link = kInvalidIdent;
+        root_state.has_output = 0;
+
+        for (size_type i = 1; i < queue.size(); i++) {
+            ident_t cur = queue[i];
             State & cur_state = this->states_[cur];
-            ident_t base = cur_state.base;
-            ident_t child = base + label;
-            assert(this->is_valid_child(child));
-            State & child_state = this->states_[child];
-            if (likely(child_state.check != cur)) {
-                // Mismatch, restart matching status and recheck first word (label).
-                if (unlikely(cur != root)) {
-                    cur = root;
-                    assert(text_save != nullptr);
-                    text = text_save;
-                    text_save = nullptr;
-                    goto MatchNextWord;
-                } else {
-                    assert(text_save == nullptr);
+            ident_t fail_ac = this->acTrie_.states(ac_queue[i]).fail_link;
+            ident_t fail = (fail_ac != kInvalidIdent) ? ac_to_dat[fail_ac] : root;
+            assert(this->is_valid_id(fail));
+            assert(this->depths_[fail] < depth_queue[i] || fail == root);
+
+            const State & fail_state = this->states_[fail];
+            cur_state.fail_link = fail;
+            this->output_links_[cur] = (fail_state.is_final != 0) ? fail : this->output_links_[fail];
+            cur_state.has_output = ((cur_state.is_final != 0) ||
+                                    (this->output_links_[cur] != kInvalidIdent)) ? 1 : 0;
+            this->depths_[cur] = depth_queue[i];
+        }
+    }
+
+    //
+    // The loaded arrays are copied before the online updates, and the DFA is
+    // dropped, it's built from the AC trie. The matcher uses the failure links.
+    //
+    void prepare_update() {
+        if (this->has_dfa())
+            this->clear_dfa();
+        this->states_.detach();
+        this->output_links_.detach();
+        this->depths_.detach();
+        this->label_table_.detach();
+        this->trie_file_.reset();
+        if (this->child_first_.empty())
+            this->build_update_index();
+    }
+
+    //
+    // The reverse links of the states, so an update only visits the states which
+    // refer to the changed ones, instead of all the states.
+    //
+    void build_update_index() {
+        size_type num_states = this->states_.size();
+        this->child_first_.assign(num_states, ident_t(kInvalidIdent));
+        this->child_next_.assign(num_states, ident_t(kInvalidIdent));
+        this->fail_first_.assign(num_states, ident_t(kInvalidIdent));
+        this->fail_next_.assign(num_states, ident_t(kInvalidIdent));
+        this->fail_prev_.assign(num_states, ident_t(kInvalidIdent));
+
+        for (size_type i = kFirstFreeIdent; i < num_states; i++) {
+            const State & state = this->states_[i];
+            if (state.is_free != 0) {
+                this->link_child(state.check, (ident_t)i);
+                this->link_fail(state.fail_link, (ident_t)i);
+            }
+        }
+
+        this->overflow_states_.clear();
+        for (auto iter = this->overflow_labels_.begin(); iter != this->overflow_labels_.end(); ++iter) {
+            this->overflow_states_.insert(std::make_pair(iter->second, (std::uint32_t)(iter->first & 0xFFFFFFFFu)));
+        }
+    }
+
+    void clear_update_index() {
+        this->child_first_.clear();
+        this->child_next_.clear();
+        this->fail_first_.clear();
+        this->fail_next_.clear();
+        this->fail_prev_.clear();
+        this->overflow_states_.clear();
+    }
+
+    inline void link_child(ident_t parent, ident_t child) {
+        this->child_next_[child] = this->child_first_[parent];
+        this->child_first_[parent] = child;
+    }
+
+    inline void link_fail(ident_t fail, ident_t state) {
+        ident_t first = this->fail_first_[fail];
+        this->fail_next_[state] = first;
+        this->fail_prev_[state] = kInvalidIdent;
+        if (first != kInvalidIdent)
+            this->fail_prev_[first] = state;
+        this->fail_first_[fail] = state;
+    }
+
+    inline void unlink_fail(ident_t fail, ident_t state) {
+        ident_t prev = this->fail_prev_[state];
+        ident_t next = this->fail_next_[state];
+        if (prev != kInvalidIdent)
+            this->fail_next_[prev] = next;
+        else
+            this->fail_first_[fail] = next;
+        if (next != kInvalidIdent)
+            this->fail_prev_[next] = prev;
+    }
+
+    //
+    // Change the failure link of a state, it's moved to the failure list of the new one.
+    //
+    void set_fail_link(ident_t state, ident_t fail) {
+        ident_t old_fail = this->states_[state].fail_link;
+        if (fail != old_fail) {
+            if (old_fail != kInvalidIdent)
+                this->unlink_fail(old_fail, state);
+            this->link_fail(fail, state);
+            this->states_[state].fail_link = fail;
+        }
+    }
+
+    inline std::uint32_t child_label(ident_t parent, ident_t child) const {
+        if (!this->overflow_states_.empty()) {
+            auto iter = this->overflow_states_.find(child);
+            if (iter != this->overflow_states_.end())
+                return iter->second;
+        }
+        return (child - this->states_[parent].base);
+    }
+
+    //
+    // The number of the dead states from id up to the root, the parent of a dead
+    // state is dead if it isn't final and its other children are dead too.
+    //
+    size_type count_dead_path(ident_t id) const {
+        size_type dead_states = 0;
+        ident_t dead_child = kInvalidIdent;
+        while ((id != this->root()) && !this->has_live_key(id, dead_child)) {
+            dead_states++;
+            dead_child = id;
+            id = this->states_[id].check;
+        }
+        return dead_states;
+    }
+
+    // Whether a key ends at id or below it, skip_child is known to be dead.
+    bool has_live_key(ident_t id, ident_t skip_child) const {
+        if (this->states_[id].is_final != 0)
+            return true;
+        for (ident_t child = this->child_first_[id]; child != kInvalidIdent;
+             child = this->child_next_[child]) {
+            if ((child != skip_child) && this->has_live_key(child, kInvalidIdent))
+                return true;
+        }
+        return false;
+    }
+
+    inline void update_has_output(ident_t id) {
+        State & state = this->states_[id];
+        state.has_output = ((state.is_final != 0) ||
+                            (this->output_links_[id] != kInvalidIdent)) ? 1 : 0;
+    }
+
+    //
+    // The remapped labels are 16 bits, return false if the new code points
+    // can't be added to the label table.
+    //
+    bool can_add_labels(const std::vector<std::uint32_t> & code_points) const {
+        if (!this->use_label_remap_)
+            return true;
+        std::vector<std::uint32_t> new_labels;
+        for (auto iter = code_points.begin(); iter != code_points.end(); ++iter) {
+            if (this->map_label(*iter) == 0)
+                new_labels.push_back(*iter);
+        }
+        std::sort(new_labels.begin(), new_labels.end());
+        size_type num_new = std::unique(new_labels.begin(), new_labels.end()) - new_labels.begin();
+        return ((size_type)this->label_window_ + num_new <= kMaxAscii);
+    }
+
+    //
+    // Return the label of a code point, a new code point gets the next label,
+    // then (base + label) of every state must be still in range.
+    //
+    std::uint32_t add_label(std::uint32_t code_point) {
+        std::uint32_t label = this->map_label(code_point);
+        if (!this->use_label_remap_ || (label != 0))
+            return label;
+
+        label = this->label_window_;
+        assert(label < kMaxAscii);
+        if (code_point < kMaxAscii)
+            this->label_table_[code_point] = (std::uint16_t)label;
+        else
+            this->overflow_label_table_.insert(std::make_pair(code_point, label));
+        this->label_window_ = label + 1;
+
+        // The states are always padded to (max base + label_window_), see build_links()
+        // and find_online_base(), so one more cell is enough for the new label.
+        this->grow_states(this->states_.size() + 1);
+        return label;
+    }
+
+    void grow_states(size_type new_size) {
+        if (new_size > this->states_.size()) {
+            this->states_.resize(new_size);
+            this->output_links_.resize(new_size, ident_t(kInvalidIdent));
+            this->depths_.resize(new_size, 0);
+            if (!this->child_first_.empty()) {
+                this->child_first_.resize(new_size, ident_t(kInvalidIdent));
+                this->child_next_.resize(new_size, ident_t(kInvalidIdent));
+                this->fail_first_.resize(new_size, ident_t(kInvalidIdent));
+                this->fail_next_.resize(new_size, ident_t(kInvalidIdent));
+                this->fail_prev_.resize(new_size, ident_t(kInvalidIdent));
+            }
+        }
+    }
+
+    inline bool is_free_cell_online(ident_t cell) const {
+        return ((cell >= kFirstFreeIdent) &&
+                ((cell >= this->max_state_id()) || this->is_free_state(cell)));
+    }
+
+    //
+    // Return the first free cell at or after first, there are always the free
+    // cells at the end, the padding of (base + label).
+    //
+    ident_t next_free_state(ident_t first) {
+        if (first < kFirstFreeIdent)
+            first = kFirstFreeIdent;
+        while (!this->is_free_cell_online(first)) {
+            first++;
+        }
+        this->grow_states((size_type)first + 1);
+        return first;
+    }
+
+    //
+    // Find a base that all (base + label) are free, labels[0] is the min label.
+    //
+    ident_t find_online_base(const std::vector<std::uint32_t> & labels) {
+        assert(!labels.empty());
+        std::uint32_t min_label = labels[0];
+        ident_t first_free = this->next_free_state(this->first_free_id());
+        this->set_first_free_id(first_free);
+
+        ident_t cell = first_free;
+        if (cell < kFirstFreeIdent + min_label)
+            cell = kFirstFreeIdent + min_label;
+        do {
+            cell = this->next_free_state(cell);
+            ident_t base = cell - min_label;
+            bool base_found = true;
+            for (size_type i = 1; i < labels.size(); i++) {
+                if (!this->is_free_cell_online(base + labels[i])) {
+                    base_found = false;
+                    break;
+                }
+            }
+            if (base_found) {
+                // Make sure that (base + label) of any label is in range.
+                this->grow_states((size_type)base + this->label_window_);
+                return base;
+            }
+            cell++;
+        } while (1);
+    }
+
+    //
+    // Add a new child of the state, the children are moved to a new base if the
+    // cell is used. The labels above kOverFlowLable are put into any free cell.
+    //
+    ident_t add_child(ident_t parent, std::uint32_t label) {
+        ident_t child;
+        if (label >= kOverFlowLable) {
+            child = this->next_free_state(this->first_free_id());
+            std::uint64_t ident_and_label = ((std::uint64_t)parent << 32u) | label;
+            assert(this->overflow_labels_.count(ident_and_label) == 0);
+            this->overflow_labels_.insert(std::make_pair(ident_and_label, child));
+            this->overflow_states_.insert(std::make_pair(child, label));
+        } else {
+            ident_t base = this->states_[parent].base;
+            if ((base == 0) || !this->is_free_cell_online(base + label))
+                base = this->move_children(parent, label);
+            child = base + label;
+        }
+
+        assert(this->is_free_cell_online(child));
+        State & child_state = this->states_[child];
+        child_state.check = parent;
+        child_state.fail_link = 0;
+        child_state.identifier = 0;
+        this->link_child(parent, child);
+        return child;
+    }
+
+    //
+    // Move the children of the state to a new base which has a free cell for
+    // new_label too. The overflow children are not in the window of the base,
+    // they are not moved.
+    //
+    ident_t move_children(ident_t parent, std::uint32_t new_label) {
+        ident_t old_base = this->states_[parent].base;
+
+        std::vector<ident_t> overflow_children;
+        std::vector<std::uint32_t> labels;
+        for (ident_t child = this->child_first_[parent]; child != kInvalidIdent;
+             child = this->child_next_[child]) {
+            if (this->overflow_states_.count(child) != 0)
+                overflow_children.push_back(child);
+            else
+                labels.push_back(child - old_base);
+        }
+        std::sort(labels.begin(), labels.end());
+
+        std::vector<std::uint32_t> new_labels(labels);
+        new_labels.push_back(new_label);
+        std::sort(new_labels.begin(), new_labels.end());
+        ident_t new_base = this->find_online_base(new_labels);
+        this->states_[parent].base = new_base;
+        if (labels.empty())
+            return new_base;
+
+        for (auto iter = labels.begin(); iter != labels.end(); ++iter) {
+            this->move_state(old_base + *iter, new_base + *iter);
+        }
+
+        // The sibling list has the new identifiers.
+        this->child_first_[parent] = kInvalidIdent;
+        for (auto iter = overflow_children.begin(); iter != overflow_children.end(); ++iter) {
+            this->link_child(parent, *iter);
+        }
+        for (auto iter = labels.begin(); iter != labels.end(); ++iter) {
+            this->link_child(parent, new_base + *iter);
+        }
+        return new_base;
+    }
+
+    //
+    // Move a state to a free cell, the references to it are renamed by the indexes:
+    // the check of its children, the failure links of its failure list, and the
+    // output links if it's final. The siblings are moved together, and the states
+    // which refer to a moved state are never its siblings (they are deeper or
+    // shallower), the sibling list is fixed by move_children().
+    //
+    void move_state(ident_t from, ident_t to) {
+        assert(this->is_free_cell_online(to));
+        this->states_[to] = this->states_[from];
+        this->output_links_[to] = this->output_links_[from];
+        this->depths_[to] = this->depths_[from];
+
+        ident_t prev = this->fail_prev_[from];
+        ident_t next = this->fail_next_[from];
+        this->fail_prev_[to] = prev;
+        this->fail_next_[to] = next;
+        if (prev != kInvalidIdent)
+            this->fail_next_[prev] = to;
+        else
+            this->fail_first_[this->states_[to].fail_link] = to;
+        if (next != kInvalidIdent)
+            this->fail_prev_[next] = to;
+
+        this->child_first_[to] = this->child_first_[from];
+        for (ident_t child = this->child_first_[to]; child != kInvalidIdent;
+             child = this->child_next_[child]) {
+            this->states_[child].check = to;
+            auto overflow_iter = this->overflow_states_.find(child);
+            if (overflow_iter != this->overflow_states_.end()) {
+                std::uint64_t label = overflow_iter->second;
+                this->overflow_labels_.erase(((std::uint64_t)from << 32u) | label);
+                this->overflow_labels_.insert(std::make_pair(((std::uint64_t)to << 32u) | label, child));
+            }
+        }
+
+        this->fail_first_[to] = this->fail_first_[from];
+        for (ident_t state = this->fail_first_[to]; state != kInvalidIdent;
+             state = this->fail_next_[state]) {
+            this->states_[state].fail_link = to;
+        }
+
+        if (this->states_[to].is_final != 0)
+            this->rename_output_links(from, to);
+
+        this->states_[from] = State();
+        this->output_links_[from] = kInvalidIdent;
+        this->depths_[from] = 0;
+        this->child_first_[from] = kInvalidIdent;
+        this->child_next_[from] = kInvalidIdent;
+        this->fail_first_[from] = kInvalidIdent;
+        this->fail_next_[from] = kInvalidIdent;
+        this->fail_prev_[from] = kInvalidIdent;
+        if (from < this->first_free_id())
+            this->set_first_free_id(from);
+    }
+
+    //
+    // The states whose output link is the moved final state are in its failure
+    // subtree, below another final state the output links are the nearer one.
+    //
+    void rename_output_links(ident_t from, ident_t to) {
+        std::vector<ident_t> stack;
+        stack.push_back(to);
+        while (!stack.empty()) {
+            ident_t fail = stack.back();
+            stack.pop_back();
+            for (ident_t cur = this->fail_first_[fail]; cur != kInvalidIdent;
+                 cur = this->fail_next_[cur]) {
+                if (this->output_links_[cur] == from) {
+                    this->output_links_[cur] = to;
+                    if (this->states_[cur].is_final == 0)
+                        stack.push_back(cur);
+                }
+            }
+        }
+    }
+
+    //
+    // The state is final or not final now, the output links of its failure subtree
+    // are set again, a subtree is skipped if its top keeps the output link.
+    //
+    void relink_outputs(ident_t state) {
+        std::vector<ident_t> stack;
+        stack.push_back(state);
+        while (!stack.empty()) {
+            ident_t fail = stack.back();
+            stack.pop_back();
+            ident_t output = (this->states_[fail].is_final != 0) ? fail : this->output_links_[fail];
+            for (ident_t cur = this->fail_first_[fail]; cur != kInvalidIdent;
+                 cur = this->fail_next_[cur]) {
+                if (this->output_links_[cur] != output) {
+                    this->output_links_[cur] = output;
+                    this->update_has_output(cur);
+                    stack.push_back(cur);
+                }
+            }
+        }
+    }
+
+    //
+    // Fix the links after the new states are added below last_state, labels[i] is
+    // the label of new_states[i]. A failure link can only change to a new state, so
+    // only the states whose failure chain passes through a new state are visited,
+    // in depth order, then the parent and the failure link of a state are always
+    // done before it. The seeds are the new states, and the children by labels[0]
+    // of the failure subtree of last_state (it has the new child). If the chain of
+    // a state is changed, its failure list and its children by the deeper labels
+    // are visited too.
+    //
+    void relink_states(ident_t last_state, const std::vector<ident_t> & new_states,
+                       const std::vector<std::uint32_t> & labels) {
+        typedef std::pair<std::uint32_t, ident_t> depth_state;
+        std::priority_queue<depth_state, std::vector<depth_state>, std::greater<depth_state>> queue;
+        std::unordered_set<ident_t> queued;
+        std::unordered_set<ident_t> changed;
+
+        auto visit = [&](ident_t state) {
+            if (queued.insert(state).second)
+                queue.push(std::make_pair(this->depths_[state], state));
+        };
+
+        for (auto iter = new_states.begin(); iter != new_states.end(); ++iter) {
+            visit(*iter);
+        }
+
+        // The new states are not in the failure lists yet.
+        std::vector<ident_t> stack;
+        stack.push_back(last_state);
+        while (!stack.empty()) {
+            ident_t fail = stack.back();
+            stack.pop_back();
+            for (ident_t cur = this->fail_first_[fail]; cur != kInvalidIdent;
+                 cur = this->fail_next_[cur]) {
+                ident_t child = this->next_state(cur, labels[0]);
+                if (child != kInvalidIdent)
+                    visit(child);
+                stack.push_back(cur);
+            }
+        }
+
+        while (!queue.empty()) {
+            ident_t cur = queue.top().second;
+            queue.pop();
+
+            ident_t parent = this->states_[cur].check;
+            ident_t old_fail = this->states_[cur].fail_link;
+            ident_t fail = this->find_fail_link(parent, this->child_label(parent, cur));
+            assert(this->is_valid_id(fail));
+            this->set_fail_link(cur, fail);
+
+            const State & fail_state = this->states_[fail];
+            this->output_links_[cur] = (fail_state.is_final != 0) ? fail : this->output_links_[fail];
+            this->update_has_output(cur);
+
+            bool is_new = (std::find(new_states.begin(), new_states.end(), cur) != new_states.end());
+            if (is_new || (fail != old_fail) || (changed.count(fail) != 0)) {
+                changed.insert(cur);
+                for (ident_t state = this->fail_first_[cur]; state != kInvalidIdent;
+                     state = this->fail_next_[state]) {
+                    visit(state);
+                }
+                for (size_type i = 1; i < labels.size(); i++) {
+                    ident_t child = this->next_state(cur, labels[i]);
+                    if (child != kInvalidIdent)
+                        visit(child);
+                }
+            }
+        }
+    }
+
+    //
+    // The failure link of the child (of parent by label), like the AC trie build.
+    //
+    ident_t find_fail_link(ident_t parent, std::uint32_t label) const {
+        ident_t root = this->root();
+        if (parent == root)
+            return root;
+        ident_t node = this->states_[parent].fail_link;
+        do {
+            ident_t child = this->next_state(node, label);
+            if (child != kInvalidIdent)
+                return child;
+            if (node == root)
+                return root;
+            node = this->states_[node].fail_link;
+        } while (1);
+    }
+
+    //
+    // Collect the keys of the final states, the labels are mapped back to the
+    // code points.
+    //
+    void collect_keys(std::vector<std::pair<std::string, std::uint32_t>> & key_list) const {
+        key_list.clear();
+        size_type num_states = this->states_.size();
+
+        std::unordered_map<ident_t, std::uint32_t> overflow_states;
+        for (auto iter = this->overflow_labels_.begin(); iter != this->overflow_labels_.end(); ++iter) {
+            overflow_states.insert(std::make_pair(iter->second, (std::uint32_t)(iter->first & 0xFFFFFFFFu)));
+        }
+
+        std::vector<std::uint32_t> code_points;
+        if (this->use_label_remap_) {
+            code_points.resize(this->label_window_, 0);
+            for (std::uint32_t code_point = 0; code_point < this->label_table_.size(); code_point++) {
+                std::uint32_t label = this->label_table_[code_point];
+                if (label != 0)
+                    code_points[label] = code_point;
+            }
+            for (auto iter = this->overflow_label_table_.begin();
+                iter != this->overflow_label_table_.end(); ++iter) {
+                code_points[iter->second] = iter->first;
+            }
+        }
+
+        // The children of each state, children[child_first[i], child_first[i + 1]).
+        std::vector<ident_t> child_first(num_states + 1, 0);
+        for (size_type i = kFirstFreeIdent; i < num_states; i++) {
+            if (this->states_[i].is_free != 0)
+                child_first[this->states_[i].check + 1]++;
+        }
+        for (size_type i = 0; i < num_states; i++) {
+            child_first[i + 1] += child_first[i];
+        }
+        std::vector<ident_t> children(child_first[num_states]);
+        std::vector<ident_t> child_next(child_first.begin(), child_first.end() - 1);
+        for (size_type i = kFirstFreeIdent; i < num_states; i++) {
+            if (this->states_[i].is_free != 0)
+                children[child_next[this->states_[i].check]++] = (ident_t)i;
+        }
+
+        std::string key;
+        std::vector<std::pair<ident_t, size_type>> stack;
+        stack.push_back(std::make_pair(this->root(), size_type(0)));
+        while (!stack.empty()) {
+            ident_t cur = stack.back().first;
+            key.resize(stack.back().second);
+            stack.pop_back();
+
+            const State & cur_state = this->states_[cur];
+            if (cur != this->root()) {
+                ident_t parent = cur_state.check;
+                std::uint32_t label;
+                auto overflow_iter = overflow_states.find(cur);
+                if (overflow_iter != overflow_states.end())
+                    label = overflow_iter->second;
+                else
+                    label = cur - this->states_[parent].base;
+                std::uint32_t code_point = this->use_label_remap_ ? code_points[label] : label;
+                char utf8[8];
+                std::size_t utf8_len = utf8_encode(code_point, utf8);
+                key.append(utf8, utf8_len);
+                if (cur_state.is_final != 0)
+                    key_list.push_back(std::make_pair(key, (std::uint32_t)cur_state.pattern_id));
+            }
+
+            for (ident_t i = child_first[cur]; i < child_first[cur + 1]; i++) {
+                stack.push_back(std::make_pair(children[i], key.size()));
+            }
+        }
+    }
+
+    //
+    // Leftmost-longest, non-overlapping matching by the failure links, every label is
+    // read once. A match is kept as pending until the current state can't reach back
+    // to its begin, then no later match can begin before or at it, so it's committed.
+    // The shorter matches which begin after the pending end are deferred, they are
+    // the candidates after the pending is committed. If LineReset is true, '\n' is
+    // a hard reset label. If UseDfa is true, walk the full DFA table instead.
+    // If SplitLayout is true, the transitions, failure links and the output test
+    // use hot_states_, the outputs use cold_states_.
+    //
+    template <bool LineReset, bool UseDfa, bool SplitLayout>
+    void match_leftmost_longest(const uchar_type * first, const uchar_type * last,
+                                std::vector<MatchInfoEx> & match_list,
+                                const std::vector<int> & length_list) {
+        match_list.clear();
+
+        MatchStream stream;
+        stream.text = first;
+        stream.last = last;
+        this->template match_leftmost_longest<LineReset, UseDfa, SplitLayout>(
+                            stream, first, match_list, length_list);
+        while (stream.has_pending) {
+            this->commit_pending(match_list, stream.pending, stream.has_pending,
+                                 stream.deferred, stream.min_begin);
+        }
+    }
+
+    //
+    // Match [stream.text, stream.last) from the status of the stream, the offsets are
+    // from base. The pending and the deferred matches are left in the stream.
+    // The status is copied to the locals, so the loop is the same as a one-shot match.
+    //
+    template <bool LineReset, bool UseDfa, bool SplitLayout>
+    void match_leftmost_longest(MatchStream & stream, const uchar_type * base,
+                                std::vector<MatchInfoEx> & match_list,
+                                const std::vector<int> & length_list) {
+        uchar_type * text_first = (uchar_type *)base;
+        uchar_type * text_last = (uchar_type *)stream.last;
+        uchar_type * text = (uchar_type *)stream.text;
+        assert(text_first <= text);
+        assert(text <= text_last);
+
+        const state_type * states = UseDfa ? this->dfa_states_.data() : this->states_.data();
+        const ident_t * output_links = UseDfa ? this->dfa_output_links_.data() : this->output_links_.data();
+        const std::uint32_t * depths = UseDfa ? this->dfa_depths_.data() : this->depths_.data();
+        const HotState * hot_states = this->hot_states_.data();
+
+        ident_t root = this->root();
+        ident_t cur = stream.cur;
+
+        MatchInfoEx pending = stream.pending;
+        bool has_pending = stream.has_pending;
+        std::vector<MatchInfoEx> & deferred = stream.deferred;
+        // The matches must begin at or after the end of the last committed match.
+        std::uint32_t min_begin = stream.min_begin;
+
+        const BytePrefilter * prefilter = this->has_prefilter() ? &this->prefilter_ : nullptr;
+
+        while (text < text_last) {
+            // At the root, the labels which can't begin a key only stay at the root
+            // (and '\n' only resets it), so skip to the next candidate.
+            if ((prefilter != nullptr) && (cur == root) && !has_pending &&
+                !prefilter->has_first((std::uint8_t)*text)) {
+                text = (uchar_type *)prefilter->find((const std::uint8_t *)text + 1,
+                                                     (const std::uint8_t *)text_last);
+                if (unlikely(text >= text_last))
+                    break;
+            }
+
+            std::size_t skip;
+            std::uint32_t label = utf8_decode((const char *)text, skip);
+            text += skip;
+
+            if (LineReset && unlikely(label == std::uint32_t('\n'))) {
+                while (has_pending) {
+                    this->commit_pending(match_list, pending, has_pending, deferred, min_begin);
                 }
+                cur = root;
+                continue;
+            }
+
+            if (UseDfa) {
+                cur = this->dfa_next_state(cur, label);
             } else {
-                // Matched first word (Label)
-                cur = child;
-                if (text_save == nullptr)
-                    text_save = text;                
+                label = this->map_label(label);
+                // The remapped label 0 is not in the dictionary, go back to the root.
+                ident_t child = kInvalidIdent;
+                if (likely(label != 0) || !this->use_label_remap_) {
+                    // Follow the failure links until the label is accepted or reach the root.
+                    do {
+                        assert(this->is_valid_id(cur));
+                        if (SplitLayout)
+                            child = this->hot_next_state(cur, label);
+                        else
+                            child = this->next_state(cur, label);
+                        if (likely(child != kInvalidIdent) || (cur == root))
+                            break;
+                        cur = SplitLayout ? hot_states[cur].fail_link : this->states_[cur].fail_link;
+                    } while (1);
+                }
+                cur = (child != kInvalidIdent) ? child : root;
+            }
 
-                if (likely(child_state.is_final == 0)) {
-                    if (likely(child_state.has_child == 0)) {
-                        // Matched one, restart matching status, match next ...
-                        cur = root;
-                        text = text_save;
-                        text_save = nullptr;
-                    }
-                } else {
-                    // Matched
-                    MatchInfoEx matchInfo;
-                    matchInfo.end        = (std::uint32_t)(text - text_first);
-                    matchInfo.pattern_id = child_state.pattern_id;
-                    if (unlikely(child_state.has_child != 0)) {
-                        // If a sub suffix exists, match the continous longest suffixs.
-                        MatchInfo matchInfo1;
-                        bool matched1 = this->match_tail(cur, text, text_last, matchInfo1);
-                        if (matched1) {
-                            matchInfo.end       += matchInfo1.end;
-                            matchInfo.pattern_id = matchInfo1.pattern_id;
-                            text += matchInfo1.end;
+            std::uint32_t pos = (std::uint32_t)(text - text_first);
+            while (unlikely(has_pending) && ((pos - depths[cur]) > pending.begin)) {
+                this->commit_pending(match_list, pending, has_pending, deferred, min_begin);
+            }
+
+            bool has_output;
+            if (SplitLayout)
+                has_output = ((hot_states[cur].base & kHotOutputMask) != 0);
+            else
+                has_output = (states[cur].has_output != 0);
+            if (unlikely(has_output)) {
+                ColdState cur_state = this->template cold_state<SplitLayout>(states, cur);
+                // The output chain is from the longest to the shortest.
+                ident_t node = (cur_state.is_final != 0) ? cur : output_links[cur];
+                do {
+                    ColdState node_state = this->template cold_state<SplitLayout>(states, node);
+                    std::uint32_t length = (std::uint32_t)length_list[node_state.pattern_id];
+                    assert(length > 0);
+                    std::uint32_t begin = pos - length;
+                    if (begin >= min_begin) {
+                        if (!has_pending || (begin <= pending.begin)) {
+                            // The shorter ones overlap with it.
+                            pending.begin      = begin;
+                            pending.end        = pos;
+                            pending.pattern_id = node_state.pattern_id;
+                            pending.reserve    = 0;
+                            has_pending = true;
+                            break;
+                        } else if (begin >= pending.end) {
+                            MatchInfoEx matchInfo;
+                            matchInfo.begin      = begin;
+                            matchInfo.end        = pos;
+                            matchInfo.pattern_id = node_state.pattern_id;
+                            matchInfo.reserve    = 0;
+                            deferred.push_back(matchInfo);
                         }
                     }
-                    std::uint32_t length = length_list[matchInfo.pattern_id];
-                    assert(length > 0);
-                    matchInfo.begin = matchInfo.end - length;
-                    match_list.push_back(matchInfo);
+                    node = output_links[node];
+                } while (node != kInvalidIdent);
+            }
+        }
 
-                    // Matched one, restart matching status, match next ...
-                    cur = root;
-                    text_save = nullptr;
+        stream.text = text_last;
+        stream.cur = cur;
+        stream.pending = pending;
+        stream.has_pending = has_pending;
+        stream.min_begin = min_begin;
+    }
+
+    //
+    // Commit the pending match, the leftmost-longest deferred match which begins
+    // after it becomes the next pending.
+    //
+    void commit_pending(std::vector<MatchInfoEx> & match_list,
+                        MatchInfoEx & pending, bool & has_pending,
+                        std::vector<MatchInfoEx> & deferred,
+                        std::uint32_t & min_begin) {
+        assert(has_pending);
+        match_list.push_back(pending);
+        min_begin = pending.end;
+        has_pending = false;
+
+        size_type count = 0;
+        for (auto iter = deferred.begin(); iter != deferred.end(); ++iter) {
+            const MatchInfoEx & matchInfo = *iter;
+            if (matchInfo.begin >= min_begin) {
+                if (!has_pending || (matchInfo.begin < pending.begin) ||
+                    ((matchInfo.begin == pending.begin) && (matchInfo.end > pending.end))) {
+                    pending = matchInfo;
+                    has_pending = true;
                 }
+                deferred[count++] = matchInfo;
             }
         }
+        deferred.resize(count);
     }
 
-    void match_one(const char_type * first, const char_type * last,
-                   std::vector<MatchInfoEx> & match_list,
-                   const std::vector<int> & length_list) {
-        return this->match_one((const uchar_type *)first, (const uchar_type *)last, match_list, length_list);
+    //
+    // In match_interleaved(), the label to step is decoded ahead (the DFA label class
+    // if it uses DFA, '\n' is kLineResetLabel), then its next state can be prefetched.
+    //
+    static const std::uint32_t kLineResetLabel = 0xFFFFFFFFu;
+
+    template <bool UseDfa, bool SplitLayout>
+    inline void decode_and_prefetch(MatchStream & stream) const {
+        std::size_t skip;
+        std::uint32_t label = utf8_decode((const char *)stream.text, skip);
+        stream.skip = (std::uint32_t)skip;
+        if (unlikely(label == std::uint32_t('\n'))) {
+            stream.label = kLineResetLabel;
+        } else if (UseDfa) {
+            stream.label = this->dfa_label_class(label);
+            DAT_PREFETCH(&this->dfa_table_[stream.cur * this->dfa_alphabet_size_ + stream.label]);
+        } else {
+            stream.label = this->map_label(label);
+            if (likely(stream.label < kOverFlowLable)) {
+                if (SplitLayout)
+                    DAT_PREFETCH(&this->hot_states_[(this->hot_states_[stream.cur].base & kHotBaseMask) + stream.label]);
+                else
+                    DAT_PREFETCH(&this->states_[this->states_[stream.cur].base + stream.label]);
+            }
+        }
     }
 
-    void match_one(const schar_type * first, const schar_type * last,
-                   std::vector<MatchInfoEx> & match_list,
-                   const std::vector<int> & length_list) {
-        return this->match_one((const uchar_type *)first, (const uchar_type *)last, match_list, length_list);
+    //
+    // Step one label of the stream and prefetch the next state of it,
+    // return false if the slice is done.
+    //
+    template <bool UseDfa, bool SplitLayout>
+    inline bool step_stream(MatchStream & stream, const uchar_type * first,
+                            const std::vector<int> & length_list) {
+        const state_type * states = UseDfa ? this->dfa_states_.data() : this->states_.data();
+        const ident_t * output_links = UseDfa ? this->dfa_output_links_.data() : this->output_links_.data();
+        const std::uint32_t * depths = UseDfa ? this->dfa_depths_.data() : this->depths_.data();
+        const HotState * hot_states = this->hot_states_.data();
+        ident_t root = this->root();
+
+        std::uint32_t label = stream.label;
+        stream.text += stream.skip;
+        ident_t cur = stream.cur;
+
+        if (unlikely(label == kLineResetLabel)) {
+            while (stream.has_pending) {
+                this->commit_pending(stream.match_list, stream.pending, stream.has_pending,
+                                     stream.deferred, stream.min_begin);
+            }
+            cur = root;
+        } else {
+            if (UseDfa) {
+                cur = this->dfa_table_[cur * this->dfa_alphabet_size_ + label];
+            } else {
+                // The remapped label 0 is not in the dictionary, go back to the root.
+                ident_t child = kInvalidIdent;
+                if (likely(label != 0) || !this->use_label_remap_) {
+                    do {
+                        if (SplitLayout)
+                            child = this->hot_next_state(cur, label);
+                        else
+                            child = this->next_state(cur, label);
+                        if (likely(child != kInvalidIdent) || (cur == root))
+                            break;
+                        cur = SplitLayout ? hot_states[cur].fail_link : this->states_[cur].fail_link;
+                    } while (1);
+                }
+                cur = (child != kInvalidIdent) ? child : root;
+            }
+
+            std::uint32_t pos = (std::uint32_t)(stream.text - first);
+            while (unlikely(stream.has_pending) && ((pos - depths[cur]) > stream.pending.begin)) {
+                this->commit_pending(stream.match_list, stream.pending, stream.has_pending,
+                                     stream.deferred, stream.min_begin);
+            }
+
+            bool has_output;
+            if (SplitLayout)
+                has_output = ((hot_states[cur].base & kHotOutputMask) != 0);
+            else
+                has_output = (states[cur].has_output != 0);
+            if (unlikely(has_output)) {
+                this->template add_outputs<SplitLayout>(stream, states, output_links, length_list, cur, pos);
+            }
+        }
+        stream.cur = cur;
+
+        if (likely(stream.text < stream.last)) {
+            this->template decode_and_prefetch<UseDfa, SplitLayout>(stream);
+            return true;
+        } else {
+            while (stream.has_pending) {
+                this->commit_pending(stream.match_list, stream.pending, stream.has_pending,
+                                     stream.deferred, stream.min_begin);
+            }
+            return false;
+        }
+    }
+
+    template <size_type K, bool UseDfa, bool SplitLayout>
+    void match_interleaved(const uchar_type * first, const uchar_type * last,
+                           std::vector<MatchInfoEx> & match_list,
+                           const std::vector<int> & length_list) {
+        static_assert((K > 0), "DAT::match_interleaved<K>(): K must be at least 1.");
+        match_list.clear();
+        assert(first <= last);
+
+        ident_t root = this->root();
+
+        // Cut the chunk into K slices, every slice begins at a line head.
+        MatchStream streams[K];
+        size_type active[K];
+        size_type active_count = 0;
+        std::size_t chunk_size = (std::size_t)(last - first);
+        const uchar_type * slice_first = first;
+        for (size_type i = 0; i < K; i++) {
+            const uchar_type * slice_last = last;
+            if (i < (K - 1)) {
+                slice_last = first + chunk_size * (i + 1) / K;
+                if (slice_last <= slice_first) {
+                    slice_last = slice_first;
+                } else {
+                    const uchar_type * line_end = (const uchar_type *)
+                        std::memchr(slice_last - 1, '\n', (std::size_t)(last - (slice_last - 1)));
+                    slice_last = (line_end != nullptr) ? (line_end + 1) : last;
+                }
+            }
+            MatchStream & stream = streams[i];
+            stream.text = slice_first;
+            stream.last = slice_last;
+            stream.cur = root;
+            stream.has_pending = false;
+            stream.min_begin = 0;
+            if (slice_first < slice_last) {
+                this->template decode_and_prefetch<UseDfa, SplitLayout>(stream);
+                active[active_count++] = i;
+            }
+            slice_first = slice_last;
+        }
+
+        // All the streams are stepped in turn while none of them is done, the loop
+        // is unrolled by the compiler, then the rest ones are stepped by the list.
+        if (active_count == K) {
+            bool all_active;
+            do {
+                all_active = true;
+                for (size_type i = 0; i < K; i++) {
+                    all_active &= this->template step_stream<UseDfa, SplitLayout>(streams[i], first, length_list);
+                }
+            } while (likely(all_active));
+
+            active_count = 0;
+            for (size_type i = 0; i < K; i++) {
+                if (streams[i].text < streams[i].last)
+                    active[active_count++] = i;
+            }
+        }
+
+        while (active_count > 0) {
+            for (size_type n = 0; n < active_count; ) {
+                bool is_active = this->template step_stream<UseDfa, SplitLayout>(streams[active[n]], first, length_list);
+                if (likely(is_active)) {
+                    n++;
+                } else {
+                    // The slice is done, the order of the active streams doesn't matter.
+                    active[n] = active[--active_count];
+                }
+            }
+        }
+
+        for (size_type i = 0; i < K; i++) {
+            match_list.insert(match_list.end(), streams[i].match_list.begin(), streams[i].match_list.end());
+        }
+    }
+
+    //
+    // The same as the output step of match_leftmost_longest().
+    //
+    template <bool SplitLayout>
+    void add_outputs(MatchStream & stream, const state_type * states,
+                     const ident_t * output_links, const std::vector<int> & length_list,
+                     ident_t cur, std::uint32_t pos) {
+        ColdState cur_state = this->template cold_state<SplitLayout>(states, cur);
+        // The output chain is from the longest to the shortest.
+        ident_t node = (cur_state.is_final != 0) ? cur : output_links[cur];
+        do {
+            ColdState node_state = this->template cold_state<SplitLayout>(states, node);
+            std::uint32_t length = (std::uint32_t)length_list[node_state.pattern_id];
+            assert(length > 0);
+            std::uint32_t begin = pos - length;
+            if (begin >= stream.min_begin) {
+                if (!stream.has_pending || (begin <= stream.pending.begin)) {
+                    // The shorter ones overlap with it.
+                    stream.pending.begin      = begin;
+                    stream.pending.end        = pos;
+                    stream.pending.pattern_id = node_state.pattern_id;
+                    stream.pending.reserve    = 0;
+                    stream.has_pending = true;
+                    break;
+                } else if (begin >= stream.pending.end) {
+                    MatchInfoEx matchInfo;
+                    matchInfo.begin      = begin;
+                    matchInfo.end        = pos;
+                    matchInfo.pattern_id = node_state.pattern_id;
+                    matchInfo.reserve    = 0;
+                    stream.deferred.push_back(matchInfo);
+                }
+            }
+            node = output_links[node];
+        } while (node != kInvalidIdent);
     }
 
-private:
     void create_root() {
         assert(this->states_.size() == 0);
 
@@ -951,7 +3102,7 @@ private:
         dummy.base = 0;
         dummy.check = 0;
         dummy.identifier = 0;
-        dummy.reserve = 0;
+        dummy.fail_link = 0;
         this->states_.push_back(std::move(dummy));
 
         // Append root state, Identifier = 1
@@ -959,11 +3110,63 @@ private:
         root.base = 0;
         root.check = 0;
         root.identifier = 0;
-        root.reserve = 0;
+        root.fail_link = 0;
         this->states_.push_back(std::move(root));
     }
 };
 
+//
+// The DAT built with the frequency-ranked labels, see DAT<CharT>::set_label_remap().
+//
+template <typename CharT>
+class DAT_Remap : public DAT<CharT> {
+public:
+    DAT_Remap() : DAT<CharT>() {
+        this->set_label_remap(true);
+    }
+
+    virtual ~DAT_Remap() {}
+};
+
+//
+// The DAT built in the split layout, see DAT<CharT>::set_split_layout().
+//
+template <typename CharT>
+class DAT_Split : public DAT<CharT> {
+public:
+    DAT_Split() : DAT<CharT>() {
+        this->set_split_layout(true);
+    }
+
+    virtual ~DAT_Split() {}
+};
+
+//
+// The DAT built in the full DFA mode, see DAT<CharT>::set_dfa_mode().
+//
+template <typename CharT>
+class DAT_DFA : public DAT<CharT> {
+public:
+    DAT_DFA() : DAT<CharT>() {
+        this->set_dfa_mode(true);
+    }
+
+    virtual ~DAT_DFA() {}
+};
+
+//
+// The DAT with the first bytes prefilter, see DAT<CharT>::set_prefilter().
+//
+template <typename CharT>
+class DAT_Prefilter : public DAT<CharT> {
+public:
+    DAT_Prefilter() : DAT<CharT>() {
+        this->set_prefilter(true);
+    }
+
+    virtual ~DAT_Prefilter() {}
+};
+
 } // namespace utf8
 
 #endif // DOUBLE_ARRAY_TRIE_UTF8_H
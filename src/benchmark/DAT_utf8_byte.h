@@ -0,0 +1,554 @@
+
+#ifndef DOUBLE_ARRAY_TRIE_UTF8_BYTE_H
+#define DOUBLE_ARRAY_TRIE_UTF8_BYTE_H
+
+#if defined(_MSC_VER) && (_MSC_VER >= 1020)
+#pragma once
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <inttypes.h>
+#include <time.h>
+#include <string.h>
+#include <assert.h>
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstdint>
+#include <cstddef>
+#include <cstdbool>
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <cstring>
+#include <vector>
+#include <map>
+#include <functional>
+#include <utility>
+#include <algorithm>
+#include <type_traits>
+
+#include "benchmark.h"
+#include "win_iconv.h"
+#include "utf8_utils.h"
+#include "AcTrie_v1.h"
+
+namespace utf8 {
+
+//
+// The double-array trie walks the raw UTF-8 bytes, the labels are [0, 255].
+//
+// utf8::DAT<T> uses the code points as labels, every base reserves a 64K window.
+// Here the window is 256 labels, so the arrays are much smaller and denser, and
+// there is no utf8_decode() in the hot loop. The patterns are whole UTF-8 chars,
+// so a match always begins and ends on the character boundaries.
+//
+template <typename CharT>
+class DAT_Byte {
+public:
+    typedef DAT_Byte<CharT>                                 this_type;
+    typedef typename ::detail::char_trait<CharT>::NoSigned  char_type;
+    typedef typename ::detail::char_trait<CharT>::Signed    schar_type;
+    typedef typename ::detail::char_trait<CharT>::Unsigned  uchar_type;
+
+    typedef typename v1::AcTrie<CharT>                      AcTireT;
+    typedef typename AcTireT::State                         AcState;
+    typedef typename AcTireT::size_type                     size_type;
+    typedef typename AcTireT::ident_t                       ident_t;
+
+    typedef std::function<std::size_t (std::uint32_t)>      on_hit_callback;
+
+    static const ident_t kInvalidIdent = 0;
+    static const ident_t kRootIdent = 1;
+    static const ident_t kFirstFreeIdent = 2;
+
+    static const std::uint32_t kMaxAscii = 256;
+
+    static const std::uint32_t kPatternIdMask = 0x1FFFFFFFu;
+    static const std::uint32_t kHasOutputMask = 0x20000000u;
+    static const std::uint32_t kHasChildMask = 0x40000000u;
+    static const std::uint32_t kIsFinalMask = 0x80000000u;
+
+    #pragma pack(push, 1)
+
+    struct State {
+        union {
+            std::uint64_t       is_free;
+
+            struct {
+              ident_t           base;
+              ident_t           check;
+            };
+        };
+        union {
+            std::uint64_t       extend;
+
+            struct {
+              union {
+                std::uint32_t   identifier;
+                struct {
+                  std::uint32_t pattern_id : 29;
+                  std::uint32_t has_output : 1;
+                  std::uint32_t has_child  : 1;
+                  std::uint32_t is_final   : 1;
+                };
+              };
+              ident_t           fail_link;
+            };
+        };
+
+        State() noexcept : is_free(0), extend(0) {
+        }
+    };
+
+    struct MatchInfoEx {
+        std::uint32_t begin;
+        std::uint32_t end;
+        std::uint32_t pattern_id;
+        std::uint32_t reserve;
+    };
+
+    #pragma pack(pop)
+
+    typedef State state_type;
+
+private:
+    std::vector<state_type> states_;
+    std::vector<ident_t> output_links_;
+    std::vector<std::uint32_t> depths_;
+    // The root is the hottest state, root_next_[label] is its next state (or the root).
+    std::vector<ident_t> root_next_;
+
+    ident_t first_free_id_;
+    // The lowest free state which (kFirstFreeIdent + min_label) can start to search from.
+    std::vector<ident_t> free_hints_;
+    AcTireT acTrie_;
+
+public:
+    DAT_Byte() : root_next_(kMaxAscii, ident_t(kRootIdent)), first_free_id_(kFirstFreeIdent) {
+        this->create_root();
+    }
+
+    virtual ~DAT_Byte() {}
+
+    ident_t max_state_id() const {
+        return static_cast<ident_t>(this->states_.size());
+    }
+
+    bool is_valid_id(ident_t identifier) const {
+        return ((identifier != kInvalidIdent) && (identifier < this->max_state_id()));
+    }
+
+    size_type size() const {
+        return this->states_.size();
+    }
+
+    State & states(size_type index) {
+        return this->states_[index];
+    }
+
+    const State & states(size_type index) const {
+        return this->states_[index];
+    }
+
+    inline bool is_free_state(ident_t index) const {
+        const State & state = this->states_[index];
+        return (state.is_free == 0);
+    }
+
+    ident_t root() const {
+        return kRootIdent;
+    }
+
+    bool has_overflow_labels() const {
+        return false;
+    }
+
+    size_type dat_bytes() const {
+        return (this->states_.size() * sizeof(state_type) +
+                this->output_links_.size() * sizeof(ident_t) +
+                this->depths_.size() * sizeof(std::uint32_t));
+    }
+
+    void clear() {
+        this->clear_ac_trie();
+        this->clear_trie();
+    }
+
+    void clear_ac_trie() {
+        this->acTrie_.clear();
+    }
+
+    void clear_trie() {
+        this->output_links_.clear();
+        this->depths_.clear();
+        this->root_next_.clear();
+        this->root_next_.resize(kMaxAscii, ident_t(kRootIdent));
+        this->states_.clear();
+        this->first_free_id_ = kFirstFreeIdent;
+        this->free_hints_.clear();
+        this->free_hints_.resize(kMaxAscii, 0);
+        this->create_root();
+    }
+
+    bool insert(const uchar_type * pattern, size_type length, std::uint32_t id) {
+        return this->acTrie_.insert(pattern, length, id);
+    }
+
+    bool insert(const char_type * pattern, size_type length, std::uint32_t id) {
+        return this->insert((const uchar_type *)pattern, length, id);
+    }
+
+    bool insert(const schar_type * pattern, size_type length, std::uint32_t id) {
+        return this->insert((const uchar_type *)pattern, length, id);
+    }
+
+    bool insert(const std::string & pattern, std::uint32_t id) {
+        return this->insert(pattern.c_str(), pattern.size(), id);
+    }
+
+    void build() {
+        this->acTrie_.build();
+
+        size_type ac_size = this->acTrie_.size();
+        this->clear_trie();
+        this->states_.resize(kFirstFreeIdent + kMaxAscii);
+
+        std::vector<ident_t> ac_queue;
+        std::vector<ident_t> queue;
+        ac_queue.reserve(ac_size);
+        queue.reserve(ac_size);
+
+        std::vector<ident_t> ac_to_dat(ac_size, ident_t(kInvalidIdent));
+
+        ident_t root_ac = this->acTrie_.root();
+        ident_t root = this->root();
+        ac_queue.push_back(root_ac);
+        queue.push_back(root);
+        ac_to_dat[root_ac] = root;
+
+        size_type head = 0;
+        while (likely(head < ac_queue.size())) {
+            ident_t cur_ac = ac_queue[head];
+            const AcState & cur_ac_state = this->acTrie_.states(cur_ac);
+            ident_t cur = queue[head++];
+
+            this->states_[cur].identifier = cur_ac_state.identifier;
+            this->states_[cur].has_output = 0;
+            this->states_[cur].has_child = (cur_ac_state.children.size() != 0) ? 1 : 0;
+
+            if (cur_ac_state.children.size() == 0)
+                continue;
+
+            ident_t base = this->find_base(cur_ac_state);
+            this->states_[cur].base = base;
+
+            for (auto iter = cur_ac_state.children.begin();
+                iter != cur_ac_state.children.end(); ++iter) {
+                std::uint32_t label = iter->first;
+                ident_t child_ac = iter->second;
+                ident_t child = base + label;
+                assert(this->is_free_state(child));
+
+                this->states_[child].check = cur;
+                ac_to_dat[child_ac] = child;
+                ac_queue.push_back(child_ac);
+                queue.push_back(child);
+            }
+        }
+
+        this->build_links(ac_queue, queue, ac_to_dat);
+    }
+
+    void match_one(const uchar_type * first, const uchar_type * last,
+                   std::vector<MatchInfoEx> & match_list,
+                   const std::vector<int> & length_list) {
+        this->template match_leftmost_longest<false>(first, last, match_list, length_list);
+    }
+
+    void match_one(const char_type * first, const char_type * last,
+                   std::vector<MatchInfoEx> & match_list,
+                   const std::vector<int> & length_list) {
+        return this->match_one((const uchar_type *)first, (const uchar_type *)last, match_list, length_list);
+    }
+
+    void match_one(const schar_type * first, const schar_type * last,
+                   std::vector<MatchInfoEx> & match_list,
+                   const std::vector<int> & length_list) {
+        return this->match_one((const uchar_type *)first, (const uchar_type *)last, match_list, length_list);
+    }
+
+    //
+    // Match the whole chunk in one pass, '\n' is a hard reset label.
+    //
+    void match_chunk(const uchar_type * first, const uchar_type * last,
+                     std::vector<MatchInfoEx> & match_list,
+                     const std::vector<int> & length_list) {
+        this->template match_leftmost_longest<true>(first, last, match_list, length_list);
+    }
+
+    void match_chunk(const char_type * first, const char_type * last,
+                     std::vector<MatchInfoEx> & match_list,
+                     const std::vector<int> & length_list) {
+        return this->match_chunk((const uchar_type *)first, (const uchar_type *)last, match_list, length_list);
+    }
+
+    void match_chunk(const schar_type * first, const schar_type * last,
+                     std::vector<MatchInfoEx> & match_list,
+                     const std::vector<int> & length_list) {
+        return this->match_chunk((const uchar_type *)first, (const uchar_type *)last, match_list, length_list);
+    }
+
+private:
+    inline ident_t find_next_free_state(ident_t first) {
+        for (ident_t cur = first; cur < this->max_state_id(); cur++) {
+            if (this->is_free_state(cur)) {
+                return cur;
+            }
+        }
+        return kInvalidIdent;
+    }
+
+    //
+    // Find the first base which all the children can be placed at, and make sure
+    // that (base + label) of any label is in range.
+    //
+    ident_t find_base(const AcState & ac_state) {
+        std::uint32_t min_label = ac_state.children.begin()->first;
+
+        ident_t first_free = this->find_next_free_state(this->first_free_id_);
+        if (first_free != kInvalidIdent)
+            this->first_free_id_ = first_free;
+
+        // The states never become free again while building, so all the states
+        // below the hint are still in use.
+        ident_t base;
+        ident_t first = this->first_free_id_;
+        if (first < kFirstFreeIdent + min_label)
+            first = kFirstFreeIdent + min_label;
+        if (first < this->free_hints_[min_label])
+            first = this->free_hints_[min_label];
+        bool is_first_try = true;
+        do {
+            first_free = this->find_next_free_state(first);
+            if (is_first_try) {
+                if (first_free != kInvalidIdent)
+                    this->free_hints_[min_label] = first_free;
+                is_first_try = false;
+            }
+            if (first_free == kInvalidIdent) {
+                base = this->max_state_id() - min_label;
+                break;
+            }
+            base = first_free - min_label;
+            bool base_found = true;
+            for (auto iter = ac_state.children.begin(); iter != ac_state.children.end(); ++iter) {
+                ident_t child = base + iter->first;
+                if (child < this->max_state_id() && !this->is_free_state(child)) {
+                    base_found = false;
+                    break;
+                }
+            }
+            if (base_found)
+                break;
+            first = first_free + 1;
+        } while (1);
+
+        if (this->states_.size() < (size_type)base + kMaxAscii) {
+            this->states_.resize((size_type)base + kMaxAscii);
+        }
+        return base;
+    }
+
+    //
+    // Map the failure links of the AC trie to the DAT states, and set the output links
+    // (the nearest final state on the failure chain) and the depths. The failure link
+    // of a state always points to a shallower state, which is linked before in BFS order.
+    //
+    void build_links(const std::vector<ident_t> & ac_queue,
+                     const std::vector<ident_t> & queue,
+                     const std::vector<ident_t> & ac_to_dat) {
+        assert(ac_queue.size() == queue.size());
+
+        this->output_links_.clear();
+        this->output_links_.resize(this->states_.size(), ident_t(kInvalidIdent));
+        this->depths_.clear();
+        this->depths_.resize(this->states_.size(), 0);
+
+        ident_t root = this->root();
+        this->states_[root].fail_link = kInvalidIdent;
+
+        for (std::uint32_t label = 0; label < kMaxAscii; label++) {
+            ident_t child = this->states_[root].base + label;
+            this->root_next_[label] = (this->states_[child].check == root) ? child : root;
+        }
+
+        for (size_type i = 1; i < queue.size(); i++) {
+            ident_t cur = queue[i];
+            State & cur_state = this->states_[cur];
+            ident_t fail_ac = this->acTrie_.states(ac_queue[i]).fail_link;
+            ident_t fail = (fail_ac != kInvalidIdent) ? ac_to_dat[fail_ac] : root;
+            assert(this->is_valid_id(fail));
+
+            const State & fail_state = this->states_[fail];
+            cur_state.fail_link = fail;
+            this->output_links_[cur] = (fail_state.is_final != 0) ? fail : this->output_links_[fail];
+            cur_state.has_output = ((cur_state.is_final != 0) ||
+                                    (this->output_links_[cur] != kInvalidIdent)) ? 1 : 0;
+            this->depths_[cur] = this->depths_[cur_state.check] + 1;
+        }
+    }
+
+    static inline
+    bool is_char_boundary(const uchar_type * text, const uchar_type * last) {
+        return ((text >= last) || ((*text & 0xC0) != 0x80));
+    }
+
+    //
+    // Leftmost-longest, non-overlapping matching by the failure links, it's the same
+    // as utf8::DAT<T>::match_leftmost_longest(), except the labels are the bytes.
+    // A match must begin and end on the character boundaries.
+    //
+    template <bool LineReset>
+    void match_leftmost_longest(const uchar_type * first, const uchar_type * last,
+                                std::vector<MatchInfoEx> & match_list,
+                                const std::vector<int> & length_list) {
+        match_list.clear();
+
+        const uchar_type * text_first = first;
+        const uchar_type * text_last = last;
+        const uchar_type * text = text_first;
+        assert(text_first <= text_last);
+
+        const state_type * states = this->states_.data();
+        const ident_t * root_next = this->root_next_.data();
+        ident_t root = this->root();
+        ident_t cur = root;
+
+        MatchInfoEx pending;
+        bool has_pending = false;
+        std::vector<MatchInfoEx> deferred;
+        // The matches must begin at or after the end of the last committed match.
+        std::uint32_t min_begin = 0;
+
+        while (text < text_last) {
+            std::uint32_t label = (std::uint32_t)*text++;
+
+            if (LineReset && unlikely(label == std::uint32_t('\n'))) {
+                while (has_pending) {
+                    this->commit_pending(match_list, pending, has_pending, deferred, min_begin);
+                }
+                cur = root;
+                continue;
+            }
+
+            if (likely(cur == root)) {
+                cur = root_next[label];
+            } else {
+                // Follow the failure links until the label is accepted or reach the root.
+                do {
+                    assert(this->is_valid_id(cur));
+                    ident_t child = states[cur].base + label;
+                    if (likely(states[child].check == cur)) {
+                        cur = child;
+                        break;
+                    }
+                    cur = states[cur].fail_link;
+                    if (cur == root) {
+                        cur = root_next[label];
+                        break;
+                    }
+                } while (1);
+            }
+
+            std::uint32_t pos = (std::uint32_t)(text - text_first);
+            while (unlikely(has_pending) && ((pos - this->depths_[cur]) > pending.begin)) {
+                this->commit_pending(match_list, pending, has_pending, deferred, min_begin);
+            }
+
+            const State & cur_state = states[cur];
+            if (unlikely(cur_state.has_output != 0)) {
+                if (!is_char_boundary(text, text_last))
+                    continue;
+                // The output chain is from the longest to the shortest.
+                ident_t node = (cur_state.is_final != 0) ? cur : this->output_links_[cur];
+                do {
+                    const State & node_state = states[node];
+                    std::uint32_t length = (std::uint32_t)length_list[node_state.pattern_id];
+                    assert(length > 0);
+                    std::uint32_t begin = pos - length;
+                    if ((begin >= min_begin) && is_char_boundary(text_first + begin, text_last)) {
+                        if (!has_pending || (begin <= pending.begin)) {
+                            // The shorter ones overlap with it.
+                            pending.begin      = begin;
+                            pending.end        = pos;
+                            pending.pattern_id = node_state.pattern_id;
+                            pending.reserve    = 0;
+                            has_pending = true;
+                            break;
+                        } else if (begin >= pending.end) {
+                            MatchInfoEx matchInfo;
+                            matchInfo.begin      = begin;
+                            matchInfo.end        = pos;
+                            matchInfo.pattern_id = node_state.pattern_id;
+                            matchInfo.reserve    = 0;
+                            deferred.push_back(matchInfo);
+                        }
+                    }
+                    node = this->output_links_[node];
+                } while (node != kInvalidIdent);
+            }
+        }
+
+        while (has_pending) {
+            this->commit_pending(match_list, pending, has_pending, deferred, min_begin);
+        }
+    }
+
+    void commit_pending(std::vector<MatchInfoEx> & match_list,
+                        MatchInfoEx & pending, bool & has_pending,
+                        std::vector<MatchInfoEx> & deferred,
+                        std::uint32_t & min_begin) {
+        assert(has_pending);
+        match_list.push_back(pending);
+        min_begin = pending.end;
+        has_pending = false;
+
+        size_type count = 0;
+        for (auto iter = deferred.begin(); iter != deferred.end(); ++iter) {
+            const MatchInfoEx & matchInfo = *iter;
+            if (matchInfo.begin >= min_begin) {
+                if (!has_pending || (matchInfo.begin < pending.begin) ||
+                    ((matchInfo.begin == pending.begin) && (matchInfo.end > pending.end))) {
+                    pending = matchInfo;
+                    has_pending = true;
+                }
+                deferred[count++] = matchInfo;
+            }
+        }
+        deferred.resize(count);
+    }
+
+    void create_root() {
+        assert(this->states_.size() == 0);
+
+        // Append dummy state for invalid link, Identifier = 0
+        State dummy;
+        this->states_.push_back(dummy);
+
+        // Append root state, Identifier = 1
+        State root;
+        this->states_.push_back(root);
+    }
+
+    DAT_Byte(const DAT_Byte & src) = delete;
+    DAT_Byte & operator = (const DAT_Byte & rhs) = delete;
+};
+
+} // namespace utf8
+
+#endif // DOUBLE_ARRAY_TRIE_UTF8_BYTE_H
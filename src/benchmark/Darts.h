@@ -29,6 +29,7 @@
 #include <vector>
 #include <set>
 #include <map>
+#include <memory>
 #include <functional>
 #include <utility>
 #include <algorithm>
@@ -38,6 +39,7 @@
 #include "win_iconv.h"
 #include "AcTrie_v1.h"
 #include "AcTrie_v2.h"
+#include "trie_file.h"
 
 namespace darts {
 
@@ -76,6 +78,17 @@ public:
 
     static const std::uint32_t kSignMask = 0x80000000u;
 
+    // The sections of the trie file, see save() and load().
+    enum FileSection {
+        kSectionParams = 1,
+        kSectionStates
+    };
+
+    enum FileParam {
+        kParamFirstFreeId,
+        kMaxFileParam
+    };
+
     #pragma pack(push, 1)
 
     struct State {
@@ -112,11 +125,14 @@ public:
     typedef State state_type;
 
 private:
-    std::vector<state_type> states_;
+    trie_file::MappedVector<state_type> states_;
 
     ident_t first_free_id_;
     AcTireT acTrie_;
 
+    // The loaded trie file, states_ is the view of it.
+    std::shared_ptr<trie_file::Reader> trie_file_;
+
 public:
     Darts() : first_free_id_(kFirstFreeIdent) {
         this->create_root();
@@ -224,12 +240,63 @@ public:
         this->states_.clear();
         this->states_.reserve(2);
         this->create_root();
+        this->trie_file_.reset();
     }
 
     void clear_ac_trie() {
         this->acTrie_.clear();
     }
 
+    static const char * file_kind() {
+        return "darts::Darts";
+    }
+
+    std::uint64_t file_options() const {
+        return 0;
+    }
+
+    std::uint64_t file_dict_hash() const {
+        return (this->trie_file_ ? this->trie_file_->header().dict_hash : 0);
+    }
+
+    //
+    // Save the built trie, the AC trie is not needed after load().
+    //
+    bool save(const std::string & path, std::uint64_t dict_hash = 0) const {
+        std::uint64_t params[kMaxFileParam];
+        params[kParamFirstFreeId] = this->first_free_id_;
+
+        trie_file::Writer writer(file_kind(), dict_hash);
+        writer.add(kSectionParams, params, sizeof(std::uint64_t), kMaxFileParam);
+        writer.add(kSectionStates, this->states_);
+        return writer.save(path);
+    }
+
+    //
+    // Load a saved trie, the states are used in place in the mapped file
+    // (or in the read buffer if use_mmap is false).
+    //
+    bool load(const std::string & path, bool use_mmap = true) {
+        std::shared_ptr<trie_file::Reader> reader = std::make_shared<trie_file::Reader>();
+        if (!reader->open(path, file_kind(), use_mmap))
+            return false;
+
+        std::vector<std::uint64_t> params;
+        if (!reader->read(kSectionParams, params) || params.size() < kMaxFileParam)
+            return false;
+
+        this->clear();
+        bool succeeded = (reader->attach(kSectionStates, this->states_));
+        if (!succeeded || this->states_.size() <= kRootIdent) {
+            this->clear();
+            return false;
+        }
+
+        this->first_free_id_ = (ident_t)params[kParamFirstFreeId];
+        this->trie_file_ = reader;
+        return true;
+    }
+
     bool insert(const uchar_type * pattern, size_type length, std::uint32_t id) {
         return this->acTrie_.insert(pattern, length, id);
     }
@@ -369,7 +436,7 @@ public:
                 } while (!base_found);
 
                 assert(base_found);
-                cur_state.base = base;
+                this->states_[cur].base = base;
 
                 // Travel all children
                 for (auto iter = cur_ac_state.children.begin();
@@ -420,7 +487,7 @@ public:
                     child_state.has_child = (child_ac_state.children.size() != 0) ? 1 : 0;
 
                     if (likely(cur != root)) {
-                        ident_t node = cur_state.fail_link;
+                        ident_t node = this->states_[cur].fail_link;
                         do {
                             if (likely(node != kInvalidIdent)) {
                                 assert(this->is_valid_id(node));
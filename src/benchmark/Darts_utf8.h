@@ -30,6 +30,7 @@
 #include <set>
 #include <map>
 #include <unordered_map>
+#include <memory>
 #include <functional>
 #include <utility>
 #include <algorithm>
@@ -39,6 +40,7 @@
 #include "win_iconv.h"
 #include "utf8_utils.h"
 #include "AcTrie_utf8.h"
+#include "trie_file.h"
 
 namespace utf8 {
 
@@ -79,6 +81,18 @@ public:
 
     static const std::uint32_t kSignMask = 0x80000000u;
 
+    // The sections of the trie file, see save() and load().
+    enum FileSection {
+        kSectionParams = 1,
+        kSectionStates,
+        kSectionOverflowLabels
+    };
+
+    enum FileParam {
+        kParamFirstFreeId,
+        kMaxFileParam
+    };
+
     #pragma pack(push, 1)
 
     struct State {
@@ -131,12 +145,15 @@ public:
     typedef State state_type;
 
 private:
-    std::vector<state_type> states_;
+    trie_file::MappedVector<state_type> states_;
     std::unordered_map<std::uint64_t, std::uint32_t> overflow_labels_;
 
     ident_t first_free_id_;
     AcTireT acTrie_;
 
+    // The loaded trie file, states_ is the view of it.
+    std::shared_ptr<trie_file::Reader> trie_file_;
+
 public:
     Darts() : first_free_id_(kFirstFreeIdent) {
         this->create_root();
@@ -254,6 +271,59 @@ public:
         this->states_.clear();
         this->states_.reserve(capacity);
         this->create_root();
+        this->trie_file_.reset();
+    }
+
+    static const char * file_kind() {
+        return "utf8::Darts";
+    }
+
+    std::uint64_t file_options() const {
+        return 0;
+    }
+
+    std::uint64_t file_dict_hash() const {
+        return (this->trie_file_ ? this->trie_file_->header().dict_hash : 0);
+    }
+
+    //
+    // Save the built trie, the AC trie is not needed after load().
+    //
+    bool save(const std::string & path, std::uint64_t dict_hash = 0) const {
+        std::uint64_t params[kMaxFileParam];
+        params[kParamFirstFreeId] = this->first_free_id_;
+
+        trie_file::Writer writer(file_kind(), dict_hash);
+        writer.add(kSectionParams, params, sizeof(std::uint64_t), kMaxFileParam);
+        writer.add(kSectionStates, this->states_);
+        writer.add(kSectionOverflowLabels, this->overflow_labels_);
+        return writer.save(path);
+    }
+
+    //
+    // Load a saved trie, the states are used in place in the mapped file
+    // (or in the read buffer if use_mmap is false).
+    //
+    bool load(const std::string & path, bool use_mmap = true) {
+        std::shared_ptr<trie_file::Reader> reader = std::make_shared<trie_file::Reader>();
+        if (!reader->open(path, file_kind(), use_mmap))
+            return false;
+
+        std::vector<std::uint64_t> params;
+        if (!reader->read(kSectionParams, params) || params.size() < kMaxFileParam)
+            return false;
+
+        this->clear();
+        bool succeeded = (reader->attach(kSectionStates, this->states_) &&
+                          reader->read(kSectionOverflowLabels, this->overflow_labels_));
+        if (!succeeded || this->states_.size() <= kRootIdent) {
+            this->clear();
+            return false;
+        }
+
+        this->first_free_id_ = (ident_t)params[kParamFirstFreeId];
+        this->trie_file_ = reader;
+        return true;
     }
 
     bool insert(const uchar_type * pattern, size_type length, std::uint32_t id) {
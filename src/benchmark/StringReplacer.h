@@ -0,0 +1,401 @@
+
+#ifndef STRING_REPLACER_H
+#define STRING_REPLACER_H
+
+#if defined(_MSC_VER) && (_MSC_VER >= 1020)
+#pragma once
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <inttypes.h>
+#include <string.h>
+#include <assert.h>
+
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <memory>
+#include <functional>
+#include <utility>
+#include <algorithm>
+
+#include "benchmark.h"
+#include "DAT_utf8.h"
+#include "value_arena.h"
+#include "darts_benchmark.h"
+#include "pipe_io.h"
+
+namespace darts_bench {
+
+//
+// Push-based streaming replacer: feed() the input in buffers of any size, and the
+// output is passed to the sink as soon as it's decided, finish() flushes the rest.
+//
+// The matcher status (the current state, the pending and the deferred matches) is
+// kept across the feed() calls, so every byte is matched once, and a key across two
+// buffers is never missed. The text before the decided offset of the matcher can't
+// be changed by the coming bytes, it's replaced and sent out, the rest is kept.
+//
+template <typename AcTrieT = utf8::DAT<char>>
+class StringReplacer {
+public:
+    typedef AcTrieT                                         actrie_type;
+    typedef typename AcTrieT::MatchInfoEx                   MatchInfoEx;
+    typedef typename AcTrieT::MatchStream                   MatchStream;
+    typedef std::size_t                                     size_type;
+    typedef std::function<void (const char * data, size_type size)> sink_type;
+
+    static const size_type kPageSize = 4 * 1024;
+    static const size_type kMinBlockSize = 64 * 1024;
+
+private:
+    std::unique_ptr<AcTrieT>                    ac_trie_;
+    std::vector<std::pair<std::string, int>>    dict_list_;
+    std::vector<int>                            length_list_;
+    ValueArena                                  value_arena_;
+    size_type                                   expand_ratio_;
+
+    sink_type                                   sink_;
+    // The bytes of pending_ after pending_size_ are the zero padding (kPageSize).
+    // The head scan_size_ bytes of pending_ have been fed to the matcher.
+    std::string                                 pending_;
+    size_type                                   pending_size_;
+    size_type                                   scan_size_;
+    size_type                                   process_size_;
+    std::string                                 output_;
+    MatchStream                                 stream_;
+    std::vector<MatchInfoEx>                    match_list_;
+
+    std::uint64_t                               input_size_;
+    std::uint64_t                               output_size_;
+
+public:
+    StringReplacer() : expand_ratio_(1), pending_size_(0), scan_size_(0), process_size_(kMinBlockSize),
+                       input_size_(0), output_size_(0) {
+    }
+
+    StringReplacer(const std::string & dict_kv, sink_type sink) : StringReplacer() {
+        this->load_dict(dict_kv);
+        this->set_sink(sink);
+    }
+
+    ~StringReplacer() {}
+
+    bool is_loaded() const { return (this->ac_trie_.get() != nullptr); }
+
+    std::uint64_t input_size() const { return this->input_size_; }
+    std::uint64_t output_size() const { return this->output_size_; }
+
+    void set_sink(sink_type sink) {
+        this->sink_ = sink;
+    }
+
+    //
+    // Load the dictionary text, one "key\tvalue" per line.
+    //
+    bool load_dict(const std::string & dict_kv) {
+        preprocessing_dict_file(dict_kv, this->dict_list_, this->length_list_, this->value_arena_);
+        if (this->dict_list_.empty())
+            return false;
+
+        this->ac_trie_.reset(new AcTrieT);
+        buildAcTrie(*this->ac_trie_, this->dict_list_);
+
+        this->expand_ratio_ = getMaxExpandRatio(this->dict_list_, this->value_arena_);
+        this->reset();
+        return true;
+    }
+
+    bool load_dict_file(const std::string & dict_file) {
+        std::string dict_kv;
+        std::size_t dict_filesize = read_dict_file(dict_file, dict_kv);
+        if (dict_filesize == 0)
+            return false;
+        return this->load_dict(dict_kv);
+    }
+
+    //
+    // Start a new stream with the same dictionary.
+    //
+    void reset() {
+        this->pending_.clear();
+        this->pending_size_ = 0;
+        this->scan_size_ = 0;
+        this->process_size_ = kMinBlockSize;
+        this->stream_ = MatchStream();
+        this->match_list_.clear();
+        this->input_size_ = 0;
+        this->output_size_ = 0;
+    }
+
+    void feed(const char * data, size_type size) {
+        assert(this->is_loaded());
+        size_type need_size = this->pending_size_ + size + kPageSize;
+        if (this->pending_.size() < need_size)
+            this->pending_.resize(need_size);
+        std::memcpy(&this->pending_[this->pending_size_], data, size);
+        this->pending_size_ += size;
+        this->input_size_ += size;
+        if (this->pending_size_ >= this->process_size_) {
+            this->process(false);
+        }
+    }
+
+    void feed(const std::string & data) {
+        this->feed(data.c_str(), data.size());
+    }
+
+    void finish() {
+        assert(this->is_loaded());
+        this->process(true);
+    }
+
+private:
+    void write_output(const char * data, size_type size) {
+        if (size > 0) {
+            if (this->sink_)
+                this->sink_(data, size);
+            this->output_size_ += size;
+        }
+    }
+
+    void process(bool is_final) {
+        // The matcher may read a few bytes over the end of an incomplete UTF-8 char,
+        // they are in the string and zero.
+        if (this->pending_.size() < this->pending_size_ + kPageSize)
+            this->pending_.resize(this->pending_size_ + kPageSize);
+        std::memset(&this->pending_[this->pending_size_], 0, kPageSize);
+
+        const char * first = this->pending_.c_str();
+        const char * scan_first = first + this->scan_size_;
+        const char * last = first + this->pending_size_;
+
+        // The incomplete UTF-8 char at the tail is matched with the next buffer.
+        const char * scan_last = last;
+        if (!is_final && (scan_first < last)) {
+            const char * char_first = last - 1;
+            while (char_first > scan_first && (((std::uint8_t)*char_first & 0xC0) == 0x80))
+                --char_first;
+            if (char_first + utf8::utf8_decode_len(char_first) > last)
+                scan_last = char_first;
+        }
+
+        this->ac_trie_->match_stream(this->stream_, first, scan_first, scan_last,
+                                     this->match_list_, this->length_list_);
+        this->scan_size_ = (size_type)(scan_last - first);
+
+        size_type decided_size;
+        if (is_final) {
+            this->ac_trie_->finish_stream(this->stream_, this->match_list_);
+            decided_size = this->pending_size_;
+        } else {
+            decided_size = this->ac_trie_->stream_decided(this->stream_, first);
+        }
+
+        // The decided matches all end before the decided size.
+        std::size_t need_size = decided_size * this->expand_ratio_ + kPageSize;
+        if (this->output_.size() < need_size)
+            this->output_.resize(need_size);
+
+        char * output = &this->output_[0];
+        char * output_start = output;
+        const char * text = first;
+        for (auto iter = this->match_list_.begin(); iter != this->match_list_.end(); ++iter) {
+            const char * match_first = first + iter->begin;
+            assert((size_type)iter->end <= decided_size);
+            std::copy(text, match_first, output);
+            output += (match_first - text);
+            output += this->value_arena_.write(output, iter->pattern_id);
+            text = first + iter->end;
+        }
+        const char * decided_last = first + decided_size;
+        if (text < decided_last) {
+            std::copy(text, decided_last, output);
+            output += (decided_last - text);
+        }
+        this->write_output(output_start, (size_type)(output - output_start));
+        this->match_list_.clear();
+
+        // Move the undecided tail to the head, the padding is not moved.
+        size_type remain_size = this->pending_size_ - decided_size;
+        if (remain_size > 0 && decided_size > 0)
+            std::memmove(&this->pending_[0], decided_last, remain_size);
+        this->ac_trie_->rebase_stream(this->stream_, (std::uint32_t)decided_size);
+        this->pending_size_ = remain_size;
+        this->scan_size_ -= decided_size;
+
+        // Wait for enough new bytes before the next process().
+        this->process_size_ = this->pending_size_ + kMinBlockSize;
+    }
+
+    StringReplacer(const StringReplacer & src) = delete;
+    StringReplacer & operator = (const StringReplacer & rhs) = delete;
+};
+
+//
+// Drive the StringReplacer by a file stream, read_size can be any size.
+//
+template <typename AcTrieT>
+int StringReplaceStream(const std::string & name,
+                        const std::string & dict_file,
+                        const std::string & input_file,
+                        const std::string & in_output_file,
+                        std::size_t read_size = 64 * 1024)
+{
+    std::string output_file = splicing_file_name(in_output_file, name);
+
+    std::ifstream ifs;
+    ifs.open(input_file, std::ios::in | std::ios::binary);
+    if (!ifs.good()) {
+        return -1;
+    }
+
+    std::ofstream ofs;
+    ofs.open(output_file, std::ios::out | std::ios::binary);
+    if (!ofs.good()) {
+        ifs.close();
+        return -1;
+    }
+
+    StringReplacer<AcTrieT> replacer;
+    if (!replacer.load_dict_file(dict_file)) {
+        std::cout << "dict_file [ " << dict_file << " ] read failed." << std::endl;
+        return -1;
+    }
+    replacer.set_sink([&ofs](const char * data, std::size_t size) {
+        ofs.write(data, size);
+    });
+
+    std::string read_buf;
+    read_buf.resize(read_size);
+    while (!ifs.eof()) {
+        ifs.read(&read_buf[0], read_size);
+        std::streamsize readBytes = ifs.gcount();
+        if (readBytes > 0)
+            replacer.feed(read_buf.c_str(), (std::size_t)readBytes);
+        else
+            break;
+    }
+    replacer.finish();
+
+    ofs.close();
+    ifs.close();
+    return 0;
+}
+
+//
+// Stream mode for the shell pipeline, "-" is stdin or stdout. The exact output
+// file name is used, and the stdout must be detached by pipe_io::detach_stdout()
+// before any log is printed.
+//
+template <typename AcTrieT>
+int StringReplaceStdio(const std::string & dict_file,
+                       const std::string & input_file,
+                       const std::string & output_file,
+                       int stdout_fd = 1)
+{
+    static const std::size_t kReadBufSize = pipe_io::kPipeSize;
+
+    int in_fd;
+    if (pipe_io::is_stdio_name(input_file)) {
+        in_fd = 0;
+  #if PIPE_IO_USE_WIN32
+        ::_setmode(in_fd, _O_BINARY);
+  #endif
+    } else {
+  #if PIPE_IO_USE_WIN32
+        in_fd = ::_open(input_file.c_str(), _O_RDONLY | _O_BINARY);
+  #else
+        in_fd = ::open(input_file.c_str(), O_RDONLY);
+  #endif
+        if (in_fd < 0) {
+            std::cout << "input_file [ " << input_file << " ] open failed." << std::endl;
+            return -1;
+        }
+    }
+
+    int out_fd;
+    if (pipe_io::is_stdio_name(output_file)) {
+        out_fd = stdout_fd;
+    } else {
+  #if PIPE_IO_USE_WIN32
+        out_fd = ::_open(output_file.c_str(), _O_WRONLY | _O_CREAT | _O_TRUNC | _O_BINARY,
+                         _S_IREAD | _S_IWRITE);
+  #else
+        out_fd = ::open(output_file.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  #endif
+        if (out_fd < 0) {
+            std::cout << "output_file [ " << output_file << " ] open failed." << std::endl;
+            return -1;
+        }
+    }
+
+    StringReplacer<AcTrieT> replacer;
+    if (!replacer.load_dict_file(dict_file)) {
+        std::cout << "dict_file [ " << dict_file << " ] read failed." << std::endl;
+        return -1;
+    }
+
+    // A larger pipe buffer lets the producer (e.g. zcat) write in bigger batches.
+    std::size_t in_pipe_size = pipe_io::set_pipe_size(in_fd, pipe_io::kPipeSize);
+
+    pipe_io::PipeWriter writer;
+    writer.open(out_fd);
+
+    bool succeeded = true;
+    replacer.set_sink([&writer, &succeeded](const char * data, std::size_t size) {
+        if (!writer.write(data, size))
+            succeeded = false;
+    });
+
+    std::string read_buf;
+    read_buf.resize(kReadBufSize);
+    do {
+        std::ptrdiff_t readBytes = pipe_io::read_fd(in_fd, &read_buf[0], kReadBufSize);
+        if (readBytes > 0) {
+            replacer.feed(read_buf.c_str(), (std::size_t)readBytes);
+        } else {
+            if (readBytes < 0)
+                succeeded = false;
+            break;
+        }
+    } while (succeeded);
+
+    replacer.finish();
+    if (!writer.flush())
+        succeeded = false;
+
+    printf("darts_bench::StringReplaceStdio(): input = %" PRIu64 " bytes, output = %" PRIu64 " bytes, "
+           "input pipe size = %u, output pipe size = %u, vmsplice = %s\n\n",
+           replacer.input_size(), replacer.output_size(),
+           (uint32_t)in_pipe_size, (uint32_t)writer.pipe_size(),
+           (writer.use_vmsplice() ? "yes" : "no"));
+
+    if (in_fd != 0) {
+  #if PIPE_IO_USE_WIN32
+        ::_close(in_fd);
+  #else
+        ::close(in_fd);
+  #endif
+    }
+    if (out_fd != stdout_fd) {
+  #if PIPE_IO_USE_WIN32
+        ::_close(out_fd);
+  #else
+        ::close(out_fd);
+  #endif
+    }
+    return (succeeded ? 0 : -1);
+}
+
+} // namespace darts_bench
+
+#endif // STRING_REPLACER_H
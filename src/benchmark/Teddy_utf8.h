@@ -0,0 +1,594 @@
+
+#ifndef TEDDY_UTF8_H
+#define TEDDY_UTF8_H
+
+#if defined(_MSC_VER) && (_MSC_VER >= 1020)
+#pragma once
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <string.h>
+#include <assert.h>
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstdint>
+#include <cstddef>
+#include <cstdbool>
+#include <string>
+#include <cstring>
+#include <vector>
+#include <unordered_set>
+#include <utility>
+#include <algorithm>
+
+#if defined(__AVX2__)
+#define TEDDY_USE_AVX2      1
+#endif
+
+#if defined(__SSSE3__) || defined(__AVX__) || defined(__AVX2__) \
+ || (defined(_MSC_VER) && (defined(_M_X64) || defined(_M_AMD64)))
+#define TEDDY_USE_SSSE3     1
+#endif
+
+#if defined(TEDDY_USE_AVX2)
+#include <immintrin.h>  // AVX 2
+#elif defined(TEDDY_USE_SSSE3)
+#include <tmmintrin.h>  // SSSE 3   (include pmmintrin.h)
+#endif
+
+#include "support/bitscan_forward.h"
+
+#include "benchmark.h"
+
+namespace utf8 {
+
+//
+// The Teddy multi-literal matcher (from Hyperscan): the keys are put into 8 buckets,
+// for each of the first 1 to 3 bytes of the keys, two pshufb tables map the low
+// and the high nibble of a text byte to the buckets which can have it there.
+// The AND of the tables of the 16 (SSSE3) or 32 (AVX2) positions are the candidate
+// positions, then the keys of the same head bytes (a hash table) are verified.
+//
+// There is no trie, it's for the small dictionaries (up to a few hundred keys),
+// the buckets of a big dictionary are too crowded to filter anything.
+// The matches are leftmost-longest and non-overlapping, the same as utf8::DAT<T>.
+//
+// See: https://github.com/intel/hyperscan/blob/master/src/fdr/teddy.c
+// See: https://github.com/BurntSushi/aho-corasick/tree/master/src/packed/teddy
+//
+template <typename CharT>
+class Teddy {
+public:
+    typedef Teddy<CharT>                                    this_type;
+    typedef typename ::detail::char_trait<CharT>::NoSigned  char_type;
+    typedef typename ::detail::char_trait<CharT>::Signed    schar_type;
+    typedef typename ::detail::char_trait<CharT>::Unsigned  uchar_type;
+
+    typedef std::size_t                                     size_type;
+    typedef std::uint32_t                                   ident_t;
+
+    static const size_type kMaxBuckets = 8;
+    static const size_type kMaxMaskLen = 3;
+
+    #pragma pack(push, 1)
+
+    struct MatchInfoEx {
+        std::uint32_t begin;
+        std::uint32_t end;
+        std::uint32_t pattern_id;
+        std::uint32_t reserve;
+    };
+
+    #pragma pack(pop)
+
+    //
+    // A key in the bucket, prefix is the first (up to) 4 bytes of it.
+    //
+    struct Literal {
+        std::uint32_t offset;
+        std::uint32_t length;
+        std::uint32_t pattern_id;
+        std::uint32_t prefix;
+        std::uint32_t prefix_mask;
+    };
+
+private:
+    // The keys of the next build().
+    std::vector<std::pair<std::string, std::uint32_t>> keys_;
+    std::unordered_set<std::string> key_set_;
+
+    // The keys of a head (the first mask_len_ bytes) are literals_[first, first + count)
+    // of its slot, the longer ones are first. The slots are open addressing.
+    struct HeadSlot {
+        std::uint32_t head;
+        std::uint32_t first;
+        std::uint32_t count;
+    };
+
+    std::string key_arena_;
+    std::vector<Literal> literals_;
+    std::vector<HeadSlot> head_table_;
+    std::uint32_t head_shift_;
+
+    // The first mask_len_ bytes of the keys are in the masks, 0 is not built.
+    size_type mask_len_;
+    alignas(16) std::uint8_t lo_masks_[kMaxMaskLen][16];
+    alignas(16) std::uint8_t hi_masks_[kMaxMaskLen][16];
+
+    bool use_avx2_;
+
+public:
+    Teddy() : head_shift_(32), mask_len_(0), use_avx2_(true) {
+        this->clear_masks();
+    }
+
+    virtual ~Teddy() {}
+
+    //
+    // There are no states, it's the count of the keys.
+    //
+    ident_t max_state_id() const {
+        return static_cast<ident_t>(this->literals_.size());
+    }
+
+    size_type size() const {
+        return this->literals_.size();
+    }
+
+    size_type mask_len() const {
+        return this->mask_len_;
+    }
+
+    bool has_overflow_labels() const {
+        return false;
+    }
+
+    size_type dat_bytes() const {
+        return (this->literals_.size() * sizeof(Literal) + this->key_arena_.size() +
+                this->head_table_.size() * sizeof(HeadSlot) + sizeof(this->lo_masks_) + sizeof(this->hi_masks_));
+    }
+
+    //
+    // The AVX2 kernel is used if it's compiled in (-mavx2) and it's on,
+    // otherwise the SSSE3 kernel, or the scalar loop if there is no SSSE3.
+    //
+    void set_avx2(bool use_avx2) {
+        this->use_avx2_ = use_avx2;
+    }
+
+    bool use_avx2() const {
+#if defined(TEDDY_USE_AVX2)
+        return this->use_avx2_;
+#else
+        return false;
+#endif
+    }
+
+    void clear() {
+        this->clear_ac_trie();
+        this->clear_trie();
+    }
+
+    //
+    // Only the keys of the next build() are cleared, the built literals have the copies.
+    //
+    void clear_ac_trie() {
+        this->keys_.clear();
+        this->key_set_.clear();
+    }
+
+    void clear_trie() {
+        this->key_arena_.clear();
+        this->literals_.clear();
+        this->head_table_.clear();
+        this->head_shift_ = 32;
+        this->mask_len_ = 0;
+        this->clear_masks();
+    }
+
+    bool insert(const uchar_type * pattern, size_type length, std::uint32_t id) {
+        if (length == 0)
+            return false;
+        std::string key((const char *)pattern, length);
+        if (!this->key_set_.insert(key).second)
+            return false;
+        this->keys_.push_back(std::make_pair(key, id));
+        return true;
+    }
+
+    bool insert(const char_type * pattern, size_type length, std::uint32_t id) {
+        return this->insert((const uchar_type *)pattern, length, id);
+    }
+
+    bool insert(const schar_type * pattern, size_type length, std::uint32_t id) {
+        return this->insert((const uchar_type *)pattern, length, id);
+    }
+
+    bool insert(const std::string & pattern, std::uint32_t id) {
+        return this->insert(pattern.c_str(), pattern.size(), id);
+    }
+
+    void build() {
+        this->clear_trie();
+        if (this->keys_.empty())
+            return;
+
+        size_type min_length = this->keys_[0].first.size();
+        for (auto iter = this->keys_.begin(); iter != this->keys_.end(); ++iter) {
+            min_length = (std::min)(min_length, iter->first.size());
+        }
+        // std::min() takes the references, kMaxMaskLen has no definition out of the class.
+        size_type max_mask_len = kMaxMaskLen;
+        size_type mask_len = (std::min)(min_length, max_mask_len);
+
+        // The keys of the same head bytes are put into the same bucket,
+        // the buckets have the same count of keys.
+        std::vector<size_type> order(this->keys_.size());
+        for (size_type i = 0; i < order.size(); i++) {
+            order[i] = i;
+        }
+        std::sort(order.begin(), order.end(), [&](size_type lhs, size_type rhs) {
+            return (this->keys_[lhs].first.compare(0, mask_len, this->keys_[rhs].first, 0, mask_len) < 0);
+        });
+
+        for (size_type i = 0; i < order.size(); i++) {
+            const std::string & key = this->keys_[order[i]].first;
+            size_type bucket = i * kMaxBuckets / order.size();
+            for (size_type n = 0; n < mask_len; n++) {
+                std::uint8_t ch = (std::uint8_t)key[n];
+                this->lo_masks_[n][ch & 0x0F] |= (std::uint8_t)(1u << bucket);
+                this->hi_masks_[n][ch >> 4]   |= (std::uint8_t)(1u << bucket);
+            }
+        }
+
+        // The keys of the same head are together, the longer ones are first.
+        std::stable_sort(order.begin(), order.end(), [&](size_type lhs, size_type rhs) {
+            int compare = this->keys_[lhs].first.compare(0, mask_len, this->keys_[rhs].first, 0, mask_len);
+            return ((compare < 0) ||
+                    ((compare == 0) && (this->keys_[lhs].first.size() > this->keys_[rhs].first.size())));
+        });
+
+        size_type table_size = 16;
+        while (table_size < order.size() * 2) {
+            table_size *= 2;
+        }
+        this->head_table_.resize(table_size);
+        this->head_shift_ = 32;
+        while (table_size > 1) {
+            this->head_shift_--;
+            table_size /= 2;
+        }
+
+        for (auto iter = order.begin(); iter != order.end(); ++iter) {
+            const std::string & key = this->keys_[*iter].first;
+            Literal literal;
+            literal.offset = (std::uint32_t)this->key_arena_.size();
+            literal.length = (std::uint32_t)key.size();
+            literal.pattern_id = this->keys_[*iter].second;
+            literal.prefix = 0;
+            literal.prefix_mask = 0;
+            for (size_type i = 0; i < key.size() && i < 4; i++) {
+                literal.prefix |= (std::uint32_t)(std::uint8_t)key[i] << (i * 8);
+                literal.prefix_mask |= 0xFFu << (i * 8);
+            }
+
+            std::uint32_t head = read_head((const uchar_type *)key.c_str(), mask_len);
+            HeadSlot * slot = this->find_slot(head);
+            if (slot->count == 0) {
+                slot->head = head;
+                slot->first = (std::uint32_t)this->literals_.size();
+            }
+            slot->count++;
+
+            this->literals_.push_back(literal);
+            this->key_arena_.append(key);
+        }
+        this->mask_len_ = mask_len;
+    }
+
+    void match_one(const uchar_type * first, const uchar_type * last,
+                   std::vector<MatchInfoEx> & match_list,
+                   const std::vector<int> & length_list) {
+        this->match_leftmost_longest(first, last, match_list);
+    }
+
+    void match_one(const char_type * first, const char_type * last,
+                   std::vector<MatchInfoEx> & match_list,
+                   const std::vector<int> & length_list) {
+        return this->match_one((const uchar_type *)first, (const uchar_type *)last, match_list, length_list);
+    }
+
+    void match_one(const schar_type * first, const schar_type * last,
+                   std::vector<MatchInfoEx> & match_list,
+                   const std::vector<int> & length_list) {
+        return this->match_one((const uchar_type *)first, (const uchar_type *)last, match_list, length_list);
+    }
+
+    //
+    // Match the whole chunk in one pass. The keys have no '\n', so no match
+    // crosses the line end, it's the same as match_one() per line.
+    //
+    void match_chunk(const uchar_type * first, const uchar_type * last,
+                     std::vector<MatchInfoEx> & match_list,
+                     const std::vector<int> & length_list) {
+        this->match_leftmost_longest(first, last, match_list);
+    }
+
+    void match_chunk(const char_type * first, const char_type * last,
+                     std::vector<MatchInfoEx> & match_list,
+                     const std::vector<int> & length_list) {
+        return this->match_chunk((const uchar_type *)first, (const uchar_type *)last, match_list, length_list);
+    }
+
+    void match_chunk(const schar_type * first, const schar_type * last,
+                     std::vector<MatchInfoEx> & match_list,
+                     const std::vector<int> & length_list) {
+        return this->match_chunk((const uchar_type *)first, (const uchar_type *)last, match_list, length_list);
+    }
+
+private:
+    void clear_masks() {
+        std::memset(this->lo_masks_, 0, sizeof(this->lo_masks_));
+        std::memset(this->hi_masks_, 0, sizeof(this->hi_masks_));
+    }
+
+    void match_leftmost_longest(const uchar_type * first, const uchar_type * last,
+                                std::vector<MatchInfoEx> & match_list) {
+        match_list.clear();
+        assert(first <= last);
+
+        const uchar_type * text = first;
+        switch (this->mask_len_) {
+            case 1:
+                text = this->template match_simd<1>(first, text, last, match_list);
+                break;
+            case 2:
+                text = this->template match_simd<2>(first, text, last, match_list);
+                break;
+            case 3:
+                text = this->template match_simd<3>(first, text, last, match_list);
+                break;
+            default:
+                // Not built.
+                return;
+        }
+        this->match_scalar(first, text, last, match_list);
+    }
+
+    template <size_type MaskLen>
+    const uchar_type * match_simd(const uchar_type * first, const uchar_type * text,
+                                  const uchar_type * last,
+                                  std::vector<MatchInfoEx> & match_list) {
+#if defined(TEDDY_USE_AVX2)
+        if (this->use_avx2_)
+            text = this->template match_avx2<MaskLen>(first, text, last, match_list);
+#endif
+#if defined(TEDDY_USE_SSSE3)
+        text = this->template match_ssse3<MaskLen>(first, text, last, match_list);
+#endif
+        return text;
+    }
+
+#if defined(TEDDY_USE_SSSE3)
+
+    template <size_type MaskLen>
+    const uchar_type * match_ssse3(const uchar_type * first, const uchar_type * text,
+                                   const uchar_type * last,
+                                   std::vector<MatchInfoEx> & match_list) {
+        static const size_type kBlockSize = 16;
+
+        __m128i lo_masks[MaskLen], hi_masks[MaskLen];
+        for (size_type i = 0; i < MaskLen; i++) {
+            lo_masks[i] = _mm_load_si128((const __m128i *)this->lo_masks_[i]);
+            hi_masks[i] = _mm_load_si128((const __m128i *)this->hi_masks_[i]);
+        }
+        const __m128i nibble_mask = _mm_set1_epi8(0x0F);
+        const __m128i zeros = _mm_setzero_si128();
+
+        // The text of the last mask byte of the block must be in the range.
+        while ((size_type)(last - text) >= (kBlockSize + MaskLen - 1)) {
+            // Lane i is the buckets of the keys which can begin at (text + i).
+            __m128i result = _mm_set1_epi8(-1);
+            for (size_type i = 0; i < MaskLen; i++) {
+                __m128i chars = _mm_loadu_si128((const __m128i *)(text + i));
+                __m128i lo_nibbles = _mm_and_si128(chars, nibble_mask);
+                __m128i hi_nibbles = _mm_and_si128(_mm_srli_epi16(chars, 4), nibble_mask);
+                result = _mm_and_si128(result, _mm_and_si128(_mm_shuffle_epi8(lo_masks[i], lo_nibbles),
+                                                             _mm_shuffle_epi8(hi_masks[i], hi_nibbles)));
+            }
+            std::uint32_t mask = (~(std::uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(result, zeros))) & 0xFFFFu;
+            if (likely(mask == 0)) {
+                text += kBlockSize;
+                continue;
+            }
+
+            text = this->verify_block(first, text, last, kBlockSize, mask, match_list);
+        }
+        return text;
+    }
+
+#endif // TEDDY_USE_SSSE3
+
+#if defined(TEDDY_USE_AVX2)
+
+    template <size_type MaskLen>
+    const uchar_type * match_avx2(const uchar_type * first, const uchar_type * text,
+                                  const uchar_type * last,
+                                  std::vector<MatchInfoEx> & match_list) {
+        static const size_type kBlockSize = 32;
+
+        __m256i lo_masks[MaskLen], hi_masks[MaskLen];
+        for (size_type i = 0; i < MaskLen; i++) {
+            lo_masks[i] = _mm256_broadcastsi128_si256(_mm_load_si128((const __m128i *)this->lo_masks_[i]));
+            hi_masks[i] = _mm256_broadcastsi128_si256(_mm_load_si128((const __m128i *)this->hi_masks_[i]));
+        }
+        const __m256i nibble_mask = _mm256_set1_epi8(0x0F);
+        const __m256i zeros = _mm256_setzero_si256();
+
+        while ((size_type)(last - text) >= (kBlockSize + MaskLen - 1)) {
+            __m256i result = _mm256_set1_epi8(-1);
+            for (size_type i = 0; i < MaskLen; i++) {
+                __m256i chars = _mm256_loadu_si256((const __m256i *)(text + i));
+                __m256i lo_nibbles = _mm256_and_si256(chars, nibble_mask);
+                __m256i hi_nibbles = _mm256_and_si256(_mm256_srli_epi16(chars, 4), nibble_mask);
+                result = _mm256_and_si256(result, _mm256_and_si256(_mm256_shuffle_epi8(lo_masks[i], lo_nibbles),
+                                                                   _mm256_shuffle_epi8(hi_masks[i], hi_nibbles)));
+            }
+            std::uint32_t mask = ~(std::uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(result, zeros));
+            if (likely(mask == 0)) {
+                text += kBlockSize;
+                continue;
+            }
+
+            text = this->verify_block(first, text, last, kBlockSize, mask, match_list);
+        }
+        return text;
+    }
+
+#endif // TEDDY_USE_AVX2
+
+    //
+    // Verify the candidates of the block in order, return the next position to scan:
+    // the end of the first match, or the end of the block if there is no match.
+    //
+    inline
+    const uchar_type * verify_block(const uchar_type * first, const uchar_type * text,
+                                    const uchar_type * last, size_type block_size,
+                                    std::uint32_t mask,
+                                    std::vector<MatchInfoEx> & match_list) {
+        do {
+            unsigned long index;
+            __BitScanForward(index, mask);
+            const uchar_type * candidate = text + index;
+            std::uint32_t pattern_id;
+            std::uint32_t length = this->verify(candidate, last, pattern_id);
+            if (length != 0) {
+                this->add_match(match_list, first, candidate, length, pattern_id);
+                return (candidate + length);
+            }
+            mask &= mask - 1;
+        } while (mask != 0);
+        return (text + block_size);
+    }
+
+    void match_scalar(const uchar_type * first, const uchar_type * text,
+                      const uchar_type * last, std::vector<MatchInfoEx> & match_list) {
+        size_type mask_len = this->mask_len_;
+        while (text < last) {
+            std::uint32_t bucket_mask = 0xFFu;
+            for (size_type i = 0; i < mask_len; i++) {
+                if ((text + i) >= last) {
+                    bucket_mask = 0;
+                    break;
+                }
+                std::uint8_t ch = (std::uint8_t)text[i];
+                bucket_mask &= (this->lo_masks_[i][ch & 0x0F] & this->hi_masks_[i][ch >> 4]);
+            }
+            if (bucket_mask != 0) {
+                std::uint32_t pattern_id;
+                std::uint32_t length = this->verify(text, last, pattern_id);
+                if (length != 0) {
+                    this->add_match(match_list, first, text, length, pattern_id);
+                    text += length;
+                    continue;
+                }
+            }
+            text++;
+        }
+    }
+
+    static inline
+    std::uint32_t read_head(const uchar_type * text, size_type mask_len) {
+        std::uint32_t head = 0;
+        for (size_type i = 0; i < mask_len; i++) {
+            head |= (std::uint32_t)(std::uint8_t)text[i] << (i * 8);
+        }
+        return head;
+    }
+
+    inline HeadSlot * find_slot(std::uint32_t head) {
+        size_type mask = this->head_table_.size() - 1;
+        size_type index = (size_type)((head * 0x9E3779B1u) >> this->head_shift_);
+        while ((this->head_table_[index].count != 0) && (this->head_table_[index].head != head)) {
+            index = (index + 1) & mask;
+        }
+        return &this->head_table_[index];
+    }
+
+    inline const HeadSlot * find_slot(std::uint32_t head) const {
+        return const_cast<this_type *>(this)->find_slot(head);
+    }
+
+    //
+    // Return the length of the longest key which begins at text, or 0.
+    // The candidate passed the masks, the keys of its head are checked.
+    //
+    inline
+    std::uint32_t verify(const uchar_type * text, const uchar_type * last,
+                         std::uint32_t & pattern_id) const {
+        std::uint32_t remain = (std::uint32_t)(last - text);
+        if (remain < this->mask_len_)
+            return 0;
+
+        std::uint32_t head;
+        if (likely(remain >= 4)) {
+            std::memcpy(&head, text, sizeof(std::uint32_t));
+        } else {
+            head = read_head(text, remain);
+        }
+
+        const HeadSlot * slot = this->find_slot(head & (0xFFFFFFFFu >> ((4 - this->mask_len_) * 8)));
+        if (slot->count == 0)
+            return 0;
+
+        const char * key_arena = this->key_arena_.data();
+        const Literal * literal = this->literals_.data() + slot->first;
+        const Literal * literal_last = literal + slot->count;
+        for (; literal < literal_last; ++literal) {
+            if ((literal->length > remain) || ((head & literal->prefix_mask) != literal->prefix))
+                continue;
+            if ((literal->length <= 4) ||
+                (std::memcmp(text + 4, key_arena + literal->offset + 4, literal->length - 4) == 0)) {
+                pattern_id = literal->pattern_id;
+                return literal->length;
+            }
+        }
+        return 0;
+    }
+
+    static inline
+    void add_match(std::vector<MatchInfoEx> & match_list, const uchar_type * first,
+                   const uchar_type * text, std::uint32_t length, std::uint32_t pattern_id) {
+        MatchInfoEx matchInfo;
+        matchInfo.begin      = (std::uint32_t)(text - first);
+        matchInfo.end        = matchInfo.begin + length;
+        matchInfo.pattern_id = pattern_id;
+        matchInfo.reserve    = 0;
+        match_list.push_back(matchInfo);
+    }
+
+    Teddy(const Teddy & src) = delete;
+    Teddy & operator = (const Teddy & rhs) = delete;
+};
+
+//
+// The Teddy matcher of the SSSE3 kernel, even if AVX2 is compiled in.
+//
+template <typename CharT>
+class Teddy_SSSE3 : public Teddy<CharT> {
+public:
+    Teddy_SSSE3() : Teddy<CharT>() {
+        this->set_avx2(false);
+    }
+
+    virtual ~Teddy_SSSE3() {}
+};
+
+} // namespace utf8
+
+#endif // TEDDY_UTF8_H
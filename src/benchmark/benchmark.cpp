@@ -26,6 +26,7 @@
 #include <vector>
 #include <utility>
 #include <algorithm>
+#include <thread>
 
 #ifndef __cplusplus
 #include <stdalign.h>   // C11 defines _Alignas().  This header defines alignas()
@@ -67,6 +68,7 @@
 #include "strstr_benchmark.h"
 #include "ac_benchmark.h"
 #include "darts_benchmark.h"
+#include "StringReplacer.h"
 
 using namespace StringMatch;
 
@@ -130,6 +132,8 @@ void benchmark(const std::string & dict_file,
     test::StopWatch sw;
     double elapsedTime;
 
+    double input_size_mb = (double)get_file_size(input_file) / (1024.0 * 1024.0);
+
 #if 0
     sw.start();
     strstr_bench::StringReplace("strstr", dict_file, input_file, output_file);
@@ -191,8 +195,172 @@ void benchmark(const std::string & dict_file,
     sw.stop();
 
     elapsedTime = sw.getMillisec();
-    printf("elapsed time: %0.2f ms\n\n", elapsedTime);
+    printf("elapsed time: %0.2f ms, throughput: %0.2f MB/s\n\n",
+           elapsedTime, input_size_mb * 1000.0 / elapsedTime);
+#endif
+
+#if 1
+    sw.start();
+    darts_bench::StringReplaceMmap<utf8::DAT<char>>("dat_utf8_mmap", dict_file, input_file, output_file);
+    sw.stop();
+
+    elapsedTime = sw.getMillisec();
+    printf("elapsed time: %0.2f ms, throughput: %0.2f MB/s\n\n",
+           elapsedTime, input_size_mb * 1000.0 / elapsedTime);
+#endif
+
+#if 1
+    sw.start();
+    darts_bench::StringReplaceMmap<utf8::DAT_DFA<char>>("dat_utf8_dfa", dict_file, input_file, output_file);
+    sw.stop();
+
+    elapsedTime = sw.getMillisec();
+    printf("elapsed time: %0.2f ms, throughput: %0.2f MB/s\n\n",
+           elapsedTime, input_size_mb * 1000.0 / elapsedTime);
+#endif
+
+#if 1
+    sw.start();
+    darts_bench::StringReplaceMmap<utf8::DAT_Remap<char>>("dat_utf8_remap", dict_file, input_file, output_file);
+    sw.stop();
+
+    elapsedTime = sw.getMillisec();
+    printf("elapsed time: %0.2f ms, throughput: %0.2f MB/s\n\n",
+           elapsedTime, input_size_mb * 1000.0 / elapsedTime);
+#endif
+
+#if 1
+    sw.start();
+    darts_bench::StringReplaceMmap<utf8::DAT_Prefilter<char>>("dat_utf8_prefilter", dict_file, input_file, output_file);
+    sw.stop();
+
+    elapsedTime = sw.getMillisec();
+    printf("elapsed time: %0.2f ms, throughput: %0.2f MB/s\n\n",
+           elapsedTime, input_size_mb * 1000.0 / elapsedTime);
+#endif
+
+#if 1
+    sw.start();
+    darts_bench::StringReplaceMmap<utf8::Teddy<char>>("teddy_utf8", dict_file, input_file, output_file);
+    sw.stop();
+
+    elapsedTime = sw.getMillisec();
+    printf("elapsed time: %0.2f ms, throughput: %0.2f MB/s\n\n",
+           elapsedTime, input_size_mb * 1000.0 / elapsedTime);
+#endif
+
+#if 1
+    sw.start();
+    darts_bench::StringReplaceMmap<utf8::DAT_Byte<char>>("dat_utf8_byte", dict_file, input_file, output_file);
+    sw.stop();
+
+    elapsedTime = sw.getMillisec();
+    printf("elapsed time: %0.2f ms, throughput: %0.2f MB/s\n\n",
+           elapsedTime, input_size_mb * 1000.0 / elapsedTime);
+#endif
+
+#if 1
+    sw.start();
+    darts_bench::StringReplaceScatter<utf8::DAT<char>>("dat_utf8_scatter", dict_file, input_file, output_file);
+    sw.stop();
+
+    elapsedTime = sw.getMillisec();
+    printf("elapsed time: %0.2f ms, throughput: %0.2f MB/s\n\n",
+           elapsedTime, input_size_mb * 1000.0 / elapsedTime);
+#endif
+
+#if 1
+    sw.start();
+    darts_bench::StringReplaceStream<utf8::DAT<char>>("dat_utf8_stream", dict_file, input_file, output_file);
+    sw.stop();
+
+    elapsedTime = sw.getMillisec();
+    printf("elapsed time: %0.2f ms, throughput: %0.2f MB/s\n\n",
+           elapsedTime, input_size_mb * 1000.0 / elapsedTime);
+#endif
+
+#if 1
+    // The scaling against the thread count: 1, 2, 4, ..., N threads.
+    {
+        std::size_t max_threads = (std::size_t)std::thread::hardware_concurrency();
+        if (max_threads == 0)
+            max_threads = 1;
+        for (std::size_t thread_num = 1; thread_num <= max_threads; thread_num *= 2) {
+            if ((thread_num * 2) > max_threads)
+                thread_num = max_threads;
+
+            sw.start();
+            darts_bench::StringReplaceParallel<utf8::DAT<char>>("dat_utf8_parallel", dict_file, input_file, output_file,
+                                                                thread_num);
+            sw.stop();
+
+            elapsedTime = sw.getMillisec();
+            printf("threads: %u, elapsed time: %0.2f ms, throughput: %0.2f MB/s\n\n",
+                   (uint32_t)thread_num, elapsedTime, input_size_mb * 1000.0 / elapsedTime);
+        }
+    }
 #endif
+
+#if 1
+    sw.start();
+    darts_bench::StringReplacePipeline<utf8::DAT<char>>("dat_utf8_pipeline", dict_file, input_file, output_file);
+    sw.stop();
+
+    elapsedTime = sw.getMillisec();
+    printf("elapsed time: %0.2f ms, throughput: %0.2f MB/s\n\n",
+           elapsedTime, input_size_mb * 1000.0 / elapsedTime);
+#endif
+
+#if 1
+    sw.start();
+    darts_bench::StringReplaceUring<utf8::DAT<char>>("dat_utf8_uring", dict_file, input_file, output_file);
+    sw.stop();
+
+    elapsedTime = sw.getMillisec();
+    printf("elapsed time: %0.2f ms, throughput: %0.2f MB/s\n\n",
+           elapsedTime, input_size_mb * 1000.0 / elapsedTime);
+#endif
+
+#ifndef _DEBUG
+
+#if 1
+    // The state layouts: 16 bytes states (AoS) vs. the hot base/check array (split).
+    darts_bench::MatchBenchmark<utf8::DAT<char>>("dat_utf8_match_aos", dict_file, input_file);
+    darts_bench::MatchBenchmark<utf8::DAT_Split<char>>("dat_utf8_match_split", dict_file, input_file);
+    darts_bench::MatchBenchmark<utf8::DAT_Prefilter<char>>("dat_utf8_match_prefilter", dict_file, input_file);
+#endif
+
+#if 1
+    // The build time against the key count (up to BUILD_BENCHMARK_MAX_KEYS),
+    // see find_base() of utf8::DAT.
+    darts_bench::BuildBenchmark<utf8::DAT<char>>("dat_utf8_build", dict_file);
+    darts_bench::BuildBenchmark<utf8::DAT_Remap<char>>("dat_utf8_remap_build", dict_file);
+#endif
+
+#if 1
+    // The online updates of a built trie vs. a full rebuild.
+    darts_bench::UpdateBenchmark<utf8::DAT<char>>("dat_utf8_update", dict_file);
+    darts_bench::UpdateBenchmark<utf8::DAT_Remap<char>>("dat_utf8_remap_update", dict_file);
+#endif
+
+#if 1
+    // Reload the dictionary under load, see TrieHandle.
+    darts_bench::HotSwapBenchmark<utf8::DAT<char>>("dat_utf8_hot_swap", dict_file, input_file);
+#endif
+
+#if 1
+    // K interleaved streams with the software prefetch, see DAT::match_chunk_interleaved().
+    darts_bench::InterleaveBenchmark<utf8::DAT<char>>("dat_utf8_interleave_aos", dict_file, input_file);
+    darts_bench::InterleaveBenchmark<utf8::DAT_Split<char>>("dat_utf8_interleave_split", dict_file, input_file);
+    darts_bench::InterleaveBenchmark<utf8::DAT_DFA<char>>("dat_utf8_interleave_dfa", dict_file, input_file);
+#endif
+
+#if 1
+    // The Teddy matcher vs. the trie, by the key count of the dictionary.
+    darts_bench::TeddyBenchmark<utf8::Teddy<char>, utf8::DAT<char>>("teddy_utf8_vs_dat", dict_file, input_file);
+#endif
+
+#endif // !_DEBUG
 }
 
 void print_arch_type()
@@ -213,7 +381,6 @@ void print_arch_type()
 
 int main(int argc, char * argv[])
 {
-    print_arch_type();
     ::srand((unsigned int)::time(nullptr));
 #ifndef _DEBUG
     //cpu_warmup(1000);
@@ -227,6 +394,13 @@ int main(int argc, char * argv[])
     const char * input_file = nullptr;
     const char * output_file = nullptr;
 
+    // Batch mode: StringReplace --batch dict.txt (file_list.txt | input_dir) output_dir [threads]
+    if (argc > 4 && ::strcmp(argv[1], "--batch") == 0) {
+        print_arch_type();
+        std::size_t thread_num = (argc > 5) ? (std::size_t)::atoi(argv[5]) : 0;
+        return darts_bench::StringReplaceBatch<utf8::DAT<char>>(argv[2], argv[3], argv[4], thread_num);
+    }
+
     if (argc > 3) {
         dict_file = argv[1];
         input_file = argv[2];
@@ -245,6 +419,19 @@ int main(int argc, char * argv[])
         output_file = default_output_file;
     }
 
+    // Stream mode, "-" is stdin or stdout, e.g.
+    //   zcat input.txt.gz | StringReplace dict.txt - - | loader
+    if (pipe_io::is_stdio_name(input_file) || pipe_io::is_stdio_name(output_file)) {
+        int stdout_fd = 1;
+        if (pipe_io::is_stdio_name(output_file))
+            stdout_fd = pipe_io::detach_stdout();
+        print_arch_type();
+        return darts_bench::StringReplaceStdio<utf8::DAT<char>>(dict_file, input_file,
+                                                                 output_file, stdout_fd);
+    }
+
+    print_arch_type();
+
 #if 0
     ac_bench::v1_AcTire_test();
     ac_bench::v1_AcTireW_test();
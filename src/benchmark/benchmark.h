@@ -479,6 +479,19 @@ std::size_t read_dict_file(const std::string & dict_file, std::string & content)
     return content.size();
 }
 
+std::size_t get_file_size(const std::string & filename)
+{
+    std::size_t file_size = 0;
+    std::ifstream ifs;
+    ifs.open(filename, std::ios::in | std::ios::binary);
+    if (ifs.good()) {
+        ifs.seekg(0, std::ios::end);
+        file_size = (std::size_t)ifs.tellg();
+        ifs.close();
+    }
+    return file_size;
+}
+
 inline
 std::size_t find_kv_separator(const std::string & dict_kv,
                               std::size_t start_pos, std::size_t end_pos,
@@ -0,0 +1,248 @@
+
+#ifndef BYTE_PREFILTER_H
+#define BYTE_PREFILTER_H
+
+#if defined(_MSC_VER) && (_MSC_VER >= 1020)
+#pragma once
+#endif
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <string.h>
+#include <assert.h>
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+#if defined(__AVX2__)
+#define BYTE_PREFILTER_USE_AVX2     1
+#endif
+
+#if defined(__SSE4_1__) || defined(__AVX__) || defined(__AVX2__) \
+ || (defined(_MSC_VER) && (defined(_M_X64) || defined(_M_AMD64)))
+#define BYTE_PREFILTER_USE_SSE41    1
+#endif
+
+#if defined(BYTE_PREFILTER_USE_AVX2)
+#include <immintrin.h>  // AVX 2
+#elif defined(BYTE_PREFILTER_USE_SSE41)
+#include <smmintrin.h>  // SSE 4.1  (include tmmintrin.h)
+#endif
+
+#include "basic/stddef.h"
+#include "support/bitscan_forward.h"
+
+//
+// The candidate start positions of the keys: the set of the first bytes and the
+// set of the first byte pairs of the keys. find() scans 16 or 32 bytes per step
+// for the first bytes, the set is looked up by two pshufb nibble tables, then
+// the pairs of the hits are checked in a 64K bits bitmap.
+//
+// See: http://0x80.pl/articles/simd-byte-lookup.html
+//
+class BytePrefilter {
+public:
+    typedef std::size_t size_type;
+
+    // The first 4 words are the first byte set, the next 1024 words are the pair set.
+    static const size_type kByteSetWords = 256 / 64;
+    static const size_type kPairSetWords = 65536 / 64;
+    static const size_type kTotalWords = kByteSetWords + kPairSetWords;
+
+private:
+    std::vector<std::uint64_t> bits_;
+
+    // Bit h of lo_rows_[l] is set if the byte (h << 4) | l is in the set, h is 0 to 7,
+    // hi_rows_[l] is the same for h is 8 to 15.
+    alignas(16) std::uint8_t lo_rows_[16];
+    alignas(16) std::uint8_t hi_rows_[16];
+
+public:
+    BytePrefilter() {
+        std::memset(this->lo_rows_, 0, sizeof(this->lo_rows_));
+        std::memset(this->hi_rows_, 0, sizeof(this->hi_rows_));
+    }
+
+    bool empty() const {
+        return this->bits_.empty();
+    }
+
+    const std::vector<std::uint64_t> & bits() const {
+        return this->bits_;
+    }
+
+    void clear() {
+        this->bits_.clear();
+        std::memset(this->lo_rows_, 0, sizeof(this->lo_rows_));
+        std::memset(this->hi_rows_, 0, sizeof(this->hi_rows_));
+    }
+
+    //
+    // Replace the sets with the saved ones, return false if the size is wrong.
+    //
+    bool assign(const std::vector<std::uint64_t> & bits) {
+        if (bits.empty()) {
+            this->clear();
+            return true;
+        }
+        if (bits.size() != kTotalWords)
+            return false;
+        this->bits_ = bits;
+        this->build_rows();
+        return true;
+    }
+
+    //
+    // Add the first byte and the byte pair, if the key is only one byte,
+    // the byte pairs of any second byte are added. The nibble tables are
+    // updated too, so a key can be added to a built prefilter.
+    //
+    void add_pair(std::uint8_t first, std::uint8_t second) {
+        this->reserve_bits();
+        this->set_first(first);
+        std::uint32_t pair = ((std::uint32_t)first << 8) | second;
+        this->set_bit(kByteSetWords * 64 + pair);
+    }
+
+    void add_first(std::uint8_t first) {
+        this->reserve_bits();
+        this->set_first(first);
+        std::uint64_t * pair_words = &this->bits_[kByteSetWords + (size_type)first * 256 / 64];
+        for (size_type i = 0; i < 256 / 64; i++) {
+            pair_words[i] = ~std::uint64_t(0);
+        }
+    }
+
+    void add_key(const std::uint8_t * key, size_type length) {
+        if (length >= 2)
+            this->add_pair(key[0], key[1]);
+        else if (length == 1)
+            this->add_first(key[0]);
+    }
+
+    //
+    // Build the nibble tables from the first byte set, after the sets are replaced.
+    //
+    void build_rows() {
+        std::memset(this->lo_rows_, 0, sizeof(this->lo_rows_));
+        std::memset(this->hi_rows_, 0, sizeof(this->hi_rows_));
+        for (std::uint32_t ch = 0; ch < 256; ch++) {
+            if (this->has_first(std::uint8_t(ch)))
+                this->set_row(std::uint8_t(ch));
+        }
+    }
+
+    inline bool has_first(std::uint8_t ch) const {
+        assert(!this->empty());
+        return ((this->bits_[ch / 64] & (std::uint64_t(1) << (ch % 64))) != 0);
+    }
+
+    inline bool has_pair(std::uint8_t first, std::uint8_t second) const {
+        assert(!this->empty());
+        std::uint32_t pair = ((std::uint32_t)first << 8) | second;
+        return ((this->bits_[kByteSetWords + pair / 64] & (std::uint64_t(1) << (pair % 64))) != 0);
+    }
+
+    //
+    // Return the first position in [first, last) which the first byte and the
+    // byte pair are in the sets (the last byte only needs the first byte),
+    // or last if there is no one.
+    //
+    const std::uint8_t * find(const std::uint8_t * first, const std::uint8_t * last) const {
+        const std::uint8_t * text = first;
+
+#if defined(BYTE_PREFILTER_USE_AVX2)
+        const __m256i lo_rows = _mm256_broadcastsi128_si256(_mm_load_si128((const __m128i *)this->lo_rows_));
+        const __m256i hi_rows = _mm256_broadcastsi128_si256(_mm_load_si128((const __m128i *)this->hi_rows_));
+        const __m256i bit_table = _mm256_setr_epi8(1, 2, 4, 8, 16, 32, 64, -128, 1, 2, 4, 8, 16, 32, 64, -128,
+                                                   1, 2, 4, 8, 16, 32, 64, -128, 1, 2, 4, 8, 16, 32, 64, -128);
+        const __m256i nibble_mask = _mm256_set1_epi8(0x0F);
+        const __m256i zeros = _mm256_setzero_si256();
+
+        while ((last - text) >= 32) {
+            __m256i chars = _mm256_loadu_si256((const __m256i *)text);
+            __m256i lo_nibbles = _mm256_and_si256(chars, nibble_mask);
+            __m256i hi_nibbles = _mm256_and_si256(_mm256_srli_epi16(chars, 4), nibble_mask);
+            // The top bit of the char selects the row of the high nibbles 8 to 15.
+            __m256i rows = _mm256_blendv_epi8(_mm256_shuffle_epi8(lo_rows, lo_nibbles),
+                                              _mm256_shuffle_epi8(hi_rows, lo_nibbles), chars);
+            __m256i bits = _mm256_and_si256(rows, _mm256_shuffle_epi8(bit_table, hi_nibbles));
+            std::uint32_t mask = ~(std::uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(bits, zeros));
+            while (mask != 0) {
+                unsigned long index;
+                __BitScanForward(index, mask);
+                const std::uint8_t * candidate = text + index;
+                if (this->check_pair(candidate, last))
+                    return candidate;
+                mask &= mask - 1;
+            }
+            text += 32;
+        }
+#endif // BYTE_PREFILTER_USE_AVX2
+
+#if defined(BYTE_PREFILTER_USE_SSE41)
+        const __m128i lo_rows_128 = _mm_load_si128((const __m128i *)this->lo_rows_);
+        const __m128i hi_rows_128 = _mm_load_si128((const __m128i *)this->hi_rows_);
+        const __m128i bit_table_128 = _mm_setr_epi8(1, 2, 4, 8, 16, 32, 64, -128, 1, 2, 4, 8, 16, 32, 64, -128);
+        const __m128i nibble_mask_128 = _mm_set1_epi8(0x0F);
+        const __m128i zeros_128 = _mm_setzero_si128();
+
+        while ((last - text) >= 16) {
+            __m128i chars = _mm_loadu_si128((const __m128i *)text);
+            __m128i lo_nibbles = _mm_and_si128(chars, nibble_mask_128);
+            __m128i hi_nibbles = _mm_and_si128(_mm_srli_epi16(chars, 4), nibble_mask_128);
+            __m128i rows = _mm_blendv_epi8(_mm_shuffle_epi8(lo_rows_128, lo_nibbles),
+                                           _mm_shuffle_epi8(hi_rows_128, lo_nibbles), chars);
+            __m128i bits = _mm_and_si128(rows, _mm_shuffle_epi8(bit_table_128, hi_nibbles));
+            std::uint32_t mask = (~(std::uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(bits, zeros_128))) & 0xFFFFu;
+            while (mask != 0) {
+                unsigned long index;
+                __BitScanForward(index, mask);
+                const std::uint8_t * candidate = text + index;
+                if (this->check_pair(candidate, last))
+                    return candidate;
+                mask &= mask - 1;
+            }
+            text += 16;
+        }
+#endif // BYTE_PREFILTER_USE_SSE41
+
+        while (text < last) {
+            if (this->has_first(*text) && this->check_pair(text, last))
+                return text;
+            text++;
+        }
+        return last;
+    }
+
+private:
+    void reserve_bits() {
+        if (this->bits_.empty())
+            this->bits_.resize(kTotalWords, 0);
+    }
+
+    void set_bit(size_type index) {
+        this->bits_[index / 64] |= (std::uint64_t(1) << (index % 64));
+    }
+
+    void set_row(std::uint8_t ch) {
+        std::uint8_t bit = (std::uint8_t)(1u << ((ch >> 4) & 0x07));
+        if (ch < 0x80)
+            this->lo_rows_[ch & 0x0F] |= bit;
+        else
+            this->hi_rows_[ch & 0x0F] |= bit;
+    }
+
+    void set_first(std::uint8_t ch) {
+        this->set_bit(ch);
+        this->set_row(ch);
+    }
+
+    inline bool check_pair(const std::uint8_t * text, const std::uint8_t * last) const {
+        return (((text + 1) >= last) || this->has_pair(text[0], text[1]));
+    }
+};
+
+#endif // BYTE_PREFILTER_H
@@ -27,15 +27,32 @@
 #include <cstring>
 #include <list>
 #include <vector>
+#include <set>
 #include <functional>
 #include <utility>
 #include <algorithm>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <type_traits>
 
 #include "benchmark.h"
 #include "win_iconv.h"
 #include "Darts.h"
 #include "Darts_utf8.h"
 #include "DAT_utf8.h"
+#include "DAT_utf8_byte.h"
+#include "Teddy_utf8.h"
+#include "mmap_file.h"
+#include "ring_queue.h"
+#include "io_uring_utils.h"
+#include "scatter_writer.h"
+#include "value_arena.h"
+#include "file_utils.h"
+#include "perf_counter.h"
+#include "trie_handle.h"
 
 //
 // See: https://www.cnblogs.com/zhangchaoyang/articles/4508266.html
@@ -44,19 +61,47 @@
 
 #define USE_READ_WRITE_STATISTICS   0
 
+//
+// Match the whole chunk in one pass with AcTrieT::match_chunk(), which treats
+// '\n' as a hard reset, instead of one match_one() call per line.
+//
+#ifndef USE_CHUNK_MATCHING
+#define USE_CHUNK_MATCHING          1
+#endif
+
+//
+// Save the built trie to a file keyed by the hash of the dictionary, the next
+// run with the same dictionary maps the file instead of building the trie.
+// The cache is only used if $TRIE_CACHE_DIR is set, it's the cache directory,
+// so a run doesn't leave any file unless it's asked for.
+//
+#ifndef USE_TRIE_CACHE
+#define USE_TRIE_CACHE              1
+#endif
+
+//
+// The max key count of BuildBenchmark(), build with
+// -DBUILD_BENCHMARK_MAX_KEYS=1048576 for the 1M keys sweep (it takes a while).
+//
+#ifndef BUILD_BENCHMARK_MAX_KEYS
+#define BUILD_BENCHMARK_MAX_KEYS    (64 * 1024)
+#endif
+
 namespace darts_bench {
 
 static const bool kDisplayOutput = false;
 
 void preprocessing_dict_file(const std::string & dict_kv,
                              std::vector<std::pair<std::string, int>> & dict_list,
-                             std::vector<int> & length_list)
+                             std::vector<int> & length_list,
+                             ValueArena & value_arena)
 {
     std::size_t total_size = dict_kv.size();
     printf("darts_bench::preprocessing_dict_file()\n\n");
 
     dict_list.clear();
     length_list.clear();
+    value_arena.clear();
 
     std::uint32_t kv_index = 0;
     std::size_t last_pos = 0;
@@ -83,7 +128,16 @@ void preprocessing_dict_file(const std::string & dict_kv,
             utf8_to_ansi(value, value_ansi);
             printf("%4u, key: [ %s ], value: [ %s ].\n", kv_index + 1, key_ansi.c_str(), value_ansi.c_str());
 #endif
-            int value_type = ValueType::parseValueType(dict_kv, sep_pos + 1, next_pos);
+            // The value text is stored as is, it's not limited to the ValueType list,
+            // and an empty value just removes the key.
+            std::size_t value_last = next_pos;
+            if (value_last > (sep_pos + 1) && dict_kv[value_last - 1] == '\r')
+                value_last--;
+            value_arena.append(dict_kv.c_str() + sep_pos + 1, value_last - (sep_pos + 1));
+
+            int value_type = (value_last > (sep_pos + 1)) ?
+                             ValueType::parseValueType(dict_kv, sep_pos + 1, value_last) :
+                             ValueType::Unknown;
 
             dict_list.push_back(std::make_pair(key, value_type));
             length_list.push_back((std::uint32_t)key.size());
@@ -130,9 +184,32 @@ int getPatternType(std::uint32_t pattern_id,
     return valueType;
 }
 
+//
+// The worst case of output bytes per input byte, the replacement value
+// may be longer than the key, so the output buffer must be reserved enough.
+//
+static
+std::size_t getMaxExpandRatio(const std::vector<std::pair<std::string, int>> & dict_list,
+                              const ValueArena & value_arena)
+{
+    std::size_t max_ratio = 1;
+    std::uint32_t pattern_id = 0;
+    for (auto iter = dict_list.begin(); iter != dict_list.end(); ++iter, ++pattern_id) {
+        std::size_t key_len = iter->first.size();
+        std::size_t value_len = value_arena.length(pattern_id);
+        if (key_len != 0) {
+            std::size_t ratio = (value_len + key_len - 1) / key_len;
+            if (ratio > max_ratio)
+                max_ratio = ratio;
+        }
+    }
+    return max_ratio;
+}
+
 template <typename AcTrieT>
 std::size_t replaceInputChunkText(AcTrieT & acTrie,
                                   const std::vector<std::pair<std::string, int>> & dict_list,
+                                  const ValueArena & value_arena,
                                   const std::string & input_chunk, std::size_t input_chunk_size,
                                   std::string & output_chunk, std::size_t output_offset)
 {
@@ -171,8 +248,6 @@ std::size_t replaceInputChunkText(AcTrieT & acTrie,
 
                 const std::pair<std::string, int> & dict_info = dict_list[pattern_id];
                 const std::string & key = dict_info.first;
-                std::string ansi_key;
-                utf8_to_ansi(key, ansi_key);
 
                 assert(match_end >= (std::uint32_t)key.size());
                 std::uint32_t match_begin = match_end - (std::uint32_t)key.size();
@@ -182,21 +257,7 @@ std::size_t replaceInputChunkText(AcTrieT & acTrie,
                     *output++ = *line_first++;
                 }
 
-#if defined(_MSC_VER)
-                int valueType = dict_info.second;
-                std::size_t valueLength = ValueType::length(valueType);
-                ValueType::writeType(output, valueType);
-                output += valueLength;
-#else
-                int valueType = dict_info.second;
-                uint8_t * value = (uint8_t *)ValueType::toString(valueType);
-                std::size_t valueLength = ValueType::length(valueType);
-
-                uint8_t * value_end = value + valueLength;
-                while (value < value_end) {
-                    *output++ = *value++;
-                }
-#endif
+                output += value_arena.write(output, pattern_id);
                 line_first += key.size();
             }
         }
@@ -217,22 +278,48 @@ std::size_t replaceInputChunkText(AcTrieT & acTrie,
 
 template <typename AcTrieT>
 std::size_t replaceInputChunkTextEx(AcTrieT & acTrie,
-                                    const std::vector<std::pair<std::string, int>> & dict_list,
+                                    const ValueArena & value_arena,
                                     const std::vector<int> & length_list,
-                                    const std::string & input_chunk, std::size_t input_chunk_size,
-                                    std::string & output_chunk, std::size_t output_offset)
+                                    const char * input_first, const char * input_last,
+                                    char * output_first)
 {
-    uint8_t * input_end = (uint8_t *)input_chunk.c_str() + input_chunk_size;
-    uint8_t * output = (uint8_t *)output_chunk.c_str() + output_offset;
+    uint8_t * input_end = (uint8_t *)input_last;
+    uint8_t * output = (uint8_t *)output_first;
     uint8_t * output_start = output;
 
-    std::size_t line_no = 0;
-    uint8_t * line_first = (uint8_t *)input_chunk.c_str();
-    uint8_t * line_last;
-
     typedef typename AcTrieT::MatchInfoEx MatchInfoEx;
 
     std::vector<MatchInfoEx> match_list;
+
+#if USE_CHUNK_MATCHING
+    uint8_t * text_first = (uint8_t *)input_first;
+    uint8_t * text = text_first;
+
+    acTrie.match_chunk(text_first, input_end, match_list, length_list);
+
+    for (auto iter = match_list.begin(); iter != match_list.end(); ++iter) {
+        const MatchInfoEx & matchInfo = *iter;
+        std::uint32_t pattern_id = matchInfo.pattern_id;
+        assert(pattern_id < (std::uint32_t)value_arena.size());
+
+        uint8_t * match_first = text_first + matchInfo.begin;
+        assert(text <= match_first);
+        std::size_t copy_size = std::size_t(match_first - text);
+        std::memcpy(output, text, copy_size);
+        output += copy_size;
+
+        output += value_arena.write(output, pattern_id);
+        text = text_first + matchInfo.end;
+    }
+
+    std::size_t copy_size = std::size_t(input_end - text);
+    std::memcpy(output, text, copy_size);
+    output += copy_size;
+#else // !USE_CHUNK_MATCHING
+    std::size_t line_no = 0;
+    uint8_t * line_first = (uint8_t *)input_first;
+    uint8_t * line_last;
+
 #if 0
     static typename AcTrieT::on_hit_callback onHit_callback =
         std::bind(&getPatternLength, std::placeholders::_1, dict_list);
@@ -261,14 +348,8 @@ std::size_t replaceInputChunkTextEx(AcTrieT & acTrie,
                 std::uint32_t match_begin = matchInfo.begin;
                 std::uint32_t match_end   = matchInfo.end;
                 std::uint32_t pattern_id  = matchInfo.pattern_id;
-                assert(pattern_id < (std::uint32_t)dict_list.size());
-
-                const std::pair<std::string, int> & dict_info = dict_list[pattern_id];
-                const std::string & key = dict_info.first;
-                std::string ansi_key;
-                utf8_to_ansi(key, ansi_key);
-
-                assert(std::uint32_t(match_end - match_begin) == (std::uint32_t)key.size());
+                assert(pattern_id < (std::uint32_t)value_arena.size());
+                assert(std::uint32_t(match_end - match_begin) == (std::uint32_t)length_list[pattern_id]);
 
                 uint8_t * line_mid = line_start + match_begin;
                 assert(line_first <= line_mid);
@@ -276,21 +357,7 @@ std::size_t replaceInputChunkTextEx(AcTrieT & acTrie,
                     *output++ = *line_first++;
                 }
 
-#if defined(_MSC_VER)
-                int valueType = dict_info.second;
-                std::size_t valueLength = ValueType::length(valueType);
-                ValueType::writeType(output, valueType);
-                output += valueLength;
-#else
-                int valueType = dict_info.second;
-                uint8_t * value = (uint8_t *)ValueType::toString(valueType);
-                std::size_t valueLength = ValueType::length(valueType);
-
-                uint8_t * value_end = value + valueLength;
-                while (value < value_end) {
-                    *output++ = *value++;
-                }
-#endif
+                output += value_arena.write(output, pattern_id);
                 line_first += std::size_t(match_end - match_begin);
             }
 
@@ -308,11 +375,94 @@ std::size_t replaceInputChunkTextEx(AcTrieT & acTrie,
         else
             break;
     }
+#endif // USE_CHUNK_MATCHING
 
     assert(output >= output_start);
     return std::size_t(output - output_start);
 }
 
+template <typename AcTrieT>
+std::size_t replaceInputChunkTextEx(AcTrieT & acTrie,
+                                    const ValueArena & value_arena,
+                                    const std::vector<int> & length_list,
+                                    const std::string & input_chunk, std::size_t input_chunk_size,
+                                    std::string & output_chunk, std::size_t output_offset)
+{
+    return replaceInputChunkTextEx<AcTrieT>(acTrie, value_arena, length_list,
+                                            input_chunk.c_str(),
+                                            input_chunk.c_str() + input_chunk_size,
+                                            &output_chunk[output_offset]);
+}
+
+//
+// The same as replaceInputChunkTextEx(), but the output is appended to the writer
+// as spans, the unmatched text is referenced in place and never copied.
+// If a write is failed, it stops and writer.good() is false.
+//
+template <typename AcTrieT>
+std::size_t replaceInputChunkTextIov(AcTrieT & acTrie,
+                                     const ValueArena & value_arena,
+                                     const std::vector<int> & length_list,
+                                     const char * input_first, const char * input_last,
+                                     ScatterWriter & writer)
+{
+    uint8_t * input_end = (uint8_t *)input_last;
+    uint8_t * span_first = (uint8_t *)input_first;
+    std::size_t output_size = 0;
+
+    uint8_t * line_first = (uint8_t *)input_first;
+    uint8_t * line_last;
+
+    typedef typename AcTrieT::MatchInfoEx MatchInfoEx;
+
+    std::vector<MatchInfoEx> match_list;
+
+    while (line_first < input_end) {
+        size_t length = (size_t)(input_end - line_first) * sizeof(uint8_t);
+        line_last = (uint8_t *)std::memchr(line_first, '\n', length);
+        if (line_last == nullptr)
+            line_last = input_end;
+
+        acTrie.match_one(line_first, line_last, match_list, length_list);
+
+        if (unlikely(match_list.size() != 0)) {
+            for (auto iter = match_list.begin(); iter != match_list.end(); ++iter) {
+                const MatchInfoEx & matchInfo = *iter;
+                std::uint32_t match_begin = matchInfo.begin;
+                std::uint32_t match_end   = matchInfo.end;
+                std::uint32_t pattern_id  = matchInfo.pattern_id;
+                assert(pattern_id < (std::uint32_t)value_arena.size());
+
+                uint8_t * match_first = line_first + match_begin;
+                assert(span_first <= match_first);
+                std::size_t span_size = std::size_t(match_first - span_first);
+                if (!writer.append(span_first, span_size))
+                    return output_size;
+
+                const char * value = value_arena.value(pattern_id);
+                std::size_t valueLength = value_arena.length(pattern_id);
+                if (!writer.append(value, valueLength))
+                    return output_size;
+
+                output_size += span_size + valueLength;
+                span_first = match_first + std::size_t(match_end - match_begin);
+            }
+        }
+
+        // Next line, the '\n' stays in the span.
+        if (line_last == input_end)
+            break;
+        line_first = line_last + 1;
+    }
+
+    assert(span_first <= input_end);
+    std::size_t span_size = std::size_t(input_end - span_first);
+    if (!writer.append(span_first, span_size))
+        return output_size;
+    output_size += span_size;
+    return output_size;
+}
+
 inline void writeOutputChunk(std::ofstream & ofs,
                              const std::string & output_chunk,
                              std::size_t writeBlockSize)
@@ -320,35 +470,46 @@ inline void writeOutputChunk(std::ofstream & ofs,
     ofs.write(output_chunk.c_str(), writeBlockSize);
 }
 
+//
+// The tries which have the full DFA mode have AcTrieT::dfa_blow_up().
+//
 template <typename AcTrieT>
-int StringReplace(const std::string & name,
-                  const std::string & dict_file,
-                  const std::string & input_file,
-                  const std::string & in_output_file)
-{
-    std::string dict_kv;
-    std::size_t dict_filesize = read_dict_file(dict_file, dict_kv);
-    if (dict_filesize == 0) {
-        std::cout << "dict_file [ " << dict_file << " ] read failed." << std::endl;
-        return -1;
-    }
+struct has_dfa_mode {
+    template <typename T>
+    static std::true_type test(decltype(&T::dfa_blow_up));
 
-    std::string output_file = splicing_file_name(in_output_file, name);
+    template <typename T>
+    static std::false_type test(...);
 
-    std::vector<std::pair<std::string, int>> dict_list;
-    std::vector<int> length_list;
+    static const bool value = decltype(test<AcTrieT>(nullptr))::value;
+};
 
-    preprocessing_dict_file(dict_kv, dict_list, length_list);
+template <typename AcTrieT>
+void printDfaStats(const AcTrieT & ac_trie, std::false_type)
+{
+    // Do nothing!
+}
 
-    static const std::size_t kPageSize = 4 * 1024;
-    static const std::size_t kReadChunkSize = 64 * 1024;
-    static const std::size_t kWriteBlockSize = 128 * 1024;
+template <typename AcTrieT>
+void printDfaStats(const AcTrieT & ac_trie, std::true_type)
+{
+    if (!ac_trie.use_dfa())
+        return;
+
+    static const double kMegaBytes = 1024.0 * 1024.0;
+    printf("darts_trie dfa table = %0.2f MB, dat = %0.2f MB, blow-up = %0.1f x%s\n",
+           (double)ac_trie.dfa_table_bytes() / kMegaBytes, (double)ac_trie.dat_bytes() / kMegaBytes,
+           ac_trie.dfa_blow_up(), (ac_trie.has_dfa() ? "" : " (too large, use the failure links)"));
+}
 
+template <typename AcTrieT>
+double buildAcTrieFromDict(AcTrieT & ac_trie,
+                           const std::vector<std::pair<std::string, int>> & dict_list)
+{
     test::StopWatch sw;
 
     sw.start();
 
-    AcTrieT ac_trie;
     std::uint32_t index = 0;
     for (auto iter = dict_list.begin(); iter != dict_list.end(); ++iter) {
         const std::string & key = iter->first;
@@ -364,8 +525,137 @@ int StringReplace(const std::string & name,
 
     ac_trie.clear_ac_trie();
     printf("darts_trie.max_state_id() = %u\n", (uint32_t)ac_trie.max_state_id());
+    typedef std::integral_constant<bool, has_dfa_mode<AcTrieT>::value> has_dfa_mode_t;
+    printDfaStats(ac_trie, has_dfa_mode_t());
     printf("darts_trie build elapsed time: %0.2f ms\n\n", elapsedTime);
 
+    return elapsedTime;
+}
+
+//
+// The tries which can be saved and loaded have AcTrieT::file_kind().
+//
+template <typename AcTrieT>
+struct has_trie_file {
+    template <typename T>
+    static std::true_type test(decltype(&T::file_kind));
+
+    template <typename T>
+    static std::false_type test(...);
+
+    static const bool value = decltype(test<AcTrieT>(nullptr))::value;
+};
+
+//
+// Return the empty string if the cache is not enabled.
+//
+static inline
+std::string getTrieCacheDir()
+{
+    const char * cache_dir = ::getenv("TRIE_CACHE_DIR");
+    return ((cache_dir != nullptr && cache_dir[0] != '\0') ? cache_dir : "");
+}
+
+template <typename AcTrieT>
+std::string getTrieCacheFile(const std::string & cache_dir, std::uint64_t cache_key)
+{
+    // "utf8::DAT" -> "utf8_DAT"
+    std::string kind = AcTrieT::file_kind();
+    std::size_t pos;
+    while ((pos = kind.find("::")) != std::string::npos) {
+        kind.replace(pos, 2, "_");
+    }
+
+    char key_text[32];
+    snprintf(key_text, sizeof(key_text), "%016" PRIx64, cache_key);
+    return file_utils::path_join(cache_dir, kind + "-" + key_text + ".trie");
+}
+
+template <typename AcTrieT>
+double buildAcTrieCached(AcTrieT & ac_trie,
+                         const std::vector<std::pair<std::string, int>> & dict_list,
+                         std::false_type)
+{
+    return buildAcTrieFromDict(ac_trie, dict_list);
+}
+
+template <typename AcTrieT>
+double buildAcTrieCached(AcTrieT & ac_trie,
+                         const std::vector<std::pair<std::string, int>> & dict_list,
+                         std::true_type)
+{
+    std::string cache_dir = getTrieCacheDir();
+    if (cache_dir.empty())
+        return buildAcTrieFromDict(ac_trie, dict_list);
+
+    std::uint64_t cache_key = trie_file::hash_mix(trie_file::hash_dict(dict_list),
+                                                  ac_trie.file_options());
+    std::string cache_file = getTrieCacheFile<AcTrieT>(cache_dir, cache_key);
+
+    test::StopWatch sw;
+
+    sw.start();
+    bool loaded = ac_trie.load(cache_file);
+    sw.stop();
+
+    if (loaded && ac_trie.file_dict_hash() == cache_key) {
+        double elapsedTime = sw.getMillisec();
+        printf("darts_trie.max_state_id() = %u\n", (uint32_t)ac_trie.max_state_id());
+        printf("darts_trie load elapsed time: %0.2f ms, cache: %s\n\n",
+               elapsedTime, cache_file.c_str());
+        return elapsedTime;
+    }
+    if (loaded)
+        ac_trie.clear();
+
+    double elapsedTime = buildAcTrieFromDict(ac_trie, dict_list);
+
+    if (!file_utils::make_directory(cache_dir) || !ac_trie.save(cache_file, cache_key)) {
+        printf("darts_trie save failed, cache: %s\n\n", cache_file.c_str());
+    }
+    return elapsedTime;
+}
+
+template <typename AcTrieT>
+double buildAcTrie(AcTrieT & ac_trie,
+                   const std::vector<std::pair<std::string, int>> & dict_list)
+{
+#if USE_TRIE_CACHE
+    typedef std::integral_constant<bool, has_trie_file<AcTrieT>::value> has_trie_file_t;
+    return buildAcTrieCached(ac_trie, dict_list, has_trie_file_t());
+#else
+    return buildAcTrieFromDict(ac_trie, dict_list);
+#endif
+}
+
+template <typename AcTrieT>
+int StringReplace(const std::string & name,
+                  const std::string & dict_file,
+                  const std::string & input_file,
+                  const std::string & in_output_file)
+{
+    std::string dict_kv;
+    std::size_t dict_filesize = read_dict_file(dict_file, dict_kv);
+    if (dict_filesize == 0) {
+        std::cout << "dict_file [ " << dict_file << " ] read failed." << std::endl;
+        return -1;
+    }
+
+    std::string output_file = splicing_file_name(in_output_file, name);
+
+    std::vector<std::pair<std::string, int>> dict_list;
+    std::vector<int> length_list;
+    ValueArena value_arena;
+
+    preprocessing_dict_file(dict_kv, dict_list, length_list, value_arena);
+
+    static const std::size_t kPageSize = 4 * 1024;
+    static const std::size_t kReadChunkSize = 64 * 1024;
+    static const std::size_t kWriteBlockSize = 128 * 1024;
+
+    AcTrieT ac_trie;
+    buildAcTrie(ac_trie, dict_list);
+
 #if USE_READ_WRITE_STATISTICS
     std::size_t globalReadBytes = 0;
     std::size_t globalReadCount = 0;
@@ -392,11 +682,13 @@ int StringReplace(const std::string & name,
         }
         ofs.seekp(0, std::ios::beg);
 
+        std::size_t expand_ratio = getMaxExpandRatio(dict_list, value_arena);
+
         std::string input_chunk;
         std::string output_chunk;
 
         input_chunk.resize(kReadChunkSize + kPageSize);
-        output_chunk.resize(kWriteBlockSize + kReadChunkSize * 2 + kPageSize);
+        output_chunk.resize(kWriteBlockSize + kReadChunkSize * expand_ratio + kPageSize);
 
         std::size_t input_offset = 0;
         std::size_t writeBufSize = 0;
@@ -427,7 +719,7 @@ int StringReplace(const std::string & name,
                 //input_chunk[input_chunk_last] = '\0';
                 std::size_t output_offset = writeBufSize;
                 std::size_t outputBytes = replaceInputChunkText<AcTrieT>(
-                                                ac_trie, dict_list,
+                                                ac_trie, dict_list, value_arena,
                                                 input_chunk, input_chunk_last,
                                                 output_chunk, output_offset);
                 //input_chunk[input_chunk_last] = saveChar;
@@ -459,7 +751,7 @@ int StringReplace(const std::string & name,
                     input_chunk[input_chunk_last] = '\0';
                     std::size_t output_offset = writeBufSize;
                     std::size_t outputBytes = replaceInputChunkText<AcTrieT>(
-                                                    ac_trie, dict_list,
+                                                    ac_trie, dict_list, value_arena,
                                                     input_chunk, input_chunk_last,
                                                     output_chunk, output_offset);
                     input_chunk[input_chunk_last] = saveChar;
@@ -511,34 +803,16 @@ int StringReplaceEx(const std::string & name,
 
     std::vector<std::pair<std::string, int>> dict_list;
     std::vector<int> length_list;
+    ValueArena value_arena;
 
-    preprocessing_dict_file(dict_kv, dict_list, length_list);
+    preprocessing_dict_file(dict_kv, dict_list, length_list, value_arena);
 
     static const std::size_t kPageSize = 4 * 1024;
     static const std::size_t kReadChunkSize = 64 * 1024;
     static const std::size_t kWriteBlockSize = 128 * 1024;
 
-    test::StopWatch sw;
-
-    sw.start();
-
     AcTrieT ac_trie;
-    std::uint32_t index = 0;
-    for (auto iter = dict_list.begin(); iter != dict_list.end(); ++iter) {
-        const std::string & key = iter->first;
-        ac_trie.insert(key, index);
-        index++;
-    }
-
-    ac_trie.build();
-
-    sw.stop();
-
-    double elapsedTime = sw.getMillisec();
-
-    ac_trie.clear_ac_trie();
-    printf("darts_trie.max_state_id() = %u\n", (uint32_t)ac_trie.max_state_id());
-    printf("darts_trie build elapsed time: %0.2f ms\n\n", elapsedTime);
+    buildAcTrie(ac_trie, dict_list);
 
 #if USE_READ_WRITE_STATISTICS
     std::size_t globalReadBytes = 0;
@@ -566,11 +840,13 @@ int StringReplaceEx(const std::string & name,
         }
         ofs.seekp(0, std::ios::beg);
 
+        std::size_t expand_ratio = getMaxExpandRatio(dict_list, value_arena);
+
         std::string input_chunk;
         std::string output_chunk;
 
         input_chunk.resize(kReadChunkSize + kPageSize);
-        output_chunk.resize(kWriteBlockSize + kReadChunkSize * 2 + kPageSize);
+        output_chunk.resize(kWriteBlockSize + kReadChunkSize * expand_ratio + kPageSize);
 
         std::size_t input_offset = 0;
         std::size_t writeBufSize = 0;
@@ -601,7 +877,7 @@ int StringReplaceEx(const std::string & name,
                 //input_chunk[input_chunk_last] = '\0';
                 std::size_t output_offset = writeBufSize;
                 std::size_t outputBytes = replaceInputChunkTextEx<AcTrieT>(
-                                                ac_trie, dict_list, length_list,
+                                                ac_trie, value_arena, length_list,
                                                 input_chunk, input_chunk_last,
                                                 output_chunk, output_offset);
                 //input_chunk[input_chunk_last] = saveChar;
@@ -633,7 +909,7 @@ int StringReplaceEx(const std::string & name,
                     input_chunk[input_chunk_last] = '\0';
                     std::size_t output_offset = writeBufSize;
                     std::size_t outputBytes = replaceInputChunkTextEx<AcTrieT>(
-                                                    ac_trie, dict_list, length_list,
+                                                    ac_trie, value_arena, length_list,
                                                     input_chunk, input_chunk_last,
                                                     output_chunk, output_offset);
                     input_chunk[input_chunk_last] = saveChar;
@@ -668,8 +944,1854 @@ int StringReplaceEx(const std::string & name,
     return -1;
 }
 
+//
+// Find the end of the next input chunk in place, the chunk is ended with
+// a '\n' if possible, or it's a very long line without newline.
+//
+static inline
+const char * findInputChunkLast(const char * input_first, const char * input_end,
+                                std::size_t chunk_size)
+{
+    if ((std::size_t)(input_end - input_first) <= chunk_size)
+        return input_end;
+
+    const char * chunk_last = input_first + chunk_size;
+#if defined(_MSC_VER)
+    const char * last_newline = StrUtils::rfind(input_first, chunk_last, '\n');
+#else
+    const char * last_newline = (const char *)memrchr(input_first, '\n', chunk_size);
+#endif
+    if (last_newline == nullptr) {
+        // A line longer than the chunk size, walk to the end of this line.
+        last_newline = (const char *)std::memchr(chunk_last, '\n',
+                                                 (std::size_t)(input_end - chunk_last));
+        if (last_newline == nullptr)
+            return input_end;
+    }
+    return (last_newline + 1);
+}
+
+//
+// Replace one mapped input file with a built trie, output_chunk is reusable
+// between the calls.
+//
+template <typename AcTrieT>
+int replaceFileMmap(AcTrieT & ac_trie,
+                    const ValueArena & value_arena,
+                    const std::vector<int> & length_list,
+                    std::size_t expand_ratio,
+                    const std::string & input_file,
+                    const std::string & output_file,
+                    std::string & output_chunk)
+{
+    static const std::size_t kPageSize = 4 * 1024;
+    static const std::size_t kReadChunkSize = 64 * 1024;
+    static const std::size_t kWriteBlockSize = 128 * 1024;
+    static const std::size_t kReleaseSize = 16 * 1024 * 1024;
+
+    // Opening the output truncates it, if it's the mapped input, the reads get SIGBUS.
+    if (file_utils::is_same_file(input_file, output_file)) {
+        std::cout << "output_file [ " << output_file << " ] is the input file." << std::endl;
+        return -1;
+    }
+
+    MmapFile input_map;
+    if (!input_map.open(input_file, MmapFile::Sequential)) {
+        std::cout << "input_file [ " << input_file << " ] mmap failed." << std::endl;
+        return -1;
+    }
+
+    std::ofstream ofs;
+    ofs.open(output_file, std::ios::out | std::ios::binary);
+    if (!ofs.good()) {
+        return -1;
+    }
+
+    std::size_t chunk_size = kWriteBlockSize + kReadChunkSize * expand_ratio + kPageSize;
+    if (output_chunk.size() < chunk_size)
+        output_chunk.resize(chunk_size);
+
+    const char * input_start = input_map.data();
+    const char * input_end = input_start + input_map.size();
+    const char * input = input_start;
+    const char * release_pos = input_start + kReleaseSize;
+    std::size_t writeBufSize = 0;
+
+    while (input < input_end) {
+        const char * input_chunk_last = findInputChunkLast(input, input_end, kReadChunkSize);
+        std::size_t input_chunk_size = (std::size_t)(input_chunk_last - input);
+
+        // A very long line may need more output space than a normal chunk.
+        std::size_t need_size = writeBufSize + input_chunk_size * expand_ratio + kPageSize;
+        if (unlikely(need_size > output_chunk.size())) {
+            if (writeBufSize > 0) {
+                writeOutputChunk(ofs, output_chunk, writeBufSize);
+                writeBufSize = 0;
+            }
+            need_size = input_chunk_size * expand_ratio + kPageSize;
+            if (need_size > output_chunk.size())
+                output_chunk.resize(need_size);
+        }
+
+        std::size_t outputBytes = replaceInputChunkTextEx<AcTrieT>(
+                                        ac_trie, value_arena, length_list,
+                                        input, input_chunk_last,
+                                        &output_chunk[writeBufSize]);
+        writeBufSize += outputBytes;
+        if (writeBufSize >= kWriteBlockSize) {
+            writeOutputChunk(ofs, output_chunk, writeBufSize);
+            writeBufSize = 0;
+        }
+
+        input = input_chunk_last;
+        if (input >= release_pos) {
+            input_map.release((std::size_t)(input - input_start));
+            release_pos = input + kReleaseSize;
+        }
+    }
+
+    if (writeBufSize > 0) {
+        writeOutputChunk(ofs, output_chunk, writeBufSize);
+    }
+
+    ofs.close();
+    input_map.close();
+    return 0;
+}
+
+template <typename AcTrieT>
+int StringReplaceMmap(const std::string & name,
+                      const std::string & dict_file,
+                      const std::string & input_file,
+                      const std::string & in_output_file)
+{
+    std::string dict_kv;
+    std::size_t dict_filesize = read_dict_file(dict_file, dict_kv);
+    if (dict_filesize == 0) {
+        std::cout << "dict_file [ " << dict_file << " ] read failed." << std::endl;
+        return -1;
+    }
+
+    std::string output_file = splicing_file_name(in_output_file, name);
+
+    std::vector<std::pair<std::string, int>> dict_list;
+    std::vector<int> length_list;
+    ValueArena value_arena;
+
+    preprocessing_dict_file(dict_kv, dict_list, length_list, value_arena);
+
+    AcTrieT ac_trie;
+    buildAcTrie(ac_trie, dict_list);
+
+    std::size_t expand_ratio = getMaxExpandRatio(dict_list, value_arena);
+
+    std::string output_chunk;
+    return replaceFileMmap<AcTrieT>(ac_trie, value_arena, length_list, expand_ratio,
+                                    input_file, output_file, output_chunk);
+}
+
+//
+// Scatter-gather output: the output of every chunk is a list of spans of the mapped
+// input and of the replacement values, which are flushed by writev().
+//
+template <typename AcTrieT>
+int StringReplaceScatter(const std::string & name,
+                         const std::string & dict_file,
+                         const std::string & input_file,
+                         const std::string & in_output_file)
+{
+    std::string dict_kv;
+    std::size_t dict_filesize = read_dict_file(dict_file, dict_kv);
+    if (dict_filesize == 0) {
+        std::cout << "dict_file [ " << dict_file << " ] read failed." << std::endl;
+        return -1;
+    }
+
+    std::string output_file = splicing_file_name(in_output_file, name);
+
+    std::vector<std::pair<std::string, int>> dict_list;
+    std::vector<int> length_list;
+    ValueArena value_arena;
+
+    preprocessing_dict_file(dict_kv, dict_list, length_list, value_arena);
+
+    static const std::size_t kReadChunkSize = 1024 * 1024;
+    static const std::size_t kReleaseSize = 16 * 1024 * 1024;
+
+    AcTrieT ac_trie;
+    buildAcTrie(ac_trie, dict_list);
+
+    MmapFile input_map;
+    if (!input_map.open(input_file, MmapFile::Sequential)) {
+        std::cout << "input_file [ " << input_file << " ] mmap failed." << std::endl;
+        return -1;
+    }
+
+    ScatterWriter writer;
+    if (!writer.open(output_file)) {
+        return -1;
+    }
+
+    const char * input_start = input_map.data();
+    const char * input_end = input_start + input_map.size();
+    const char * input = input_start;
+    const char * release_pos = input_start + kReleaseSize;
+
+    while (input < input_end) {
+        const char * input_chunk_last = findInputChunkLast(input, input_end, kReadChunkSize);
+
+        replaceInputChunkTextIov<AcTrieT>(ac_trie, value_arena, length_list,
+                                          input, input_chunk_last, writer);
+        if (!writer.good())
+            break;
+
+        input = input_chunk_last;
+        if (input >= release_pos) {
+            // The pending spans still point to the mapped pages.
+            if (!writer.flush())
+                break;
+            input_map.release((std::size_t)(input - input_start));
+            release_pos = input + kReleaseSize;
+        }
+    }
+
+    writer.flush();
+
+    printf("darts_bench::StringReplaceScatter(): output = %" PRIu64 " bytes, "
+           "spans = %" PRIu64 ", writev() calls = %" PRIu64 "\n\n",
+           writer.total_size(), writer.span_count(), writer.flush_count());
+
+    bool succeeded = writer.close();
+    input_map.close();
+    if (!succeeded) {
+        std::cout << "output_file [ " << output_file << " ] write failed." << std::endl;
+        return -1;
+    }
+    return 0;
+}
+
+//
+// Split the input at newline boundaries, every block is replaced by one of the
+// worker threads sharing the same built trie, and the writer puts the output
+// blocks back in input order through a reorder buffer.
+//
+template <typename AcTrieT>
+int StringReplaceParallel(const std::string & name,
+                          const std::string & dict_file,
+                          const std::string & input_file,
+                          const std::string & in_output_file,
+                          std::size_t thread_num = 0)
+{
+    std::string dict_kv;
+    std::size_t dict_filesize = read_dict_file(dict_file, dict_kv);
+    if (dict_filesize == 0) {
+        std::cout << "dict_file [ " << dict_file << " ] read failed." << std::endl;
+        return -1;
+    }
+
+    std::string output_file = splicing_file_name(in_output_file, name);
+
+    std::vector<std::pair<std::string, int>> dict_list;
+    std::vector<int> length_list;
+    ValueArena value_arena;
+
+    preprocessing_dict_file(dict_kv, dict_list, length_list, value_arena);
+
+    static const std::size_t kPageSize = 4 * 1024;
+    static const std::size_t kBlockSize = 1024 * 1024;
+
+    AcTrieT ac_trie;
+    buildAcTrie(ac_trie, dict_list);
+
+    MmapFile input_map;
+    if (!input_map.open(input_file, MmapFile::Sequential)) {
+        std::cout << "input_file [ " << input_file << " ] mmap failed." << std::endl;
+        return -1;
+    }
+
+    std::ofstream ofs;
+    ofs.open(output_file, std::ios::out | std::ios::binary);
+    if (!ofs.good()) {
+        return -1;
+    }
+
+    if (thread_num == 0) {
+        thread_num = (std::size_t)std::thread::hardware_concurrency();
+        if (thread_num == 0)
+            thread_num = 1;
+    }
+
+    // Split the whole input into blocks, every block is ended with a '\n'.
+    const char * input_start = input_map.data();
+    const char * input_end = input_start + input_map.size();
+    std::vector<const char *> block_list;
+    block_list.push_back(input_start);
+    const char * input = input_start;
+    while (input < input_end) {
+        input = findInputChunkLast(input, input_end, kBlockSize);
+        block_list.push_back(input);
+    }
+
+    std::size_t block_count = block_list.size() - 1;
+    if (thread_num > block_count)
+        thread_num = (block_count > 0) ? block_count : 1;
+
+    printf("darts_bench::StringReplaceParallel(): threads = %u, blocks = %u\n\n",
+           (uint32_t)thread_num, (uint32_t)block_count);
+
+    struct OutputSlot {
+        std::string output;
+        std::size_t size;
+        std::size_t block_id;
+        bool        ready;
+
+        OutputSlot() : size(0), block_id(std::size_t(-1)), ready(false) {}
+    };
+
+    std::size_t expand_ratio = getMaxExpandRatio(dict_list, value_arena);
+    std::size_t window_size = thread_num * 2;
+    std::vector<OutputSlot> reorder_buf(window_size);
+
+    std::mutex slot_mutex;
+    std::condition_variable slot_ready;
+    std::condition_variable slot_free;
+    std::atomic<std::size_t> next_block(0);
+    std::size_t write_block = 0;
+
+    auto worker = [&]() {
+        do {
+            std::size_t block_id = next_block.fetch_add(1);
+            if (block_id >= block_count)
+                break;
+
+            OutputSlot & slot = reorder_buf[block_id % window_size];
+            {
+                // Wait until the writer has consumed the block (block_id - window_size).
+                std::unique_lock<std::mutex> lock(slot_mutex);
+                slot_free.wait(lock, [&]() {
+                    return (block_id < write_block + window_size);
+                });
+            }
+
+            const char * block_first = block_list[block_id];
+            const char * block_last = block_list[block_id + 1];
+            std::size_t block_size = (std::size_t)(block_last - block_first);
+            std::size_t need_size = block_size * expand_ratio + kPageSize;
+            if (slot.output.size() < need_size)
+                slot.output.resize(need_size);
+
+            std::size_t outputBytes = replaceInputChunkTextEx<AcTrieT>(
+                                            ac_trie, value_arena, length_list,
+                                            block_first, block_last,
+                                            &slot.output[0]);
+            {
+                std::unique_lock<std::mutex> lock(slot_mutex);
+                slot.size = outputBytes;
+                slot.block_id = block_id;
+                slot.ready = true;
+            }
+            slot_ready.notify_all();
+        } while (1);
+    };
+
+    std::vector<std::thread> workers;
+    workers.reserve(thread_num);
+    for (std::size_t i = 0; i < thread_num; i++) {
+        workers.emplace_back(worker);
+    }
+
+    // The current thread is the writer.
+    while (write_block < block_count) {
+        OutputSlot & slot = reorder_buf[write_block % window_size];
+        {
+            std::unique_lock<std::mutex> lock(slot_mutex);
+            slot_ready.wait(lock, [&]() {
+                return (slot.ready && slot.block_id == write_block);
+            });
+        }
+
+        writeOutputChunk(ofs, slot.output, slot.size);
+
+        {
+            std::unique_lock<std::mutex> lock(slot_mutex);
+            slot.ready = false;
+            write_block++;
+        }
+        slot_free.notify_all();
+    }
+
+    for (auto iter = workers.begin(); iter != workers.end(); ++iter) {
+        iter->join();
+    }
+
+    ofs.close();
+    input_map.close();
+    return 0;
+}
+
+//
+// Three-stage pipeline: one reader thread, N match threads and one writer thread.
+// The stages talk through bounded lock-free ring queues, all buffers are
+// allocated up front and recycled, so I/O and matching are overlapped.
+//
+template <typename AcTrieT>
+int StringReplacePipeline(const std::string & name,
+                          const std::string & dict_file,
+                          const std::string & input_file,
+                          const std::string & in_output_file,
+                          std::size_t match_thread_num = 0)
+{
+    std::string dict_kv;
+    std::size_t dict_filesize = read_dict_file(dict_file, dict_kv);
+    if (dict_filesize == 0) {
+        std::cout << "dict_file [ " << dict_file << " ] read failed." << std::endl;
+        return -1;
+    }
+
+    std::string output_file = splicing_file_name(in_output_file, name);
+
+    std::vector<std::pair<std::string, int>> dict_list;
+    std::vector<int> length_list;
+    ValueArena value_arena;
+
+    preprocessing_dict_file(dict_kv, dict_list, length_list, value_arena);
+
+    static const std::size_t kPageSize = 4 * 1024;
+    static const std::size_t kReadChunkSize = 256 * 1024;
+    static const std::size_t kMaxTailingSize = 64 * 1024;
+
+    AcTrieT ac_trie;
+    buildAcTrie(ac_trie, dict_list);
+
+    std::ifstream ifs;
+    ifs.open(input_file, std::ios::in | std::ios::binary);
+    if (!ifs.good()) {
+        return -1;
+    }
+
+    std::ofstream ofs;
+    ofs.open(output_file, std::ios::out | std::ios::binary);
+    if (!ofs.good()) {
+        ifs.close();
+        return -1;
+    }
+
+    if (match_thread_num == 0) {
+        std::size_t cpu_num = (std::size_t)std::thread::hardware_concurrency();
+        match_thread_num = (cpu_num > 2) ? (cpu_num - 2) : 1;
+    }
+
+    struct PipeBuffer {
+        std::string input;
+        std::string output;
+        std::size_t input_size;
+        std::size_t output_size;
+        std::size_t seq;
+    };
+
+    std::size_t expand_ratio = getMaxExpandRatio(dict_list, value_arena);
+    std::size_t buffer_num = match_thread_num * 2 + 4;
+    std::vector<PipeBuffer> buffers(buffer_num);
+    for (auto iter = buffers.begin(); iter != buffers.end(); ++iter) {
+        iter->input.resize(kReadChunkSize + kMaxTailingSize + kPageSize);
+        iter->output.resize((kReadChunkSize + kMaxTailingSize) * expand_ratio + kPageSize);
+        iter->input_size = 0;
+        iter->output_size = 0;
+        iter->seq = 0;
+    }
+
+    printf("darts_bench::StringReplacePipeline(): match threads = %u, buffers = %u\n\n",
+           (uint32_t)match_thread_num, (uint32_t)buffer_num);
+
+    // free:   writer --> reader
+    // input:  reader --> matchers
+    // output: matchers --> writer
+    SpscRingQueue<PipeBuffer *> free_queue(buffer_num);
+    MpmcRingQueue<PipeBuffer *> input_queue(buffer_num + match_thread_num);
+    MpmcRingQueue<PipeBuffer *> output_queue(buffer_num + match_thread_num);
+
+    for (auto iter = buffers.begin(); iter != buffers.end(); ++iter) {
+        free_queue.push(&(*iter));
+    }
+
+    auto reader = [&]() {
+        std::string tailing;
+        tailing.resize(kMaxTailingSize);
+        std::size_t tailing_size = 0;
+        std::size_t seq = 0;
+
+        do {
+            PipeBuffer * buffer;
+            free_queue.pop_wait(buffer);
+
+            if (tailing_size > 0) {
+                std::copy_n(&tailing[0], tailing_size, &buffer->input[0]);
+            }
+            std::size_t totalReadBytes = readInputChunk(ifs, buffer->input, tailing_size,
+                                                        kReadChunkSize);
+            std::size_t actualInputChunkBytes = tailing_size + totalReadBytes;
+            if (actualInputChunkBytes == 0) {
+                // The writer is the only producer of free_queue, the buffer is not used any more.
+                break;
+            }
+
+            std::size_t input_chunk_last = actualInputChunkBytes;
+            if (totalReadBytes > 0) {
+                const char * input_first = buffer->input.c_str();
+                const char * last_newline = StrUtils::rfind(input_first,
+                                                            input_first + actualInputChunkBytes,
+                                                            '\n');
+                if (last_newline != nullptr) {
+                    std::size_t last_pos = (std::size_t)(last_newline - input_first + 1);
+                    if ((actualInputChunkBytes - last_pos) <= kMaxTailingSize)
+                        input_chunk_last = last_pos;
+                }
+            }
+
+            tailing_size = actualInputChunkBytes - input_chunk_last;
+            if (tailing_size > 0) {
+                std::copy_n(&buffer->input[input_chunk_last], tailing_size, &tailing[0]);
+            }
+
+            buffer->input_size = input_chunk_last;
+            buffer->seq = seq++;
+            input_queue.push_wait(buffer);
+        } while (1);
+
+        // Tell all the match threads to exit.
+        for (std::size_t i = 0; i < match_thread_num; i++) {
+            input_queue.push_wait(nullptr);
+        }
+    };
+
+    auto matcher = [&]() {
+        do {
+            PipeBuffer * buffer;
+            input_queue.pop_wait(buffer);
+            if (buffer == nullptr) {
+                output_queue.push_wait(nullptr);
+                break;
+            }
+
+            const char * input_first = buffer->input.c_str();
+            buffer->output_size = replaceInputChunkTextEx<AcTrieT>(
+                                        ac_trie, value_arena, length_list,
+                                        input_first, input_first + buffer->input_size,
+                                        &buffer->output[0]);
+            output_queue.push_wait(buffer);
+        } while (1);
+    };
+
+    auto writer = [&]() {
+        // The reorder window, there are never more than buffer_num buffers in flight.
+        std::vector<PipeBuffer *> pending(buffer_num, nullptr);
+        std::size_t next_seq = 0;
+        std::size_t exit_count = 0;
+
+        do {
+            PipeBuffer * buffer;
+            output_queue.pop_wait(buffer);
+            if (buffer == nullptr) {
+                exit_count++;
+                if (exit_count >= match_thread_num)
+                    break;
+                else
+                    continue;
+            }
+
+            pending[buffer->seq % buffer_num] = buffer;
+            do {
+                PipeBuffer * next = pending[next_seq % buffer_num];
+                if (next == nullptr || next->seq != next_seq)
+                    break;
+                writeOutputChunk(ofs, next->output, next->output_size);
+                pending[next_seq % buffer_num] = nullptr;
+                next_seq++;
+                free_queue.push_wait(next);
+            } while (1);
+        } while (1);
+    };
+
+    std::vector<std::thread> threads;
+    threads.reserve(match_thread_num + 2);
+    threads.emplace_back(reader);
+    for (std::size_t i = 0; i < match_thread_num; i++) {
+        threads.emplace_back(matcher);
+    }
+    threads.emplace_back(writer);
+
+    for (auto iter = threads.begin(); iter != threads.end(); ++iter) {
+        iter->join();
+    }
+
+    ofs.close();
+    ifs.close();
+    return 0;
+}
+
+//
+// Batch mode: the trie is built once, and the input files (a directory or a file
+// list) are spread over a pool of worker threads, every worker takes the next file
+// until all the files are done. The output files have the same names in output_dir.
+//
+template <typename AcTrieT>
+int StringReplaceBatch(const std::string & dict_file,
+                       const std::string & input_list,
+                       const std::string & output_dir,
+                       std::size_t thread_num = 0)
+{
+    std::string dict_kv;
+    std::size_t dict_filesize = read_dict_file(dict_file, dict_kv);
+    if (dict_filesize == 0) {
+        std::cout << "dict_file [ " << dict_file << " ] read failed." << std::endl;
+        return -1;
+    }
+
+    std::vector<std::string> input_files;
+    file_utils::get_input_files(input_list, input_files);
+    if (input_files.empty()) {
+        std::cout << "input [ " << input_list << " ] has no files." << std::endl;
+        return -1;
+    }
+
+    if (!file_utils::make_directory(output_dir)) {
+        std::cout << "output_dir [ " << output_dir << " ] create failed." << std::endl;
+        return -1;
+    }
+
+    // An output file must not be any input file (it's truncated while it's mapped),
+    // and two inputs must not have the same output file (two workers write it).
+    std::vector<std::string> output_files;
+    output_files.reserve(input_files.size());
+    {
+        std::set<file_utils::FileId> input_ids;
+        for (auto iter = input_files.begin(); iter != input_files.end(); ++iter) {
+            file_utils::FileId file_id;
+            if (file_utils::get_file_id(*iter, file_id))
+                input_ids.insert(file_id);
+        }
+
+        std::set<std::string> output_names;
+        for (auto iter = input_files.begin(); iter != input_files.end(); ++iter) {
+            std::string output_name = file_utils::base_name(*iter);
+            if (!output_names.insert(output_name).second) {
+                std::cout << "input [ " << *iter << " ]: the output name [ " << output_name
+                          << " ] is used by another input file." << std::endl;
+                return -1;
+            }
+            std::string output_file = file_utils::path_join(output_dir, output_name);
+            file_utils::FileId file_id;
+            if (file_utils::get_file_id(output_file, file_id) && input_ids.count(file_id) != 0) {
+                std::cout << "output_file [ " << output_file << " ] is an input file." << std::endl;
+                return -1;
+            }
+            output_files.push_back(output_file);
+        }
+    }
+
+    std::vector<std::pair<std::string, int>> dict_list;
+    std::vector<int> length_list;
+    ValueArena value_arena;
+
+    preprocessing_dict_file(dict_kv, dict_list, length_list, value_arena);
+
+    AcTrieT ac_trie;
+    double buildTime = buildAcTrie(ac_trie, dict_list);
+
+    std::size_t expand_ratio = getMaxExpandRatio(dict_list, value_arena);
+
+    if (thread_num == 0) {
+        thread_num = (std::size_t)std::thread::hardware_concurrency();
+        if (thread_num == 0)
+            thread_num = 1;
+    }
+    if (thread_num > input_files.size())
+        thread_num = input_files.size();
+
+    printf("darts_bench::StringReplaceBatch(): files = %u, threads = %u\n\n",
+           (uint32_t)input_files.size(), (uint32_t)thread_num);
+
+    struct FileResult {
+        std::size_t input_size;
+        double      elapsed;
+        int         status;
+    };
+
+    std::vector<FileResult> results(input_files.size());
+    std::atomic<std::size_t> next_file(0);
+
+    auto worker = [&]() {
+        std::string output_chunk;
+        test::StopWatch sw;
+        do {
+            std::size_t file_id = next_file.fetch_add(1);
+            if (file_id >= input_files.size())
+                break;
+
+            const std::string & input_file = input_files[file_id];
+            const std::string & output_file = output_files[file_id];
+            FileResult & result = results[file_id];
+            result.input_size = get_file_size(input_file);
+
+            sw.start();
+            result.status = replaceFileMmap<AcTrieT>(ac_trie, value_arena, length_list, expand_ratio,
+                                                     input_file, output_file, output_chunk);
+            sw.stop();
+            result.elapsed = sw.getMillisec();
+        } while (1);
+    };
+
+    test::StopWatch total_sw;
+    total_sw.start();
+
+    std::vector<std::thread> workers;
+    workers.reserve(thread_num);
+    for (std::size_t i = 0; i < thread_num; i++) {
+        workers.emplace_back(worker);
+    }
+    for (auto iter = workers.begin(); iter != workers.end(); ++iter) {
+        iter->join();
+    }
+
+    total_sw.stop();
+    double totalTime = total_sw.getMillisec();
+
+    static const double kMegaBytes = 1024.0 * 1024.0;
+
+    std::uint64_t total_size = 0;
+    std::size_t failed_count = 0;
+    for (std::size_t i = 0; i < input_files.size(); i++) {
+        const FileResult & result = results[i];
+        double size_mb = (double)result.input_size / kMegaBytes;
+        if (result.status == 0) {
+            double throughput = (result.elapsed > 0.0) ? (size_mb * 1000.0 / result.elapsed) : 0.0;
+            printf("  [%4u] %s: %0.2f MB, %0.2f ms, %0.2f MB/s\n", (uint32_t)(i + 1),
+                   input_files[i].c_str(), size_mb, result.elapsed, throughput);
+            total_size += result.input_size;
+        } else {
+            printf("  [%4u] %s: failed\n", (uint32_t)(i + 1), input_files[i].c_str());
+            failed_count++;
+        }
+    }
+    printf("\n");
+
+    double total_mb = (double)total_size / kMegaBytes;
+    printf("files = %u, failed = %u, total input = %0.2f MB\n",
+           (uint32_t)input_files.size(), (uint32_t)failed_count, total_mb);
+    printf("build time: %0.2f ms, replace time: %0.2f ms, throughput: %0.2f MB/s "
+           "(with build: %0.2f MB/s)\n\n",
+           buildTime, totalTime, (totalTime > 0.0) ? (total_mb * 1000.0 / totalTime) : 0.0,
+           total_mb * 1000.0 / (totalTime + buildTime));
+
+    return ((failed_count == 0) ? 0 : -1);
+}
+
+//
+// Single thread replacement on io_uring: several reads and writes are kept in flight
+// on registered buffers, so the matcher seldom waits for the disk. The line across
+// two read blocks is stitched in a small bridge buffer. If io_uring or its read
+// and write opcodes are unavailable, it falls back to the blocking StringReplaceEx().
+// On an error, the requests in flight are waited for before the buffers are freed.
+//
+template <typename AcTrieT>
+int StringReplaceUring(const std::string & name,
+                       const std::string & dict_file,
+                       const std::string & input_file,
+                       const std::string & in_output_file)
+{
+#if USE_IO_URING
+    if (!IoUring::is_supported()) {
+        printf("darts_bench::StringReplaceUring(): io_uring is not supported, "
+               "fallback to the blocking I/O.\n\n");
+        return StringReplaceEx<AcTrieT>(name, dict_file, input_file, in_output_file);
+    }
+
+    std::string dict_kv;
+    std::size_t dict_filesize = read_dict_file(dict_file, dict_kv);
+    if (dict_filesize == 0) {
+        std::cout << "dict_file [ " << dict_file << " ] read failed." << std::endl;
+        return -1;
+    }
+
+    std::string output_file = splicing_file_name(in_output_file, name);
+
+    std::vector<std::pair<std::string, int>> dict_list;
+    std::vector<int> length_list;
+    ValueArena value_arena;
+
+    preprocessing_dict_file(dict_kv, dict_list, length_list, value_arena);
+
+    static const std::size_t kPageSize = 4 * 1024;
+    static const std::size_t kReadChunkSize = 256 * 1024;
+    static const std::size_t kMaxTailingSize = 64 * 1024;
+    static const std::size_t kReadDepth = 4;
+    static const std::size_t kWriteDepth = 4;
+
+    static const std::uint64_t kReadRequest = 0;
+    static const std::uint64_t kWriteRequest = 1;
+
+    int in_fd = ::open(input_file.c_str(), O_RDONLY);
+    if (in_fd < 0) {
+        std::cout << "input_file [ " << input_file << " ] open failed." << std::endl;
+        return -1;
+    }
+
+    struct stat st;
+    if (::fstat(in_fd, &st) != 0) {
+        ::close(in_fd);
+        return -1;
+    }
+    std::uint64_t input_size = (std::uint64_t)st.st_size;
+  #if defined(POSIX_FADV_SEQUENTIAL)
+    ::posix_fadvise(in_fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+  #endif
+
+    int out_fd = ::open(output_file.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (out_fd < 0) {
+        ::close(in_fd);
+        return -1;
+    }
+
+    IoUring ring;
+    if (!ring.init((unsigned)(kReadDepth + kWriteDepth))) {
+        ::close(out_fd);
+        ::close(in_fd);
+        return -1;
+    }
+
+    struct ReadSlot {
+        std::string     buffer;
+        std::uint64_t   offset;
+        std::size_t     length;
+        std::size_t     bytes;
+        bool            done;
+    };
+
+    struct WriteSlot {
+        std::string     buffer;
+        std::uint64_t   offset;
+        std::size_t     length;
+        std::size_t     bytes;
+        bool            busy;
+    };
+
+    std::size_t expand_ratio = getMaxExpandRatio(dict_list, value_arena);
+
+    std::vector<ReadSlot> read_slots(kReadDepth);
+    std::vector<WriteSlot> write_slots(kWriteDepth);
+    std::vector<struct iovec> iovecs;
+    iovecs.reserve(kReadDepth + kWriteDepth);
+    for (auto iter = read_slots.begin(); iter != read_slots.end(); ++iter) {
+        iter->buffer.resize(kReadChunkSize + kPageSize);
+        iter->offset = 0;
+        iter->length = 0;
+        iter->bytes = 0;
+        iter->done = false;
+        struct iovec iov = { (void *)&iter->buffer[0], iter->buffer.size() };
+        iovecs.push_back(iov);
+    }
+    for (auto iter = write_slots.begin(); iter != write_slots.end(); ++iter) {
+        iter->buffer.resize((kReadChunkSize + kMaxTailingSize) * expand_ratio + kPageSize);
+        iter->offset = 0;
+        iter->length = 0;
+        iter->bytes = 0;
+        iter->busy = false;
+        struct iovec iov = { (void *)&iter->buffer[0], iter->buffer.size() };
+        iovecs.push_back(iov);
+    }
+
+    // It may fail on RLIMIT_MEMLOCK, then use the normal (not fixed) read and write,
+    // but they are not supported before Linux 5.6.
+    bool fixed_buffers = ring.register_buffers(&iovecs[0], (unsigned)iovecs.size());
+    if (!ring.is_read_write_supported()) {
+        ring.destroy();
+        ::close(out_fd);
+        ::close(in_fd);
+        printf("darts_bench::StringReplaceUring(): io_uring %s is not supported, "
+               "fallback to the blocking I/O.\n\n",
+               (fixed_buffers ? "fixed read and write" : "read and write"));
+        return StringReplaceEx<AcTrieT>(name, dict_file, input_file, in_output_file);
+    }
+
+    AcTrieT ac_trie;
+    buildAcTrie(ac_trie, dict_list);
+
+    std::uint64_t block_count = (input_size + kReadChunkSize - 1) / kReadChunkSize;
+
+    printf("darts_bench::StringReplaceUring(): reads = %u, writes = %u, fixed buffers = %s\n\n",
+           (uint32_t)kReadDepth, (uint32_t)kWriteDepth, (fixed_buffers ? "yes" : "no"));
+
+    // The requests which are prepared and not reaped yet.
+    std::size_t in_flight = 0;
+
+    auto prep_read = [&](std::size_t slot_id, std::uint64_t user_data) -> bool {
+        ReadSlot & slot = read_slots[slot_id];
+        if (!ring.prep_read(in_fd, &slot.buffer[slot.bytes], (unsigned)(slot.length - slot.bytes),
+                            slot.offset + slot.bytes, (int)slot_id, user_data)) {
+            printf("darts_bench::StringReplaceUring(): the read request is not queued.\n");
+            return false;
+        }
+        in_flight++;
+        return true;
+    };
+
+    auto submit_read = [&](std::size_t slot_id, std::uint64_t block_id) -> bool {
+        ReadSlot & slot = read_slots[slot_id];
+        slot.offset = block_id * kReadChunkSize;
+        slot.length = (std::size_t)std::min((std::uint64_t)kReadChunkSize,
+                                            input_size - slot.offset);
+        slot.bytes = 0;
+        slot.done = false;
+        return prep_read(slot_id, (kReadRequest << 32) | slot_id);
+    };
+
+    auto submit_write = [&](std::size_t slot_id) -> bool {
+        WriteSlot & slot = write_slots[slot_id];
+        slot.busy = true;
+        if (!ring.prep_write(out_fd, &slot.buffer[slot.bytes],
+                             (unsigned)(slot.length - slot.bytes),
+                             slot.offset + slot.bytes, (int)(kReadDepth + slot_id),
+                             (kWriteRequest << 32) | slot_id)) {
+            printf("darts_bench::StringReplaceUring(): the write request is not queued.\n");
+            return false;
+        }
+        in_flight++;
+        return true;
+    };
+
+    // Reap one completion, the short reads and writes are submitted again.
+    auto reap_one = [&]() -> bool {
+        io_uring_cqe cqe;
+        if (!ring.wait_cqe(cqe))
+            return false;
+
+        assert(in_flight > 0);
+        in_flight--;
+        std::uint64_t request = cqe.user_data >> 32;
+        std::size_t slot_id = (std::size_t)(cqe.user_data & 0xFFFFFFFFull);
+        if (cqe.res < 0 && cqe.res != -EINTR && cqe.res != -EAGAIN) {
+            printf("darts_bench::StringReplaceUring(): %s error: %s\n",
+                   ((request == kReadRequest) ? "read" : "write"), strerror(-cqe.res));
+            return false;
+        }
+
+        std::size_t bytes = (cqe.res > 0) ? (std::size_t)cqe.res : 0;
+        if (request == kReadRequest) {
+            ReadSlot & slot = read_slots[slot_id];
+            slot.bytes += bytes;
+            if (slot.bytes < slot.length && cqe.res != 0)
+                return prep_read(slot_id, cqe.user_data);
+            // The file is truncated if the read returns 0 bytes.
+            slot.length = slot.bytes;
+            slot.done = true;
+        } else {
+            WriteSlot & slot = write_slots[slot_id];
+            slot.bytes += bytes;
+            if (slot.bytes < slot.length)
+                return submit_write(slot_id);
+            slot.busy = false;
+        }
+        return true;
+    };
+
+    std::string bridge;
+    bridge.resize(kMaxTailingSize + kReadChunkSize + kPageSize);
+    std::size_t tailing_size = 0;
+
+    std::uint64_t output_offset = 0;
+    std::size_t write_slot_id = 0;
+    bool succeeded = true;
+
+    for (std::uint64_t block_id = 0; block_id < std::min(block_count, (std::uint64_t)kReadDepth);
+         block_id++) {
+        if (!submit_read((std::size_t)block_id, block_id)) {
+            succeeded = false;
+            break;
+        }
+    }
+    if (succeeded && ring.submit() < 0)
+        succeeded = false;
+
+    for (std::uint64_t block_id = 0; succeeded && block_id < block_count; block_id++) {
+        std::size_t read_slot_id = (std::size_t)(block_id % kReadDepth);
+        ReadSlot & read_slot = read_slots[read_slot_id];
+        while (!read_slot.done) {
+            if (!reap_one()) {
+                succeeded = false;
+                break;
+            }
+        }
+        if (!succeeded)
+            break;
+
+        bool is_last = (block_id == (block_count - 1));
+        const char * input = read_slot.buffer.c_str();
+        const char * input_end = input + read_slot.length;
+
+        if (tailing_size > 0) {
+            const char * newline = (const char *)std::memchr(input, '\n', read_slot.length);
+            if (newline == nullptr && !is_last &&
+                (tailing_size + read_slot.length) <= kMaxTailingSize) {
+                // The line is still not ended, keep it in the bridge.
+                std::copy_n(input, read_slot.length, &bridge[tailing_size]);
+                tailing_size += read_slot.length;
+                input = input_end;
+            }
+        }
+
+        if (input < input_end || is_last) {
+            WriteSlot * write_slot = &write_slots[write_slot_id];
+            while (write_slot->busy) {
+                if (!reap_one()) {
+                    succeeded = false;
+                    break;
+                }
+            }
+            if (!succeeded)
+                break;
+
+            char * output = &write_slot->buffer[0];
+            std::size_t outputBytes = 0;
+
+            // The head of this block ends the tailing line of the last block.
+            if (tailing_size > 0) {
+                const char * newline = (const char *)std::memchr(input, '\n',
+                                                                 (std::size_t)(input_end - input));
+                const char * head_last = (newline != nullptr) ? (newline + 1) : input_end;
+                std::size_t head_size = (std::size_t)(head_last - input);
+                std::copy_n(input, head_size, &bridge[tailing_size]);
+                const char * bridge_first = bridge.c_str();
+                outputBytes += replaceInputChunkTextEx<AcTrieT>(
+                                    ac_trie, value_arena, length_list,
+                                    bridge_first, bridge_first + tailing_size + head_size,
+                                    output + outputBytes);
+                tailing_size = 0;
+                input = head_last;
+            }
+
+            const char * input_chunk_last = input_end;
+            if (!is_last && input < input_end) {
+                const char * last_newline = StrUtils::rfind(input, input_end, '\n');
+                const char * tailing_first = (last_newline != nullptr) ? (last_newline + 1) : input;
+                if ((std::size_t)(input_end - tailing_first) <= kMaxTailingSize)
+                    input_chunk_last = tailing_first;
+            }
+
+            if (input < input_chunk_last) {
+                outputBytes += replaceInputChunkTextEx<AcTrieT>(
+                                    ac_trie, value_arena, length_list,
+                                    input, input_chunk_last,
+                                    output + outputBytes);
+            }
+
+            tailing_size = (std::size_t)(input_end - input_chunk_last);
+            if (tailing_size > 0) {
+                std::copy_n(input_chunk_last, tailing_size, &bridge[0]);
+            }
+
+            if (outputBytes > 0) {
+                write_slot->offset = output_offset;
+                write_slot->length = outputBytes;
+                write_slot->bytes = 0;
+                if (!submit_write(write_slot_id)) {
+                    succeeded = false;
+                    break;
+                }
+                output_offset += outputBytes;
+                write_slot_id = (write_slot_id + 1) % kWriteDepth;
+            }
+        }
+
+        // The read buffer is consumed, reuse it for the next block.
+        std::uint64_t next_block_id = block_id + kReadDepth;
+        if (next_block_id < block_count) {
+            if (!submit_read(read_slot_id, next_block_id)) {
+                succeeded = false;
+                break;
+            }
+        }
+        if (ring.submit() < 0) {
+            succeeded = false;
+            break;
+        }
+    }
+
+    // Wait for all the writes are done.
+    for (std::size_t i = 0; succeeded && i < kWriteDepth; i++) {
+        while (write_slots[i].busy) {
+            if (!reap_one()) {
+                succeeded = false;
+                break;
+            }
+        }
+    }
+
+    // After an error, the kernel may still read into or write from the buffers,
+    // so wait for the requests in flight before they are freed.
+    while (in_flight > 0) {
+        io_uring_cqe cqe;
+        if (!ring.wait_cqe(cqe)) {
+            printf("darts_bench::StringReplaceUring(): wait for the requests failed: %s\n",
+                   strerror(errno));
+            break;
+        }
+        in_flight--;
+    }
+
+    ring.destroy();
+    ::close(out_fd);
+    ::close(in_fd);
+    return (succeeded ? 0 : -1);
+#else
+    return StringReplaceEx<AcTrieT>(name, dict_file, input_file, in_output_file);
+#endif // USE_IO_URING
+}
+
+//
+// Match only (no replacement and no output), it's used to compare the state
+// layouts: the time and the hardware cache misses of the passes over the input.
+//
+template <typename AcTrieT>
+int MatchBenchmark(const std::string & name,
+                   const std::string & dict_file,
+                   const std::string & input_file,
+                   std::size_t passes = 5)
+{
+    static const std::size_t kReadChunkSize = 64 * 1024;
+
+    std::string dict_kv;
+    std::size_t dict_filesize = read_dict_file(dict_file, dict_kv);
+    if (dict_filesize == 0) {
+        std::cout << "dict_file [ " << dict_file << " ] read failed." << std::endl;
+        return -1;
+    }
+
+    MmapFile input_map;
+    if (!input_map.open(input_file, MmapFile::Sequential)) {
+        std::cout << "input_file [ " << input_file << " ] mmap failed." << std::endl;
+        return -1;
+    }
+
+    printf("-------------------------------------------------------------------------\n");
+    printf("  %s\n", name.c_str());
+    printf("-------------------------------------------------------------------------\n\n");
+
+    std::vector<std::pair<std::string, int>> dict_list;
+    std::vector<int> length_list;
+    ValueArena value_arena;
+
+    preprocessing_dict_file(dict_kv, dict_list, length_list, value_arena);
+
+    AcTrieT ac_trie;
+    buildAcTrie(ac_trie, dict_list);
+
+    typedef typename AcTrieT::MatchInfoEx MatchInfoEx;
+    std::vector<MatchInfoEx> match_list;
+
+    const char * input_start = input_map.data();
+    const char * input_end = input_start + input_map.size();
+    std::size_t match_count = 0;
+
+    perf_counter::PerfCounter counter;
+    test::StopWatch sw;
+
+    // The first pass is the warm-up, it's not counted.
+    for (std::size_t pass = 0; pass <= passes; pass++) {
+        if (pass == 1) {
+            match_count = 0;
+            counter.start();
+            sw.start();
+        }
+        const char * input = input_start;
+        while (input < input_end) {
+            const char * input_chunk_last = findInputChunkLast(input, input_end, kReadChunkSize);
+            ac_trie.match_chunk(input, input_chunk_last, match_list, length_list);
+            match_count += match_list.size();
+            input = input_chunk_last;
+        }
+    }
+    sw.stop();
+    counter.stop();
+
+    passes = (passes != 0) ? passes : 1;
+    double elapsedTime = sw.getMillisec() / passes;
+    double input_size_kb = (double)input_map.size() / 1024.0;
+    double input_size_mb = input_size_kb / 1024.0;
+
+    printf("matches: %" PRIu64 ", trie size: %0.2f MB\n", (std::uint64_t)(match_count / passes),
+           (double)ac_trie.dat_bytes() / (1024.0 * 1024.0));
+    printf("match time: %0.2f ms/pass, throughput: %0.2f MB/s\n",
+           elapsedTime, input_size_mb * 1000.0 / elapsedTime);
+    if (counter.is_any_available()) {
+        for (int i = 0; i < perf_counter::kMaxCounterType; i++) {
+            if (counter.is_available(i)) {
+                double count = (double)counter.value(i) / passes;
+                printf("%-16s %14.0f /pass, %10.2f /KB\n", perf_counter::counter_name(i),
+                       count, count / input_size_kb);
+            }
+        }
+    } else {
+        printf("The hardware counters are not available.\n");
+    }
+    printf("\n");
+
+    input_map.close();
+    return 0;
+}
+
+//
+// Build only, the build time against the key count: the keys are the first N keys
+// of the dictionary, doubled from 1K to max_keys. If the dictionary is too small,
+// more keys are made by joining two keys of it (key[i] + key[j]).
+//
+template <typename AcTrieT>
+int BuildBenchmark(const std::string & name,
+                   const std::string & dict_file,
+                   std::size_t max_keys = BUILD_BENCHMARK_MAX_KEYS)
+{
+    std::string dict_kv;
+    std::size_t dict_filesize = read_dict_file(dict_file, dict_kv);
+    if (dict_filesize == 0) {
+        std::cout << "dict_file [ " << dict_file << " ] read failed." << std::endl;
+        return -1;
+    }
+
+    printf("-------------------------------------------------------------------------\n");
+    printf("  %s\n", name.c_str());
+    printf("-------------------------------------------------------------------------\n\n");
+
+    std::vector<std::pair<std::string, int>> dict_list;
+    std::vector<int> length_list;
+    ValueArena value_arena;
+
+    preprocessing_dict_file(dict_kv, dict_list, length_list, value_arena);
+    if (dict_list.empty())
+        return -1;
+
+    std::vector<std::string> key_list;
+    key_list.reserve(max_keys);
+    for (auto iter = dict_list.begin(); iter != dict_list.end(); ++iter) {
+        if (key_list.size() >= max_keys)
+            break;
+        key_list.push_back(iter->first);
+    }
+    std::size_t dict_keys = key_list.size();
+    for (std::size_t i = 0; i < dict_keys && key_list.size() < max_keys; i++) {
+        for (std::size_t j = 0; j < dict_keys && key_list.size() < max_keys; j++) {
+            if (i != j)
+                key_list.push_back(key_list[i] + key_list[j]);
+        }
+    }
+
+    printf("%10s %14s %14s %12s\n", "keys", "build (ms)", "states", "ns/key");
+    std::size_t num_keys = 1024;
+    do {
+        if (num_keys > key_list.size())
+            num_keys = key_list.size();
+
+        AcTrieT ac_trie;
+        test::StopWatch sw;
+        sw.start();
+        for (std::size_t i = 0; i < num_keys; i++) {
+            ac_trie.insert(key_list[i], (std::uint32_t)i);
+        }
+        ac_trie.build();
+        sw.stop();
+
+        double elapsedTime = sw.getMillisec();
+        printf("%10" PRIu64 " %14.2f %14" PRIu64 " %12.1f\n", (std::uint64_t)num_keys, elapsedTime,
+               (std::uint64_t)ac_trie.max_state_id(), elapsedTime * 1000000.0 / num_keys);
+
+        if (num_keys >= key_list.size())
+            break;
+        num_keys *= 2;
+    } while (1);
+    printf("\n");
+
+    return 0;
+}
+
+template <typename MatchInfoT>
+static inline
+bool equal_match_list(const std::vector<MatchInfoT> & list1, const std::vector<MatchInfoT> & list2)
+{
+    if (list1.size() != list2.size())
+        return false;
+    for (std::size_t i = 0; i < list1.size(); i++) {
+        if (list1[i].begin != list2[i].begin || list1[i].end != list2[i].end ||
+            list1[i].pattern_id != list2[i].pattern_id)
+            return false;
+    }
+    return true;
+}
+
+//
+// Time online_insert() and online_erase() of the last keys on a built trie, and
+// check the matches against a fresh build of the same keys.
+//
+template <typename AcTrieT>
+int UpdateBenchmark(const std::string & name,
+                    const std::string & dict_file,
+                    std::size_t num_updates = 1000)
+{
+    typedef typename AcTrieT::MatchInfoEx MatchInfoEx;
+
+    std::string dict_kv;
+    std::size_t dict_filesize = read_dict_file(dict_file, dict_kv);
+    if (dict_filesize == 0) {
+        std::cout << "dict_file [ " << dict_file << " ] read failed." << std::endl;
+        return -1;
+    }
+
+    printf("-------------------------------------------------------------------------\n");
+    printf("  %s\n", name.c_str());
+    printf("-------------------------------------------------------------------------\n\n");
+
+    std::vector<std::pair<std::string, int>> dict_list;
+    std::vector<int> length_list;
+    ValueArena value_arena;
+
+    preprocessing_dict_file(dict_kv, dict_list, length_list, value_arena);
+    if (dict_list.empty())
+        return -1;
+
+    std::vector<std::string> key_list;
+    std::vector<int> key_length_list;
+    key_list.reserve(dict_list.size());
+    key_length_list.reserve(dict_list.size());
+    for (auto iter = dict_list.begin(); iter != dict_list.end(); ++iter) {
+        key_list.push_back(iter->first);
+        key_length_list.push_back((int)iter->first.size());
+    }
+    if (num_updates > key_list.size() / 2)
+        num_updates = key_list.size() / 2;
+    std::size_t num_base_keys = key_list.size() - num_updates;
+
+    // The text to verify: all the keys, one per line.
+    std::string text;
+    for (std::size_t i = 0; i < key_list.size(); i++) {
+        text += key_list[i];
+        text += '\n';
+    }
+
+    std::vector<MatchInfoEx> fresh_list, update_list;
+    test::StopWatch sw;
+
+    AcTrieT fresh_trie;
+    sw.start();
+    for (std::size_t i = 0; i < key_list.size(); i++) {
+        fresh_trie.insert(key_list[i], (std::uint32_t)i);
+    }
+    fresh_trie.build();
+    sw.stop();
+    double rebuild_time = sw.getMillisec();
+    fresh_trie.match_chunk(text.data(), text.data() + text.size(), fresh_list, key_length_list);
+
+    AcTrieT ac_trie;
+    for (std::size_t i = 0; i < num_base_keys; i++) {
+        ac_trie.insert(key_list[i], (std::uint32_t)i);
+    }
+    ac_trie.build();
+
+    sw.start();
+    for (std::size_t i = num_base_keys; i < key_list.size(); i++) {
+        ac_trie.online_insert(key_list[i], (std::uint32_t)i);
+    }
+    sw.stop();
+    double insert_time = sw.getMillisec();
+    ac_trie.match_chunk(text.data(), text.data() + text.size(), update_list, key_length_list);
+    bool insert_ok = equal_match_list(fresh_list, update_list);
+
+    sw.start();
+    for (std::size_t i = num_base_keys; i < key_list.size(); i++) {
+        ac_trie.online_erase(key_list[i]);
+    }
+    sw.stop();
+    double erase_time = sw.getMillisec();
+
+    AcTrieT base_trie;
+    for (std::size_t i = 0; i < num_base_keys; i++) {
+        base_trie.insert(key_list[i], (std::uint32_t)i);
+    }
+    base_trie.build();
+    base_trie.match_chunk(text.data(), text.data() + text.size(), fresh_list, key_length_list);
+    ac_trie.match_chunk(text.data(), text.data() + text.size(), update_list, key_length_list);
+    bool erase_ok = equal_match_list(fresh_list, update_list);
+
+    std::size_t tombstones = ac_trie.tombstones();
+    sw.start();
+    ac_trie.compact();
+    sw.stop();
+    double compact_time = sw.getMillisec();
+    ac_trie.match_chunk(text.data(), text.data() + text.size(), update_list, key_length_list);
+    bool compact_ok = equal_match_list(fresh_list, update_list);
+
+    printf("keys: %" PRIu64 ", updates: %" PRIu64 ", full rebuild: %0.2f ms\n\n",
+           (std::uint64_t)key_list.size(), (std::uint64_t)num_updates, rebuild_time);
+    printf("%16s %12s %12s %8s\n", "op", "total (ms)", "us/op", "check");
+    printf("%16s %12.2f %12.2f %8s\n", "online_insert", insert_time,
+           insert_time * 1000.0 / num_updates, (insert_ok ? "ok" : "FAILED"));
+    printf("%16s %12.2f %12.2f %8s\n", "online_erase", erase_time,
+           erase_time * 1000.0 / num_updates, (erase_ok ? "ok" : "FAILED"));
+    printf("%16s %12.2f %12s %8s\n", "compact", compact_time, "-", (compact_ok ? "ok" : "FAILED"));
+    printf("\ntombstones before compact: %" PRIu64 "\n\n", (std::uint64_t)tombstones);
+
+    return ((insert_ok && erase_ok && compact_ok) ? 0 : -1);
+}
+
+//
+// The matcher threads match the input chunks through a TrieHandle, first on a
+// fixed trie (steady), then while a background thread rebuilds the trie from
+// the same dictionary and swaps it reload_count times (reload). Every chunk must
+// have the same matches as the reference, and the chunk latencies of the two
+// phases are compared.
+//
+template <typename AcTrieT>
+int HotSwapBenchmark(const std::string & name,
+                     const std::string & dict_file,
+                     const std::string & input_file,
+                     std::size_t reload_count = 10,
+                     std::size_t thread_num = 0)
+{
+    static const std::size_t kReadChunkSize = 64 * 1024;
+    static const std::size_t kSteadyPasses = 3;
+
+    std::string dict_kv;
+    std::size_t dict_filesize = read_dict_file(dict_file, dict_kv);
+    if (dict_filesize == 0) {
+        std::cout << "dict_file [ " << dict_file << " ] read failed." << std::endl;
+        return -1;
+    }
+
+    MmapFile input_map;
+    if (!input_map.open(input_file, MmapFile::Sequential)) {
+        std::cout << "input_file [ " << input_file << " ] mmap failed." << std::endl;
+        return -1;
+    }
+
+    printf("-------------------------------------------------------------------------\n");
+    printf("  %s\n", name.c_str());
+    printf("-------------------------------------------------------------------------\n\n");
+
+    std::vector<std::pair<std::string, int>> dict_list;
+    std::vector<int> length_list;
+    ValueArena value_arena;
+
+    preprocessing_dict_file(dict_kv, dict_list, length_list, value_arena);
+
+    if (thread_num == 0) {
+        thread_num = (std::size_t)std::thread::hardware_concurrency();
+        // One core is left to the reloader.
+        thread_num = (thread_num > 1) ? (thread_num - 1) : 1;
+    }
+
+    typedef typename AcTrieT::MatchInfoEx MatchInfoEx;
+    typedef TrieHandle<AcTrieT> handle_type;
+
+    auto build_trie = [&]() -> AcTrieT * {
+        AcTrieT * ac_trie = new AcTrieT;
+        std::uint32_t index = 0;
+        for (auto iter = dict_list.begin(); iter != dict_list.end(); ++iter) {
+            ac_trie->insert(iter->first, index);
+            index++;
+        }
+        ac_trie->build();
+        ac_trie->clear_ac_trie();
+        return ac_trie;
+    };
+
+    // The matcher threads and the reference reader.
+    handle_type handle(build_trie(), thread_num + 1);
+
+    const char * input_start = input_map.data();
+    const char * input_end = input_start + input_map.size();
+    std::vector<const char *> chunk_list;
+    chunk_list.push_back(input_start);
+    const char * input = input_start;
+    while (input < input_end) {
+        input = findInputChunkLast(input, input_end, kReadChunkSize);
+        chunk_list.push_back(input);
+    }
+    std::size_t chunk_count = chunk_list.size() - 1;
+
+    // The reference match count of every chunk.
+    std::vector<std::size_t> ref_counts(chunk_count);
+    {
+        std::vector<MatchInfoEx> match_list;
+        std::size_t reader_id = handle.register_reader();
+        typename handle_type::ReadGuard guard(handle, reader_id);
+        for (std::size_t i = 0; i < chunk_count; i++) {
+            guard->match_chunk(chunk_list[i], chunk_list[i + 1], match_list, length_list);
+            ref_counts[i] = match_list.size();
+        }
+    }
+
+    printf("darts_bench::HotSwapBenchmark(): match threads = %u, chunks = %u, reloads = %u\n\n",
+           (uint32_t)thread_num, (uint32_t)chunk_count, (uint32_t)reload_count);
+
+    struct PhaseStat {
+        std::vector<double> latencies;
+        std::size_t         mismatches;
+
+        PhaseStat() : mismatches(0) {}
+    };
+
+    std::atomic<bool> reloading(false);
+    std::atomic<bool> reload_done(false);
+    std::atomic<std::size_t> ready_threads(0);
+    std::vector<PhaseStat> steady_stats(thread_num);
+    std::vector<PhaseStat> reload_stats(thread_num);
+    auto match_pass = [&](std::size_t reader_id, std::size_t first_chunk,
+                          std::vector<MatchInfoEx> & match_list, PhaseStat & stat) {
+        for (std::size_t n = 0; n < chunk_count; n++) {
+            std::size_t i = (first_chunk + n) % chunk_count;
+            auto start_time = std::chrono::steady_clock::now();
+            {
+                typename handle_type::ReadGuard guard(handle, reader_id);
+                guard->match_chunk(chunk_list[i], chunk_list[i + 1], match_list, length_list);
+            }
+            auto stop_time = std::chrono::steady_clock::now();
+            stat.latencies.push_back(
+                std::chrono::duration<double, std::micro>(stop_time - start_time).count());
+            if (match_list.size() != ref_counts[i])
+                stat.mismatches++;
+        }
+    };
+
+    auto matcher = [&](std::size_t thread_id) {
+        std::vector<MatchInfoEx> match_list;
+        std::size_t reader_id = handle.register_reader();
+        std::size_t first_chunk = thread_id * chunk_count / thread_num;
+
+        for (std::size_t pass = 0; pass < kSteadyPasses; pass++) {
+            match_pass(reader_id, first_chunk, match_list, steady_stats[thread_id]);
+        }
+
+        ready_threads.fetch_add(1);
+        while (!reloading.load(std::memory_order_acquire)) {
+            std::this_thread::yield();
+        }
+        do {
+            match_pass(reader_id, first_chunk, match_list, reload_stats[thread_id]);
+        } while (!reload_done.load(std::memory_order_acquire));
+    };
+
+    std::vector<std::thread> workers;
+    workers.reserve(thread_num);
+    for (std::size_t i = 0; i < thread_num; i++) {
+        workers.emplace_back(matcher, i);
+    }
+
+    while (ready_threads.load() < thread_num) {
+        std::this_thread::yield();
+    }
+    reloading.store(true, std::memory_order_release);
+
+    // The current thread is the reloader.
+    test::StopWatch sw;
+    double build_time = 0.0;
+    for (std::size_t i = 0; i < reload_count; i++) {
+        sw.start();
+        AcTrieT * new_trie = build_trie();
+        sw.stop();
+        build_time += sw.getMillisec();
+        handle.swap(new_trie);
+    }
+    reload_done.store(true, std::memory_order_release);
+
+    for (auto iter = workers.begin(); iter != workers.end(); ++iter) {
+        iter->join();
+    }
+    handle.synchronize();
+
+    auto print_phase = [](const char * phase, const std::vector<PhaseStat> & stats) {
+        std::vector<double> latencies;
+        std::size_t mismatches = 0;
+        for (auto iter = stats.begin(); iter != stats.end(); ++iter) {
+            latencies.insert(latencies.end(), iter->latencies.begin(), iter->latencies.end());
+            mismatches += iter->mismatches;
+        }
+        std::sort(latencies.begin(), latencies.end());
+        std::size_t count = latencies.size();
+        double p50 = (count > 0) ? latencies[count / 2] : 0.0;
+        double p99 = (count > 0) ? latencies[count * 99 / 100] : 0.0;
+        double max = (count > 0) ? latencies[count - 1] : 0.0;
+        printf("%8s %10" PRIu64 " %12.1f %12.1f %12.1f %12" PRIu64 "\n", phase,
+               (std::uint64_t)count, p50, p99, max, (std::uint64_t)mismatches);
+    };
+
+    printf("rebuild time: %0.2f ms/reload, epoch: %" PRIu64 ", retired: %" PRIu64 "\n\n",
+           build_time / ((reload_count != 0) ? reload_count : 1),
+           handle.epoch(), (std::uint64_t)handle.retired_count());
+    printf("%8s %10s %12s %12s %12s %12s\n",
+           "phase", "chunks", "p50 (us)", "p99 (us)", "max (us)", "mismatches");
+    print_phase("steady", steady_stats);
+    print_phase("reload", reload_stats);
+    printf("\n");
+
+    input_map.close();
+    return 0;
+}
+
+template <std::size_t K, typename AcTrieT>
+double interleavedMatchPasses(AcTrieT & ac_trie, const char * input_start, const char * input_end,
+                              std::size_t chunk_size, const std::vector<int> & length_list,
+                              std::size_t passes, std::size_t & match_count, std::size_t & mismatches)
+{
+    typedef typename AcTrieT::MatchInfoEx MatchInfoEx;
+    std::vector<MatchInfoEx> match_list;
+    std::vector<MatchInfoEx> expect_list;
+
+    // Check the matches against match_chunk() first, it's also the warm-up.
+    mismatches = 0;
+    const char * input = input_start;
+    while (input < input_end) {
+        const char * input_chunk_last = findInputChunkLast(input, input_end, chunk_size);
+        ac_trie.template match_chunk_interleaved<K>(input, input_chunk_last, match_list, length_list);
+        ac_trie.match_chunk(input, input_chunk_last, expect_list, length_list);
+        if (!equal_match_list(match_list, expect_list))
+            mismatches++;
+        input = input_chunk_last;
+    }
+
+    match_count = 0;
+    test::StopWatch sw;
+    sw.start();
+    for (std::size_t pass = 0; pass < passes; pass++) {
+        input = input_start;
+        while (input < input_end) {
+            const char * input_chunk_last = findInputChunkLast(input, input_end, chunk_size);
+            ac_trie.template match_chunk_interleaved<K>(input, input_chunk_last, match_list, length_list);
+            match_count += match_list.size();
+            input = input_chunk_last;
+        }
+    }
+    sw.stop();
+    return sw.getMillisec();
+}
+
+//
+// The chunk matching of K interleaved streams with the software prefetch,
+// the throughput against K. K = 1 is the plain dependent-load chain.
+//
+template <typename AcTrieT>
+int InterleaveBenchmark(const std::string & name,
+                        const std::string & dict_file,
+                        const std::string & input_file,
+                        std::size_t passes = 5)
+{
+    static const std::size_t kReadChunkSize = 256 * 1024;
+
+    std::string dict_kv;
+    std::size_t dict_filesize = read_dict_file(dict_file, dict_kv);
+    if (dict_filesize == 0) {
+        std::cout << "dict_file [ " << dict_file << " ] read failed." << std::endl;
+        return -1;
+    }
+
+    MmapFile input_map;
+    if (!input_map.open(input_file, MmapFile::Sequential)) {
+        std::cout << "input_file [ " << input_file << " ] mmap failed." << std::endl;
+        return -1;
+    }
+
+    printf("-------------------------------------------------------------------------\n");
+    printf("  %s\n", name.c_str());
+    printf("-------------------------------------------------------------------------\n\n");
+
+    std::vector<std::pair<std::string, int>> dict_list;
+    std::vector<int> length_list;
+    ValueArena value_arena;
+
+    preprocessing_dict_file(dict_kv, dict_list, length_list, value_arena);
+
+    AcTrieT ac_trie;
+    buildAcTrie(ac_trie, dict_list);
+
+    const char * input_start = input_map.data();
+    const char * input_end = input_start + input_map.size();
+    double input_size_mb = (double)input_map.size() / (1024.0 * 1024.0);
+    passes = (passes != 0) ? passes : 1;
+
+    printf("trie size: %0.2f MB\n\n", (double)ac_trie.dat_bytes() / (1024.0 * 1024.0));
+    printf("%6s %14s %14s %14s %12s\n", "K", "matches", "time (ms)", "MB/s", "mismatches");
+
+    for (std::size_t k = 1; k <= 16; k *= 2) {
+        std::size_t match_count = 0, mismatches = 0;
+        double elapsedTime;
+        switch (k) {
+            case 1:
+                elapsedTime = interleavedMatchPasses<1>(ac_trie, input_start, input_end, kReadChunkSize,
+                                                        length_list, passes, match_count, mismatches);
+                break;
+            case 2:
+                elapsedTime = interleavedMatchPasses<2>(ac_trie, input_start, input_end, kReadChunkSize,
+                                                        length_list, passes, match_count, mismatches);
+                break;
+            case 4:
+                elapsedTime = interleavedMatchPasses<4>(ac_trie, input_start, input_end, kReadChunkSize,
+                                                        length_list, passes, match_count, mismatches);
+                break;
+            case 8:
+                elapsedTime = interleavedMatchPasses<8>(ac_trie, input_start, input_end, kReadChunkSize,
+                                                        length_list, passes, match_count, mismatches);
+                break;
+            default:
+                elapsedTime = interleavedMatchPasses<16>(ac_trie, input_start, input_end, kReadChunkSize,
+                                                         length_list, passes, match_count, mismatches);
+                break;
+        }
+        elapsedTime /= passes;
+        printf("%6" PRIu64 " %14" PRIu64 " %14.2f %14.2f %12" PRIu64 "\n", (std::uint64_t)k,
+               (std::uint64_t)(match_count / passes), elapsedTime,
+               input_size_mb * 1000.0 / elapsedTime, (std::uint64_t)mismatches);
+    }
+    printf("\n");
+
+    input_map.close();
+    return 0;
+}
+
+template <typename MatcherT>
+double chunkMatchPasses(MatcherT & matcher, const char * input_start, const char * input_end,
+                        std::size_t chunk_size, const std::vector<int> & length_list,
+                        std::size_t passes, std::size_t & match_count)
+{
+    typedef typename MatcherT::MatchInfoEx MatchInfoEx;
+    std::vector<MatchInfoEx> match_list;
+
+    match_count = 0;
+    test::StopWatch sw;
+    sw.start();
+    for (std::size_t pass = 0; pass < passes; pass++) {
+        const char * input = input_start;
+        while (input < input_end) {
+            const char * input_chunk_last = findInputChunkLast(input, input_end, chunk_size);
+            matcher.match_chunk(input, input_chunk_last, match_list, length_list);
+            match_count += match_list.size();
+            input = input_chunk_last;
+        }
+    }
+    sw.stop();
+    return sw.getMillisec();
+}
+
+//
+// The Teddy matcher vs. the trie, the throughput against the key count: the keys
+// are the first N keys of the dictionary, N is 16 to 1024. The matches of Teddy
+// are checked against the trie for every chunk.
+//
+template <typename TeddyT, typename AcTrieT>
+int TeddyBenchmark(const std::string & name,
+                   const std::string & dict_file,
+                   const std::string & input_file,
+                   std::size_t passes = 3)
+{
+    static const std::size_t kReadChunkSize = 64 * 1024;
+
+    std::string dict_kv;
+    std::size_t dict_filesize = read_dict_file(dict_file, dict_kv);
+    if (dict_filesize == 0) {
+        std::cout << "dict_file [ " << dict_file << " ] read failed." << std::endl;
+        return -1;
+    }
+
+    MmapFile input_map;
+    if (!input_map.open(input_file, MmapFile::Sequential)) {
+        std::cout << "input_file [ " << input_file << " ] mmap failed." << std::endl;
+        return -1;
+    }
+
+    printf("-------------------------------------------------------------------------\n");
+    printf("  %s\n", name.c_str());
+    printf("-------------------------------------------------------------------------\n\n");
+
+    std::vector<std::pair<std::string, int>> dict_list;
+    std::vector<int> length_list;
+    ValueArena value_arena;
+
+    preprocessing_dict_file(dict_kv, dict_list, length_list, value_arena);
+    if (dict_list.empty())
+        return -1;
+
+    const char * input_start = input_map.data();
+    const char * input_end = input_start + input_map.size();
+    double input_size_mb = (double)input_map.size() / (1024.0 * 1024.0);
+    passes = (passes != 0) ? passes : 1;
+
+    printf("%8s %12s %14s %14s %14s %12s\n",
+           "keys", "matches", "trie (MB/s)", "ssse3 (MB/s)", "avx2 (MB/s)", "mismatches");
+
+    std::size_t num_keys = 16;
+    do {
+        if (num_keys > dict_list.size())
+            num_keys = dict_list.size();
+
+        AcTrieT ac_trie;
+        TeddyT teddy;
+        for (std::size_t i = 0; i < num_keys; i++) {
+            ac_trie.insert(dict_list[i].first, (std::uint32_t)i);
+            teddy.insert(dict_list[i].first, (std::uint32_t)i);
+        }
+        ac_trie.build();
+        teddy.build();
+
+        typedef typename AcTrieT::MatchInfoEx TrieMatchInfo;
+        typedef typename TeddyT::MatchInfoEx TeddyMatchInfo;
+        std::vector<TrieMatchInfo> trie_list;
+        std::vector<TeddyMatchInfo> teddy_list;
+
+        // Check the matches first, it's also the warm-up.
+        std::size_t mismatches = 0;
+        const char * input = input_start;
+        while (input < input_end) {
+            const char * input_chunk_last = findInputChunkLast(input, input_end, kReadChunkSize);
+            ac_trie.match_chunk(input, input_chunk_last, trie_list, length_list);
+            teddy.match_chunk(input, input_chunk_last, teddy_list, length_list);
+            bool is_equal = (trie_list.size() == teddy_list.size());
+            for (std::size_t i = 0; is_equal && i < trie_list.size(); i++) {
+                is_equal = ((trie_list[i].begin == teddy_list[i].begin) &&
+                            (trie_list[i].end == teddy_list[i].end) &&
+                            (trie_list[i].pattern_id == teddy_list[i].pattern_id));
+            }
+            if (!is_equal)
+                mismatches++;
+            input = input_chunk_last;
+        }
+
+        std::size_t match_count = 0;
+        double trie_time = chunkMatchPasses(ac_trie, input_start, input_end, kReadChunkSize,
+                                            length_list, passes, match_count) / passes;
+        teddy.set_avx2(false);
+        double ssse3_time = chunkMatchPasses(teddy, input_start, input_end, kReadChunkSize,
+                                             length_list, passes, match_count) / passes;
+        teddy.set_avx2(true);
+        double avx2_time = chunkMatchPasses(teddy, input_start, input_end, kReadChunkSize,
+                                            length_list, passes, match_count) / passes;
+
+        printf("%8" PRIu64 " %12" PRIu64 " %14.2f %14.2f ", (std::uint64_t)num_keys,
+               (std::uint64_t)(match_count / passes),
+               input_size_mb * 1000.0 / trie_time, input_size_mb * 1000.0 / ssse3_time);
+        if (teddy.use_avx2())
+            printf("%14.2f", input_size_mb * 1000.0 / avx2_time);
+        else
+            printf("%14s", "n/a");
+        printf(" %12" PRIu64 "\n", (std::uint64_t)mismatches);
+
+        if (num_keys >= dict_list.size() || num_keys >= 1024)
+            break;
+        num_keys *= 4;
+    } while (1);
+    printf("\n");
+
+    input_map.close();
+    return 0;
+}
+
 } // namespace darts_bench
 
 #undef USE_READ_WRITE_STATISTICS
+#undef USE_CHUNK_MATCHING
+#undef USE_TRIE_CACHE
 
 #endif // DARTS_BENCHMARK_H
@@ -0,0 +1,225 @@
+
+#ifndef FILE_UTILS_H
+#define FILE_UTILS_H
+
+#if defined(_MSC_VER) && (_MSC_VER >= 1020)
+#pragma once
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <string.h>
+#include <assert.h>
+
+#include <cstdint>
+#include <cstddef>
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <algorithm>
+
+#if defined(_WIN32) || defined(WIN32) || defined(OS_WINDOWS) || defined(_WINDOWS_)
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#endif // WIN32_LEAN_AND_MEAN
+#include <direct.h>
+#define FILE_UTILS_USE_WIN32    1
+#else
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <dirent.h>
+#include <unistd.h>
+#define FILE_UTILS_USE_WIN32    0
+#endif
+
+namespace file_utils {
+
+#if FILE_UTILS_USE_WIN32
+static const char kPathSeparator = '\\';
+#else
+static const char kPathSeparator = '/';
+#endif
+
+static inline
+bool is_path_separator(char ch)
+{
+    return (ch == '/' || ch == '\\');
+}
+
+static inline
+bool is_directory(const std::string & path)
+{
+#if FILE_UTILS_USE_WIN32
+    DWORD attrs = ::GetFileAttributesA(path.c_str());
+    return (attrs != INVALID_FILE_ATTRIBUTES && (attrs & FILE_ATTRIBUTE_DIRECTORY) != 0);
+#else
+    struct stat st;
+    return (::stat(path.c_str(), &st) == 0 && S_ISDIR(st.st_mode));
+#endif
+}
+
+static inline
+bool make_directory(const std::string & path)
+{
+    if (is_directory(path))
+        return true;
+#if FILE_UTILS_USE_WIN32
+    return (::_mkdir(path.c_str()) == 0);
+#else
+    return (::mkdir(path.c_str(), 0755) == 0);
+#endif
+}
+
+static inline
+std::string base_name(const std::string & path)
+{
+    std::size_t pos = path.size();
+    while (pos > 0 && !is_path_separator(path[pos - 1]))
+        pos--;
+    return path.substr(pos);
+}
+
+static inline
+std::string path_join(const std::string & dir, const std::string & name)
+{
+    if (dir.empty())
+        return name;
+    if (is_path_separator(dir[dir.size() - 1]))
+        return (dir + name);
+    else
+        return (dir + kPathSeparator + name);
+}
+
+//
+// The identity of an existing file: the device and the inode (the volume serial
+// number and the file index on Windows), the different paths of a file have the same id.
+//
+struct FileId {
+    std::uint64_t device;
+    std::uint64_t inode;
+
+    bool operator == (const FileId & rhs) const {
+        return (this->device == rhs.device && this->inode == rhs.inode);
+    }
+
+    bool operator < (const FileId & rhs) const {
+        return ((this->device < rhs.device) ||
+                (this->device == rhs.device && this->inode < rhs.inode));
+    }
+};
+
+static inline
+bool get_file_id(const std::string & path, FileId & file_id)
+{
+#if FILE_UTILS_USE_WIN32
+    HANDLE hFile = ::CreateFileA(path.c_str(), 0, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+                                 NULL, OPEN_EXISTING, FILE_FLAG_BACKUP_SEMANTICS, NULL);
+    if (hFile == INVALID_HANDLE_VALUE)
+        return false;
+    BY_HANDLE_FILE_INFORMATION info;
+    BOOL success = ::GetFileInformationByHandle(hFile, &info);
+    ::CloseHandle(hFile);
+    if (!success)
+        return false;
+    file_id.device = info.dwVolumeSerialNumber;
+    file_id.inode = ((std::uint64_t)info.nFileIndexHigh << 32) | info.nFileIndexLow;
+    return true;
+#else
+    struct stat st;
+    if (::stat(path.c_str(), &st) != 0)
+        return false;
+    file_id.device = (std::uint64_t)st.st_dev;
+    file_id.inode = (std::uint64_t)st.st_ino;
+    return true;
+#endif
+}
+
+//
+// Return true if the two paths are the same existing file,
+// a file which doesn't exist yet is not the same as any file.
+//
+static inline
+bool is_same_file(const std::string & path1, const std::string & path2)
+{
+    FileId file_id1, file_id2;
+    if (!get_file_id(path1, file_id1) || !get_file_id(path2, file_id2))
+        return false;
+    return (file_id1 == file_id2);
+}
+
+//
+// List the regular files of a directory (not recursive), sorted by name.
+//
+static inline
+std::size_t list_directory(const std::string & dir, std::vector<std::string> & files)
+{
+    files.clear();
+#if FILE_UTILS_USE_WIN32
+    WIN32_FIND_DATAA find_data;
+    HANDLE hFind = ::FindFirstFileA(path_join(dir, "*").c_str(), &find_data);
+    if (hFind != INVALID_HANDLE_VALUE) {
+        do {
+            if ((find_data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) == 0)
+                files.push_back(path_join(dir, find_data.cFileName));
+        } while (::FindNextFileA(hFind, &find_data));
+        ::FindClose(hFind);
+    }
+#else
+    DIR * pDir = ::opendir(dir.c_str());
+    if (pDir != nullptr) {
+        struct dirent * entry;
+        while ((entry = ::readdir(pDir)) != nullptr) {
+            std::string file = path_join(dir, entry->d_name);
+            struct stat st;
+            if (::stat(file.c_str(), &st) == 0 && S_ISREG(st.st_mode))
+                files.push_back(file);
+        }
+        ::closedir(pDir);
+    }
+#endif
+    std::sort(files.begin(), files.end());
+    return files.size();
+}
+
+//
+// Read a file list, one path per line, the empty lines are skipped.
+//
+static inline
+std::size_t read_file_list(const std::string & list_file, std::vector<std::string> & files)
+{
+    files.clear();
+    std::ifstream ifs;
+    ifs.open(list_file, std::ios::in);
+    if (ifs.good()) {
+        std::string line;
+        while (std::getline(ifs, line)) {
+            while (!line.empty() && (line.back() == '\r' || line.back() == ' '))
+                line.pop_back();
+            if (!line.empty())
+                files.push_back(line);
+        }
+        ifs.close();
+    }
+    return files.size();
+}
+
+//
+// The input is a directory or a file list.
+//
+static inline
+std::size_t get_input_files(const std::string & input, std::vector<std::string> & files)
+{
+    if (is_directory(input))
+        return list_directory(input, files);
+    else
+        return read_file_list(input, files);
+}
+
+} // namespace file_utils
+
+#endif // FILE_UTILS_H
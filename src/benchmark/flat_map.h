@@ -0,0 +1,113 @@
+
+#ifndef FLAT_MAP_H
+#define FLAT_MAP_H
+
+#if defined(_MSC_VER) && (_MSC_VER >= 1020)
+#pragma once
+#endif
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <assert.h>
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+#include <utility>
+#include <algorithm>
+
+#include "basic/stddef.h"
+
+//
+// A sorted vector of (key, value) pairs with the std::map interface the AC tries
+// use: find(), insert(), size() and the iteration in key order. All the children
+// of a state are in one contiguous array, no heap node per edge. The few children
+// are searched linearly, the many children (the root of a CJK dict) by binary search.
+//
+template <typename KeyT, typename ValueT>
+class FlatMap {
+public:
+    typedef KeyT                                key_type;
+    typedef ValueT                              mapped_type;
+    typedef std::pair<KeyT, ValueT>             value_type;
+    typedef std::size_t                         size_type;
+
+    typedef typename std::vector<value_type>::iterator          iterator;
+    typedef typename std::vector<value_type>::const_iterator    const_iterator;
+
+    static const size_type kLinearSearchSize = 16;
+
+private:
+    std::vector<value_type> items_;
+
+public:
+    // No user-declared destructor, so the moves of the states in a growing
+    // std::vector are not copies.
+    FlatMap() {}
+
+    iterator begin() { return this->items_.begin(); }
+    iterator end() { return this->items_.end(); }
+
+    const_iterator begin() const { return this->items_.begin(); }
+    const_iterator end() const { return this->items_.end(); }
+
+    size_type size() const { return this->items_.size(); }
+    bool empty() const { return this->items_.empty(); }
+
+    void clear() {
+        this->items_.clear();
+    }
+
+    void shrink_to_fit() {
+        this->items_.shrink_to_fit();
+    }
+
+    iterator find(const key_type & key) {
+        return (this->items_.begin() + this->find_index(key));
+    }
+
+    const_iterator find(const key_type & key) const {
+        return (this->items_.begin() + this->find_index(key));
+    }
+
+    std::pair<iterator, bool> insert(const value_type & value) {
+        iterator iter = this->lower_bound(value.first);
+        if (iter != this->items_.end() && iter->first == value.first)
+            return std::make_pair(iter, false);
+        iter = this->items_.insert(iter, value);
+        return std::make_pair(iter, true);
+    }
+
+private:
+    iterator lower_bound(const key_type & key) {
+        return std::lower_bound(this->items_.begin(), this->items_.end(), key,
+                                [](const value_type & item, const key_type & key) {
+                                    return (item.first < key);
+                                });
+    }
+
+    size_type find_index(const key_type & key) const {
+        size_type count = this->items_.size();
+        const value_type * items = this->items_.data();
+        if (likely(count <= kLinearSearchSize)) {
+            for (size_type i = 0; i < count; i++) {
+                if (items[i].first >= key)
+                    return ((items[i].first == key) ? i : count);
+            }
+            return count;
+        } else {
+            size_type low = 0, high = count;
+            while (low < high) {
+                size_type mid = (low + high) / 2;
+                if (items[mid].first < key)
+                    low = mid + 1;
+                else
+                    high = mid;
+            }
+            return ((low < count && items[low].first == key) ? low : count);
+        }
+    }
+};
+
+#endif // FLAT_MAP_H
@@ -0,0 +1,324 @@
+
+#ifndef IO_URING_UTILS_H
+#define IO_URING_UTILS_H
+
+#if defined(_MSC_VER) && (_MSC_VER >= 1020)
+#pragma once
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <assert.h>
+
+#include <cstdint>
+#include <cstddef>
+
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#define USE_IO_URING    1
+#endif
+#endif
+
+#ifndef USE_IO_URING
+#define USE_IO_URING    0
+#endif
+
+#if USE_IO_URING
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <linux/io_uring.h>
+
+//
+// A minimal io_uring wrapper on the raw syscalls, so it doesn't depend on liburing.
+//
+// See: https://kernel.dk/io_uring.pdf
+//
+class IoUring {
+public:
+    typedef std::size_t size_type;
+
+private:
+    int             ring_fd_;
+    unsigned        entries_;
+    bool            fixed_buffers_;
+
+    void *          sq_ptr_;
+    void *          cq_ptr_;
+    size_type       sq_ring_size_;
+    size_type       cq_ring_size_;
+
+    unsigned *      sq_head_;
+    unsigned *      sq_tail_;
+    unsigned *      sq_mask_;
+    unsigned *      sq_array_;
+    io_uring_sqe *  sqes_;
+    size_type       sqes_size_;
+
+    unsigned *      cq_head_;
+    unsigned *      cq_tail_;
+    unsigned *      cq_mask_;
+    io_uring_cqe *  cqes_;
+
+    unsigned        sqe_tail_;
+    unsigned        sqe_submitted_;
+
+public:
+    IoUring() : ring_fd_(-1), entries_(0), fixed_buffers_(false),
+                sq_ptr_(MAP_FAILED), cq_ptr_(MAP_FAILED),
+                sq_ring_size_(0), cq_ring_size_(0),
+                sq_head_(nullptr), sq_tail_(nullptr), sq_mask_(nullptr), sq_array_(nullptr),
+                sqes_((io_uring_sqe *)MAP_FAILED), sqes_size_(0),
+                cq_head_(nullptr), cq_tail_(nullptr), cq_mask_(nullptr), cqes_(nullptr),
+                sqe_tail_(0), sqe_submitted_(0) {
+    }
+
+    ~IoUring() {
+        this->destroy();
+    }
+
+    bool is_alive() const {
+        return (this->ring_fd_ >= 0);
+    }
+
+    bool has_fixed_buffers() const {
+        return this->fixed_buffers_;
+    }
+
+    //
+    // Probe whether io_uring is usable, the syscall may be missing on old
+    // kernels, or be denied by seccomp in the containers.
+    //
+    static bool is_supported() {
+        IoUring ring;
+        return ring.init(2);
+    }
+
+    bool init(unsigned entries) {
+        this->destroy();
+
+        io_uring_params params;
+        memset(&params, 0, sizeof(params));
+        int ring_fd = (int)::syscall(__NR_io_uring_setup, entries, &params);
+        if (ring_fd < 0)
+            return false;
+
+        this->ring_fd_ = ring_fd;
+        this->entries_ = params.sq_entries;
+
+        this->sq_ring_size_ = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+        this->cq_ring_size_ = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+        bool single_mmap = ((params.features & IORING_FEAT_SINGLE_MMAP) != 0);
+        if (single_mmap) {
+            if (this->cq_ring_size_ > this->sq_ring_size_)
+                this->sq_ring_size_ = this->cq_ring_size_;
+            this->cq_ring_size_ = this->sq_ring_size_;
+        }
+
+        this->sq_ptr_ = ::mmap(nullptr, this->sq_ring_size_, PROT_READ | PROT_WRITE,
+                               MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_SQ_RING);
+        if (this->sq_ptr_ == MAP_FAILED) {
+            this->destroy();
+            return false;
+        }
+
+        if (single_mmap) {
+            this->cq_ptr_ = this->sq_ptr_;
+        } else {
+            this->cq_ptr_ = ::mmap(nullptr, this->cq_ring_size_, PROT_READ | PROT_WRITE,
+                                   MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_CQ_RING);
+            if (this->cq_ptr_ == MAP_FAILED) {
+                this->destroy();
+                return false;
+            }
+        }
+
+        this->sqes_size_ = params.sq_entries * sizeof(io_uring_sqe);
+        this->sqes_ = (io_uring_sqe *)::mmap(nullptr, this->sqes_size_, PROT_READ | PROT_WRITE,
+                                             MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_SQES);
+        if ((void *)this->sqes_ == MAP_FAILED) {
+            this->destroy();
+            return false;
+        }
+
+        char * sq_ptr = (char *)this->sq_ptr_;
+        this->sq_head_  = (unsigned *)(sq_ptr + params.sq_off.head);
+        this->sq_tail_  = (unsigned *)(sq_ptr + params.sq_off.tail);
+        this->sq_mask_  = (unsigned *)(sq_ptr + params.sq_off.ring_mask);
+        this->sq_array_ = (unsigned *)(sq_ptr + params.sq_off.array);
+
+        char * cq_ptr = (char *)this->cq_ptr_;
+        this->cq_head_  = (unsigned *)(cq_ptr + params.cq_off.head);
+        this->cq_tail_  = (unsigned *)(cq_ptr + params.cq_off.tail);
+        this->cq_mask_  = (unsigned *)(cq_ptr + params.cq_off.ring_mask);
+        this->cqes_     = (io_uring_cqe *)(cq_ptr + params.cq_off.cqes);
+
+        this->sqe_tail_ = *this->sq_tail_;
+        this->sqe_submitted_ = this->sqe_tail_;
+        return true;
+    }
+
+    void destroy() {
+        if ((void *)this->sqes_ != MAP_FAILED) {
+            ::munmap((void *)this->sqes_, this->sqes_size_);
+            this->sqes_ = (io_uring_sqe *)MAP_FAILED;
+        }
+        if (this->cq_ptr_ != MAP_FAILED && this->cq_ptr_ != this->sq_ptr_) {
+            ::munmap(this->cq_ptr_, this->cq_ring_size_);
+        }
+        this->cq_ptr_ = MAP_FAILED;
+        if (this->sq_ptr_ != MAP_FAILED) {
+            ::munmap(this->sq_ptr_, this->sq_ring_size_);
+            this->sq_ptr_ = MAP_FAILED;
+        }
+        if (this->ring_fd_ >= 0) {
+            ::close(this->ring_fd_);
+            this->ring_fd_ = -1;
+        }
+        this->fixed_buffers_ = false;
+    }
+
+    //
+    // Whether the kernel supports the opcode, IORING_OP_READ and IORING_OP_WRITE
+    // need 5.6, but io_uring_setup() works since 5.1. IORING_REGISTER_PROBE is
+    // also 5.6, so if the probe fails, only the 5.1 opcodes are supported.
+    //
+    bool is_op_supported(std::uint8_t opcode) const {
+        assert(this->is_alive());
+        static const unsigned kMaxProbeOps = 256;
+        size_type probe_size = sizeof(io_uring_probe) + kMaxProbeOps * sizeof(io_uring_probe_op);
+        io_uring_probe * probe = (io_uring_probe *)::calloc(1, probe_size);
+        if (probe == nullptr)
+            return false;
+
+        bool supported = false;
+        int ret = (int)::syscall(__NR_io_uring_register, this->ring_fd_,
+                                 IORING_REGISTER_PROBE, probe, kMaxProbeOps);
+        if (ret == 0 && opcode <= probe->last_op)
+            supported = ((probe->ops[opcode].flags & IO_URING_OP_SUPPORTED) != 0);
+        else if (ret < 0)
+            supported = (opcode <= IORING_OP_WRITE_FIXED);
+        ::free(probe);
+        return supported;
+    }
+
+    //
+    // Whether prep_read() and prep_write() can be used, with the fixed buffers
+    // or not.
+    //
+    bool is_read_write_supported() const {
+        if (this->fixed_buffers_)
+            return (this->is_op_supported(IORING_OP_READ_FIXED) &&
+                    this->is_op_supported(IORING_OP_WRITE_FIXED));
+        else
+            return (this->is_op_supported(IORING_OP_READ) &&
+                    this->is_op_supported(IORING_OP_WRITE));
+    }
+
+    //
+    // Pin the buffers in the kernel, then use IORING_OP_READ_FIXED and
+    // IORING_OP_WRITE_FIXED to skip the page mapping of every request.
+    //
+    bool register_buffers(const struct iovec * iovecs, unsigned count) {
+        assert(this->is_alive());
+        int ret = (int)::syscall(__NR_io_uring_register, this->ring_fd_,
+                                 IORING_REGISTER_BUFFERS, iovecs, count);
+        this->fixed_buffers_ = (ret == 0);
+        return this->fixed_buffers_;
+    }
+
+    bool prep_read(int fd, void * buf, unsigned length, std::uint64_t offset,
+                   int buf_index, std::uint64_t user_data) {
+        return this->prep_rw(this->fixed_buffers_ ? IORING_OP_READ_FIXED : IORING_OP_READ,
+                             fd, buf, length, offset, buf_index, user_data);
+    }
+
+    bool prep_write(int fd, const void * buf, unsigned length, std::uint64_t offset,
+                    int buf_index, std::uint64_t user_data) {
+        return this->prep_rw(this->fixed_buffers_ ? IORING_OP_WRITE_FIXED : IORING_OP_WRITE,
+                             fd, buf, length, offset, buf_index, user_data);
+    }
+
+    //
+    // Submit all the prepared requests, and wait for at least wait_nr completions.
+    //
+    int submit(unsigned wait_nr = 0) {
+        unsigned to_submit = this->sqe_tail_ - this->sqe_submitted_;
+        if (to_submit != 0) {
+            // Make the sqes visible before the tail update.
+            __atomic_store_n(this->sq_tail_, this->sqe_tail_, __ATOMIC_RELEASE);
+        }
+        if (to_submit == 0 && wait_nr == 0)
+            return 0;
+
+        unsigned flags = (wait_nr != 0) ? IORING_ENTER_GETEVENTS : 0;
+        int ret;
+        do {
+            ret = (int)::syscall(__NR_io_uring_enter, this->ring_fd_, to_submit, wait_nr,
+                                 flags, nullptr, 0);
+        } while (ret < 0 && errno == EINTR);
+
+        if (ret >= 0)
+            this->sqe_submitted_ += (unsigned)ret;
+        return ret;
+    }
+
+    bool peek_cqe(io_uring_cqe & cqe) {
+        unsigned head = *this->cq_head_;
+        unsigned tail = __atomic_load_n(this->cq_tail_, __ATOMIC_ACQUIRE);
+        if (head == tail)
+            return false;
+        cqe = this->cqes_[head & *this->cq_mask_];
+        __atomic_store_n(this->cq_head_, head + 1, __ATOMIC_RELEASE);
+        return true;
+    }
+
+    bool wait_cqe(io_uring_cqe & cqe) {
+        while (!this->peek_cqe(cqe)) {
+            if (this->submit(1) < 0)
+                return false;
+        }
+        return true;
+    }
+
+private:
+    bool prep_rw(std::uint8_t opcode, int fd, const void * buf, unsigned length,
+                 std::uint64_t offset, int buf_index, std::uint64_t user_data) {
+        unsigned head = __atomic_load_n(this->sq_head_, __ATOMIC_ACQUIRE);
+        if ((this->sqe_tail_ - head) >= this->entries_)
+            return false;
+
+        unsigned index = this->sqe_tail_ & *this->sq_mask_;
+        io_uring_sqe * sqe = &this->sqes_[index];
+        memset((void *)sqe, 0, sizeof(io_uring_sqe));
+        sqe->opcode = opcode;
+        sqe->fd = fd;
+        sqe->off = offset;
+        sqe->addr = (std::uint64_t)(std::uintptr_t)buf;
+        sqe->len = length;
+        sqe->user_data = user_data;
+        if (opcode == IORING_OP_READ_FIXED || opcode == IORING_OP_WRITE_FIXED)
+            sqe->buf_index = (std::uint16_t)buf_index;
+
+        this->sq_array_[index] = index;
+        this->sqe_tail_++;
+        return true;
+    }
+
+    IoUring(const IoUring & src) = delete;
+    IoUring & operator = (const IoUring & rhs) = delete;
+};
+
+#endif // USE_IO_URING
+
+#endif // IO_URING_UTILS_H
@@ -0,0 +1,198 @@
+
+#ifndef MMAP_FILE_H
+#define MMAP_FILE_H
+
+#if defined(_MSC_VER) && (_MSC_VER >= 1020)
+#pragma once
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <string.h>
+#include <assert.h>
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+
+#if defined(_WIN32) || defined(WIN32) || defined(OS_WINDOWS) || defined(_WINDOWS_)
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#endif // WIN32_LEAN_AND_MEAN
+#define MMAP_FILE_USE_WIN32     1
+#else
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#define MMAP_FILE_USE_WIN32     0
+#endif
+
+//
+// Read-only memory mapped file, the matcher walks the mapped pages directly,
+// so there is no input chunk buffer and no tailing bytes shuffling.
+//
+class MmapFile {
+public:
+    typedef std::size_t size_type;
+
+    enum Advice {
+        Normal,
+        Sequential,
+        Random
+    };
+
+private:
+    const char * data_;
+    size_type    size_;
+#if MMAP_FILE_USE_WIN32
+    HANDLE       file_;
+    HANDLE       mapping_;
+#else
+    int          fd_;
+#endif
+
+public:
+    MmapFile() : data_(nullptr), size_(0),
+#if MMAP_FILE_USE_WIN32
+        file_(INVALID_HANDLE_VALUE), mapping_(NULL) {
+#else
+        fd_(-1) {
+#endif
+    }
+
+    MmapFile(const std::string & filename, int advice = Sequential) : MmapFile() {
+        this->open(filename, advice);
+    }
+
+    ~MmapFile() {
+        this->close();
+    }
+
+    const char * data() const { return this->data_; }
+    size_type size() const { return this->size_; }
+
+    const char * begin() const { return this->data_; }
+    const char * end() const { return (this->data_ + this->size_); }
+
+#if MMAP_FILE_USE_WIN32
+    bool is_open() const { return (this->file_ != INVALID_HANDLE_VALUE); }
+#else
+    bool is_open() const { return (this->fd_ >= 0); }
+#endif
+
+    bool open(const std::string & filename, int advice = Sequential) {
+        this->close();
+#if MMAP_FILE_USE_WIN32
+        DWORD flags = (advice == Sequential) ? FILE_FLAG_SEQUENTIAL_SCAN :
+                      ((advice == Random) ? FILE_FLAG_RANDOM_ACCESS : FILE_ATTRIBUTE_NORMAL);
+        this->file_ = ::CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ,
+                                    NULL, OPEN_EXISTING, flags, NULL);
+        if (this->file_ == INVALID_HANDLE_VALUE)
+            return false;
+
+        LARGE_INTEGER file_size;
+        if (!::GetFileSizeEx(this->file_, &file_size)) {
+            this->close();
+            return false;
+        }
+        this->size_ = (size_type)file_size.QuadPart;
+        if (this->size_ == 0)
+            return true;
+
+        this->mapping_ = ::CreateFileMappingA(this->file_, NULL, PAGE_READONLY, 0, 0, NULL);
+        if (this->mapping_ == NULL) {
+            this->close();
+            return false;
+        }
+        this->data_ = (const char *)::MapViewOfFile(this->mapping_, FILE_MAP_READ, 0, 0, 0);
+        if (this->data_ == nullptr) {
+            this->close();
+            return false;
+        }
+#else
+        this->fd_ = ::open(filename.c_str(), O_RDONLY);
+        if (this->fd_ < 0)
+            return false;
+
+        struct stat st;
+        if (::fstat(this->fd_, &st) != 0 || !S_ISREG(st.st_mode)) {
+            this->close();
+            return false;
+        }
+        this->size_ = (size_type)st.st_size;
+        if (this->size_ == 0)
+            return true;
+
+  #if defined(POSIX_FADV_SEQUENTIAL)
+        if (advice == Sequential)
+            ::posix_fadvise(this->fd_, 0, 0, POSIX_FADV_SEQUENTIAL);
+        else if (advice == Random)
+            ::posix_fadvise(this->fd_, 0, 0, POSIX_FADV_RANDOM);
+  #endif
+        void * addr = ::mmap(nullptr, this->size_, PROT_READ, MAP_SHARED, this->fd_, 0);
+        if (addr == MAP_FAILED) {
+            this->close();
+            return false;
+        }
+        this->data_ = (const char *)addr;
+        if (advice == Sequential)
+            ::madvise(addr, this->size_, MADV_SEQUENTIAL);
+        else if (advice == Random)
+            ::madvise(addr, this->size_, MADV_RANDOM);
+#endif
+        return true;
+    }
+
+    //
+    // Drop the pages of [0, offset) which have been consumed,
+    // it keeps the resident set small when walking a multi-GB file.
+    //
+    void release(size_type offset) {
+#if !MMAP_FILE_USE_WIN32
+        static const size_type kPageSize = 4 * 1024;
+        size_type length = offset & ~(kPageSize - 1);
+        if (this->data_ != nullptr && length > 0) {
+            assert(length <= this->size_);
+            ::madvise((void *)this->data_, length, MADV_DONTNEED);
+        }
+#endif
+    }
+
+    void close() {
+#if MMAP_FILE_USE_WIN32
+        if (this->data_ != nullptr) {
+            ::UnmapViewOfFile((LPCVOID)this->data_);
+        }
+        if (this->mapping_ != NULL) {
+            ::CloseHandle(this->mapping_);
+            this->mapping_ = NULL;
+        }
+        if (this->file_ != INVALID_HANDLE_VALUE) {
+            ::CloseHandle(this->file_);
+            this->file_ = INVALID_HANDLE_VALUE;
+        }
+#else
+        if (this->data_ != nullptr) {
+            ::munmap((void *)this->data_, this->size_);
+        }
+        if (this->fd_ >= 0) {
+            ::close(this->fd_);
+            this->fd_ = -1;
+        }
+#endif
+        this->data_ = nullptr;
+        this->size_ = 0;
+    }
+
+private:
+    MmapFile(const MmapFile & src) = delete;
+    MmapFile & operator = (const MmapFile & rhs) = delete;
+};
+
+#endif // MMAP_FILE_H
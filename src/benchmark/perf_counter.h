@@ -0,0 +1,178 @@
+
+#ifndef PERF_COUNTER_H
+#define PERF_COUNTER_H
+
+#if defined(_MSC_VER) && (_MSC_VER >= 1020)
+#pragma once
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <string.h>
+#include <assert.h>
+
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+
+#include "basic/stddef.h"
+
+#if defined(__linux__)
+#include <sys/types.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <linux/perf_event.h>
+#define PERF_COUNTER_USE_PERF_EVENT     1
+#else
+#define PERF_COUNTER_USE_PERF_EVENT     0
+#endif
+
+namespace perf_counter {
+
+enum CounterType {
+    kCycles,
+    kInstructions,
+    kL1DReadMisses,
+    kLLCReadMisses,
+    kMaxCounterType
+};
+
+static inline
+const char * counter_name(int type)
+{
+    switch (type) {
+    case kCycles:
+        return "cycles";
+    case kInstructions:
+        return "instructions";
+    case kL1DReadMisses:
+        return "L1d-read-misses";
+    case kLLCReadMisses:
+        return "LLC-read-misses";
+    default:
+        return "unknown";
+    }
+}
+
+//
+// The hardware counters of the calling thread, by perf_event_open(). If a counter
+// can't be opened (not Linux, no PMU in the VM, or perf_event_paranoid), it's
+// not available and reads 0.
+//
+class PerfCounter {
+public:
+    typedef std::size_t size_type;
+
+private:
+    int             fds_[kMaxCounterType];
+    std::uint64_t   values_[kMaxCounterType];
+
+public:
+    PerfCounter() {
+        for (int i = 0; i < kMaxCounterType; i++) {
+            this->fds_[i] = -1;
+            this->values_[i] = 0;
+        }
+        this->open();
+    }
+
+    ~PerfCounter() {
+        this->close();
+    }
+
+    bool is_available(int type) const {
+        assert(type >= 0 && type < kMaxCounterType);
+        return (this->fds_[type] >= 0);
+    }
+
+    bool is_any_available() const {
+        for (int i = 0; i < kMaxCounterType; i++) {
+            if (this->fds_[i] >= 0)
+                return true;
+        }
+        return false;
+    }
+
+    std::uint64_t value(int type) const {
+        assert(type >= 0 && type < kMaxCounterType);
+        return this->values_[type];
+    }
+
+    void start() {
+#if PERF_COUNTER_USE_PERF_EVENT
+        for (int i = 0; i < kMaxCounterType; i++) {
+            this->values_[i] = 0;
+            if (this->fds_[i] >= 0) {
+                ::ioctl(this->fds_[i], PERF_EVENT_IOC_RESET, 0);
+                ::ioctl(this->fds_[i], PERF_EVENT_IOC_ENABLE, 0);
+            }
+        }
+#endif
+    }
+
+    void stop() {
+#if PERF_COUNTER_USE_PERF_EVENT
+        for (int i = 0; i < kMaxCounterType; i++) {
+            if (this->fds_[i] >= 0) {
+                ::ioctl(this->fds_[i], PERF_EVENT_IOC_DISABLE, 0);
+                std::uint64_t count = 0;
+                if (::read(this->fds_[i], &count, sizeof(count)) == (ssize_t)sizeof(count))
+                    this->values_[i] = count;
+            }
+        }
+#endif
+    }
+
+private:
+#if PERF_COUNTER_USE_PERF_EVENT
+    static int open_event(std::uint32_t type, std::uint64_t config) {
+        struct perf_event_attr attr;
+        std::memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = type;
+        attr.config = config;
+        attr.disabled = 1;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        return (int)::syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+    }
+
+    static std::uint64_t cache_config(std::uint64_t cache_id) {
+        return (cache_id | (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                (PERF_COUNT_HW_CACHE_RESULT_MISS << 16));
+    }
+#endif
+
+    void open() {
+#if PERF_COUNTER_USE_PERF_EVENT
+        this->fds_[kCycles] = open_event(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES);
+        this->fds_[kInstructions] = open_event(PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS);
+        this->fds_[kL1DReadMisses] = open_event(PERF_TYPE_HW_CACHE,
+                                                cache_config(PERF_COUNT_HW_CACHE_L1D));
+        this->fds_[kLLCReadMisses] = open_event(PERF_TYPE_HW_CACHE,
+                                                cache_config(PERF_COUNT_HW_CACHE_LL));
+#endif
+    }
+
+    void close() {
+#if PERF_COUNTER_USE_PERF_EVENT
+        for (int i = 0; i < kMaxCounterType; i++) {
+            if (this->fds_[i] >= 0) {
+                ::close(this->fds_[i]);
+                this->fds_[i] = -1;
+            }
+        }
+#endif
+    }
+
+    PerfCounter(const PerfCounter & src) = delete;
+    PerfCounter & operator = (const PerfCounter & rhs) = delete;
+};
+
+} // namespace perf_counter
+
+#endif // PERF_COUNTER_H
@@ -0,0 +1,291 @@
+
+#ifndef PIPE_IO_H
+#define PIPE_IO_H
+
+#if defined(_MSC_VER) && (_MSC_VER >= 1020)
+#pragma once
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <assert.h>
+
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "basic/stddef.h"
+
+#if defined(_WIN32) || defined(WIN32) || defined(OS_WINDOWS) || defined(_WINDOWS_)
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <io.h>
+#include <fcntl.h>
+#define PIPE_IO_USE_WIN32       1
+#else
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <sys/ioctl.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <unistd.h>
+#define PIPE_IO_USE_WIN32       0
+#endif
+
+#if defined(__linux__) && defined(F_SETPIPE_SZ) && defined(SPLICE_F_GIFT)
+#define PIPE_IO_USE_VMSPLICE    1
+#else
+#define PIPE_IO_USE_VMSPLICE    0
+#endif
+
+namespace pipe_io {
+
+static const std::size_t kPipeSize = 1024 * 1024;
+
+static inline
+bool is_stdio_name(const std::string & filename)
+{
+    return (filename == "-");
+}
+
+//
+// Move the stdout away for the output data, and point the fd 1 to stderr,
+// so the log of printf() can't be mixed into the data stream.
+//
+static inline
+int detach_stdout()
+{
+    ::fflush(stdout);
+#if PIPE_IO_USE_WIN32
+    int data_fd = ::_dup(1);
+    ::_dup2(2, 1);
+    ::_setmode(data_fd, _O_BINARY);
+#else
+    int data_fd = ::dup(1);
+    ::dup2(2, 1);
+#endif
+    return data_fd;
+}
+
+static inline
+bool is_pipe(int fd)
+{
+#if PIPE_IO_USE_WIN32
+    (void)fd;
+    return false;
+#else
+    struct stat st;
+    return (::fstat(fd, &st) == 0 && S_ISFIFO(st.st_mode));
+#endif
+}
+
+//
+// Enlarge the pipe buffer, return the actual pipe size, or 0 if it's not a pipe.
+//
+static inline
+std::size_t set_pipe_size(int fd, std::size_t pipe_size)
+{
+#if PIPE_IO_USE_VMSPLICE
+    if (!is_pipe(fd))
+        return 0;
+    // It's limited by /proc/sys/fs/pipe-max-size for the non-root users.
+    int ret = ::fcntl(fd, F_SETPIPE_SZ, (int)pipe_size);
+    if (ret < 0)
+        ret = ::fcntl(fd, F_GETPIPE_SZ);
+    return (ret > 0) ? (std::size_t)ret : 0;
+#else
+    (void)fd;
+    (void)pipe_size;
+    return 0;
+#endif
+}
+
+static inline
+std::ptrdiff_t read_fd(int fd, void * buf, std::size_t size)
+{
+    do {
+#if PIPE_IO_USE_WIN32
+        int readBytes = ::_read(fd, buf, (unsigned int)size);
+#else
+        ssize_t readBytes = ::read(fd, buf, size);
+#endif
+        if (readBytes >= 0 || errno != EINTR)
+            return (std::ptrdiff_t)readBytes;
+    } while (1);
+}
+
+static inline
+bool write_fd(int fd, const void * buf, std::size_t size)
+{
+    const char * data = (const char *)buf;
+    while (size > 0) {
+#if PIPE_IO_USE_WIN32
+        int written = ::_write(fd, data, (unsigned int)size);
+#else
+        ssize_t written = ::write(fd, data, size);
+#endif
+        if (written < 0) {
+            if (errno == EINTR)
+                continue;
+            return false;
+        }
+        data += written;
+        size -= (std::size_t)written;
+    }
+    return true;
+}
+
+//
+// Buffered output to a fd. If the fd is a pipe, the full buffers are passed to
+// the pipe by vmsplice(), the kernel references the pages instead of copying them.
+//
+// A spliced buffer can't be rewritten until the reader has consumed it. The buffers
+// are half of the pipe size, and there are 4 of them, when a buffer comes round again,
+// at least one pipe size of data has been spliced after it, so it has left the pipe.
+// Otherwise (after a short flush), wait until the unread bytes in the pipe show it.
+//
+class PipeWriter {
+public:
+    typedef std::size_t size_type;
+
+    static const size_type kBufferNum = 4;
+
+private:
+    int                         fd_;
+    bool                        use_vmsplice_;
+    size_type                   pipe_size_;
+    size_type                   buf_size_;
+    std::vector<std::string>    buffers_;
+    std::vector<std::uint64_t>  spliced_end_;
+    size_type                   buf_index_;
+    size_type                   buf_used_;
+    std::uint64_t               spliced_total_;
+    std::uint64_t               total_size_;
+
+public:
+    PipeWriter() : fd_(-1), use_vmsplice_(false), pipe_size_(0), buf_size_(0),
+                   buf_index_(0), buf_used_(0), spliced_total_(0), total_size_(0) {
+    }
+
+    ~PipeWriter() {
+        this->flush();
+    }
+
+    bool use_vmsplice() const { return this->use_vmsplice_; }
+    size_type pipe_size() const { return this->pipe_size_; }
+    std::uint64_t total_size() const { return this->total_size_; }
+
+    void open(int fd, size_type pipe_size = kPipeSize) {
+        this->fd_ = fd;
+        this->pipe_size_ = set_pipe_size(fd, pipe_size);
+#if PIPE_IO_USE_VMSPLICE
+        this->use_vmsplice_ = (this->pipe_size_ != 0);
+#endif
+        this->buf_size_ = this->use_vmsplice_ ? (this->pipe_size_ / 2) : pipe_size;
+        this->buffers_.resize(this->use_vmsplice_ ? kBufferNum : 1);
+        this->spliced_end_.assign(this->buffers_.size(), 0);
+        for (auto iter = this->buffers_.begin(); iter != this->buffers_.end(); ++iter) {
+            iter->resize(this->buf_size_);
+        }
+        this->buf_index_ = 0;
+        this->buf_used_ = 0;
+        this->spliced_total_ = 0;
+        this->total_size_ = 0;
+    }
+
+    bool write(const char * data, size_type size) {
+        while (size > 0) {
+            size_type copy_size = this->buf_size_ - this->buf_used_;
+            if (copy_size > size)
+                copy_size = size;
+            std::memcpy(&this->buffers_[this->buf_index_][this->buf_used_], data, copy_size);
+            this->buf_used_ += copy_size;
+            data += copy_size;
+            size -= copy_size;
+            if (this->buf_used_ == this->buf_size_) {
+                if (!this->flush())
+                    return false;
+            }
+        }
+        return true;
+    }
+
+    bool flush() {
+        if (this->buf_used_ == 0)
+            return true;
+
+        const char * data = this->buffers_[this->buf_index_].c_str();
+        size_type size = this->buf_used_;
+        bool succeeded;
+#if PIPE_IO_USE_VMSPLICE
+        if (this->use_vmsplice_)
+            succeeded = this->vmsplice_all(data, size);
+        else
+#endif
+            succeeded = write_fd(this->fd_, data, size);
+
+        this->total_size_ += size;
+        this->buf_used_ = 0;
+        if (this->use_vmsplice_) {
+            this->spliced_end_[this->buf_index_] = this->spliced_total_;
+            this->buf_index_ = (this->buf_index_ + 1) % this->buffers_.size();
+#if PIPE_IO_USE_VMSPLICE
+            this->wait_consumed(this->buf_index_);
+#endif
+        }
+        return succeeded;
+    }
+
+private:
+#if PIPE_IO_USE_VMSPLICE
+    void wait_consumed(size_type buf_index) {
+        std::uint64_t spliced_end = this->spliced_end_[buf_index];
+        if (spliced_end == 0)
+            return;
+        std::uint64_t spliced_after = this->spliced_total_ - spliced_end;
+        if (likely(spliced_after >= this->pipe_size_))
+            return;
+        do {
+            int unread = 0;
+            if (::ioctl(this->fd_, FIONREAD, &unread) != 0)
+                break;
+            if ((std::uint64_t)unread <= spliced_after)
+                break;
+            ::sched_yield();
+        } while (1);
+    }
+
+    bool vmsplice_all(const char * data, size_type size) {
+        while (size > 0) {
+            struct iovec iov;
+            iov.iov_base = (void *)data;
+            iov.iov_len = size;
+            ssize_t spliced = ::vmsplice(this->fd_, &iov, 1, 0);
+            if (spliced < 0) {
+                if (errno == EINTR)
+                    continue;
+                return false;
+            }
+            data += spliced;
+            size -= (size_type)spliced;
+            this->spliced_total_ += (std::uint64_t)spliced;
+        }
+        return true;
+    }
+#endif
+
+    PipeWriter(const PipeWriter & src) = delete;
+    PipeWriter & operator = (const PipeWriter & rhs) = delete;
+};
+
+} // namespace pipe_io
+
+#endif // PIPE_IO_H
@@ -0,0 +1,286 @@
+
+#ifndef RING_QUEUE_H
+#define RING_QUEUE_H
+
+#if defined(_MSC_VER) && (_MSC_VER >= 1020)
+#pragma once
+#endif
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <assert.h>
+
+#include <cstdint>
+#include <cstddef>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <utility>
+
+#include "basic/stddef.h"
+
+#ifndef CACHE_LINE_SIZE
+#define CACHE_LINE_SIZE     64
+#endif
+
+namespace detail {
+
+static inline
+std::size_t round_up_pow2(std::size_t n)
+{
+    std::size_t pow2 = 2;
+    while (pow2 < n)
+        pow2 <<= 1;
+    return pow2;
+}
+
+//
+// The waiting side of a ring queue: spin a bounded number of times, then park
+// on a condition variable until the other side pops or pushes an item.
+// If no thread is parked, notify() is only a fence and a load.
+//
+class RingWaiter {
+public:
+    static const std::uint32_t kSpinCount = 64;
+
+private:
+    std::atomic<std::uint32_t>  waiters_;
+    std::mutex                  mutex_;
+    std::condition_variable     cond_;
+
+public:
+    RingWaiter() : waiters_(0) {}
+    ~RingWaiter() {}
+
+    template <typename TryOnce>
+    void wait(TryOnce try_once) {
+        for (std::uint32_t i = 0; i < kSpinCount; i++) {
+            if (try_once())
+                return;
+            std::this_thread::yield();
+        }
+
+        std::unique_lock<std::mutex> lock(this->mutex_);
+        this->waiters_.fetch_add(1, std::memory_order_seq_cst);
+        while (!try_once()) {
+            this->cond_.wait(lock);
+        }
+        this->waiters_.fetch_sub(1, std::memory_order_relaxed);
+    }
+
+    void notify() {
+        // Pairs with the fetch_add() in wait(), either the waiter sees the new
+        // head or tail, or we see the waiter.
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (unlikely(this->waiters_.load(std::memory_order_relaxed) != 0)) {
+            std::lock_guard<std::mutex> lock(this->mutex_);
+            this->cond_.notify_all();
+        }
+    }
+};
+
+} // namespace detail
+
+//
+// Bounded single producer, single consumer lock-free ring queue.
+//
+template <typename T>
+class SpscRingQueue {
+public:
+    typedef T           value_type;
+    typedef std::size_t size_type;
+
+private:
+    alignas(CACHE_LINE_SIZE) std::atomic<size_type> head_;
+    alignas(CACHE_LINE_SIZE) std::atomic<size_type> tail_;
+    alignas(CACHE_LINE_SIZE) size_type mask_;
+    std::unique_ptr<value_type[]> items_;
+    ::detail::RingWaiter waiter_;
+
+public:
+    SpscRingQueue(size_type capacity) : head_(0), tail_(0) {
+        capacity = ::detail::round_up_pow2(capacity);
+        this->mask_ = capacity - 1;
+        this->items_.reset(new value_type[capacity]);
+    }
+
+    ~SpscRingQueue() {}
+
+    size_type capacity() const {
+        return (this->mask_ + 1);
+    }
+
+    size_type size() const {
+        return (this->tail_.load(std::memory_order_acquire) -
+                this->head_.load(std::memory_order_acquire));
+    }
+
+    bool is_empty() const {
+        return (this->size() == 0);
+    }
+
+    bool push(const value_type & item) {
+        if (this->try_push(item)) {
+            this->waiter_.notify();
+            return true;
+        }
+        return false;
+    }
+
+    bool pop(value_type & item) {
+        if (this->try_pop(item)) {
+            this->waiter_.notify();
+            return true;
+        }
+        return false;
+    }
+
+    void push_wait(const value_type & item) {
+        this->waiter_.wait([&]() { return this->try_push(item); });
+        this->waiter_.notify();
+    }
+
+    void pop_wait(value_type & item) {
+        this->waiter_.wait([&]() { return this->try_pop(item); });
+        this->waiter_.notify();
+    }
+
+private:
+    bool try_push(const value_type & item) {
+        size_type tail = this->tail_.load(std::memory_order_relaxed);
+        size_type head = this->head_.load(std::memory_order_acquire);
+        if (unlikely((tail - head) > this->mask_))
+            return false;
+        this->items_[tail & this->mask_] = item;
+        this->tail_.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool try_pop(value_type & item) {
+        size_type head = this->head_.load(std::memory_order_relaxed);
+        size_type tail = this->tail_.load(std::memory_order_acquire);
+        if (unlikely(head == tail))
+            return false;
+        item = this->items_[head & this->mask_];
+        this->head_.store(head + 1, std::memory_order_release);
+        return true;
+    }
+};
+
+//
+// Bounded multiple producer, multiple consumer lock-free ring queue.
+//
+// See: https://www.1024cores.net/home/lock-free-algorithms/queues/bounded-mpmc-queue
+//
+template <typename T>
+class MpmcRingQueue {
+public:
+    typedef T           value_type;
+    typedef std::size_t size_type;
+
+private:
+    struct Cell {
+        std::atomic<size_type>  sequence;
+        value_type              item;
+    };
+
+    alignas(CACHE_LINE_SIZE) std::atomic<size_type> head_;
+    alignas(CACHE_LINE_SIZE) std::atomic<size_type> tail_;
+    alignas(CACHE_LINE_SIZE) size_type mask_;
+    std::unique_ptr<Cell[]> cells_;
+    ::detail::RingWaiter waiter_;
+
+public:
+    MpmcRingQueue(size_type capacity) : head_(0), tail_(0) {
+        capacity = ::detail::round_up_pow2(capacity);
+        this->mask_ = capacity - 1;
+        this->cells_.reset(new Cell[capacity]);
+        for (size_type i = 0; i < capacity; i++) {
+            this->cells_[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    ~MpmcRingQueue() {}
+
+    size_type capacity() const {
+        return (this->mask_ + 1);
+    }
+
+    bool push(const value_type & item) {
+        if (this->try_push(item)) {
+            this->waiter_.notify();
+            return true;
+        }
+        return false;
+    }
+
+    bool pop(value_type & item) {
+        if (this->try_pop(item)) {
+            this->waiter_.notify();
+            return true;
+        }
+        return false;
+    }
+
+    void push_wait(const value_type & item) {
+        this->waiter_.wait([&]() { return this->try_push(item); });
+        this->waiter_.notify();
+    }
+
+    void pop_wait(value_type & item) {
+        this->waiter_.wait([&]() { return this->try_pop(item); });
+        this->waiter_.notify();
+    }
+
+private:
+    bool try_push(const value_type & item) {
+        Cell * cell;
+        size_type tail = this->tail_.load(std::memory_order_relaxed);
+        do {
+            cell = &this->cells_[tail & this->mask_];
+            size_type sequence = cell->sequence.load(std::memory_order_acquire);
+            std::intptr_t diff = (std::intptr_t)sequence - (std::intptr_t)tail;
+            if (likely(diff == 0)) {
+                if (this->tail_.compare_exchange_weak(tail, tail + 1, std::memory_order_relaxed))
+                    break;
+            } else if (diff < 0) {
+                // The queue is full
+                return false;
+            } else {
+                tail = this->tail_.load(std::memory_order_relaxed);
+            }
+        } while (1);
+
+        cell->item = item;
+        cell->sequence.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool try_pop(value_type & item) {
+        Cell * cell;
+        size_type head = this->head_.load(std::memory_order_relaxed);
+        do {
+            cell = &this->cells_[head & this->mask_];
+            size_type sequence = cell->sequence.load(std::memory_order_acquire);
+            std::intptr_t diff = (std::intptr_t)sequence - (std::intptr_t)(head + 1);
+            if (likely(diff == 0)) {
+                if (this->head_.compare_exchange_weak(head, head + 1, std::memory_order_relaxed))
+                    break;
+            } else if (diff < 0) {
+                // The queue is empty
+                return false;
+            } else {
+                head = this->head_.load(std::memory_order_relaxed);
+            }
+        } while (1);
+
+        item = cell->item;
+        cell->sequence.store(head + this->mask_ + 1, std::memory_order_release);
+        return true;
+    }
+};
+
+#endif // RING_QUEUE_H
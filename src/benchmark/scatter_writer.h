@@ -0,0 +1,221 @@
+
+#ifndef SCATTER_WRITER_H
+#define SCATTER_WRITER_H
+
+#if defined(_MSC_VER) && (_MSC_VER >= 1020)
+#pragma once
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <assert.h>
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <vector>
+
+#if defined(_WIN32) || defined(WIN32) || defined(OS_WINDOWS) || defined(_WINDOWS_)
+#define SCATTER_WRITER_USE_WRITEV   0
+#else
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <unistd.h>
+#define SCATTER_WRITER_USE_WRITEV   1
+#endif
+
+//
+// Gather the output as a list of (pointer, length) spans, and flush them with
+// one writev() call, the spans point to the unchanged input text or to the
+// replacement values, so the bytes are never copied by the CPU.
+//
+// All the spans must stay valid until the next flush().
+//
+class ScatterWriter {
+public:
+    typedef std::size_t size_type;
+
+#if SCATTER_WRITER_USE_WRITEV
+  #if defined(IOV_MAX)
+    static const size_type kMaxIovecs = IOV_MAX;
+  #else
+    static const size_type kMaxIovecs = 1024;
+  #endif
+    typedef struct iovec span_type;
+#else
+    static const size_type kMaxIovecs = 1024;
+    struct span_type {
+        void *      iov_base;
+        size_type   iov_len;
+    };
+#endif
+
+private:
+#if SCATTER_WRITER_USE_WRITEV
+    int                     fd_;
+#else
+    FILE *                  fp_;
+#endif
+    std::vector<span_type>  spans_;
+    size_type               pending_size_;
+    std::uint64_t           total_size_;
+    std::uint64_t           flush_count_;
+    std::uint64_t           span_count_;
+    bool                    failed_;
+
+public:
+    ScatterWriter() :
+#if SCATTER_WRITER_USE_WRITEV
+        fd_(-1),
+#else
+        fp_(nullptr),
+#endif
+        pending_size_(0), total_size_(0), flush_count_(0), span_count_(0), failed_(false) {
+        this->spans_.reserve(kMaxIovecs);
+    }
+
+    ~ScatterWriter() {
+        this->close();
+    }
+
+#if SCATTER_WRITER_USE_WRITEV
+    bool is_open() const { return (this->fd_ >= 0); }
+#else
+    bool is_open() const { return (this->fp_ != nullptr); }
+#endif
+
+    std::uint64_t total_size() const { return this->total_size_; }
+    std::uint64_t flush_count() const { return this->flush_count_; }
+    std::uint64_t span_count() const { return this->span_count_; }
+
+    // False after a write is failed, the next appends and flushes fail too.
+    bool good() const { return !this->failed_; }
+
+    bool open(const std::string & filename) {
+        this->close();
+#if SCATTER_WRITER_USE_WRITEV
+        this->fd_ = ::open(filename.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+#else
+        this->fp_ = ::fopen(filename.c_str(), "wb");
+#endif
+        this->total_size_ = 0;
+        this->flush_count_ = 0;
+        this->span_count_ = 0;
+        this->failed_ = false;
+        return this->is_open();
+    }
+
+    bool append(const void * data, size_type size) {
+        if (this->failed_)
+            return false;
+        if (size == 0)
+            return true;
+
+        // Merge the span which is adjacent to the last one.
+        if (!this->spans_.empty()) {
+            span_type & last = this->spans_.back();
+            if (((const char *)last.iov_base + last.iov_len) == (const char *)data) {
+                last.iov_len += size;
+                this->pending_size_ += size;
+                return true;
+            }
+        }
+
+        if (this->spans_.size() >= kMaxIovecs) {
+            if (!this->flush())
+                return false;
+        }
+
+        span_type span;
+        span.iov_base = (void *)data;
+        span.iov_len = size;
+        this->spans_.push_back(span);
+        this->pending_size_ += size;
+        this->span_count_++;
+        return true;
+    }
+
+    bool flush() {
+        if (this->failed_)
+            return false;
+        if (this->spans_.empty())
+            return true;
+
+        bool succeeded = true;
+#if SCATTER_WRITER_USE_WRITEV
+        span_type * spans = &this->spans_[0];
+        int count = (int)this->spans_.size();
+        while (count > 0) {
+            ssize_t written = ::writev(this->fd_, spans, count);
+            if (written < 0) {
+                if (errno == EINTR)
+                    continue;
+                succeeded = false;
+                break;
+            }
+            this->flush_count_++;
+
+            // Skip the spans that have been written, and continue the short write.
+            size_type bytes = (size_type)written;
+            while (count > 0 && bytes >= spans->iov_len) {
+                bytes -= spans->iov_len;
+                spans++;
+                count--;
+            }
+            if (count > 0) {
+                spans->iov_base = (void *)((char *)spans->iov_base + bytes);
+                spans->iov_len -= bytes;
+            }
+        }
+#else
+        for (auto iter = this->spans_.begin(); iter != this->spans_.end(); ++iter) {
+            if (::fwrite(iter->iov_base, 1, iter->iov_len, this->fp_) != iter->iov_len) {
+                succeeded = false;
+                break;
+            }
+        }
+        this->flush_count_++;
+#endif
+        if (succeeded)
+            this->total_size_ += this->pending_size_;
+        else
+            this->failed_ = true;
+        this->pending_size_ = 0;
+        this->spans_.clear();
+        return succeeded;
+    }
+
+    //
+    // Flush the pending spans and close the file, return false if any write is failed.
+    //
+    bool close() {
+        if (this->is_open()) {
+            bool succeeded = this->flush();
+#if SCATTER_WRITER_USE_WRITEV
+            if (::close(this->fd_) != 0)
+                succeeded = false;
+            this->fd_ = -1;
+#else
+            if (::fclose(this->fp_) != 0)
+                succeeded = false;
+            this->fp_ = nullptr;
+#endif
+            return succeeded;
+        }
+        return !this->failed_;
+    }
+
+private:
+    ScatterWriter(const ScatterWriter & src) = delete;
+    ScatterWriter & operator = (const ScatterWriter & rhs) = delete;
+};
+
+#endif // SCATTER_WRITER_H
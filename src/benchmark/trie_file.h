@@ -0,0 +1,570 @@
+
+#ifndef TRIE_FILE_H
+#define TRIE_FILE_H
+
+#if defined(_MSC_VER) && (_MSC_VER >= 1020)
+#pragma once
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <string.h>
+#include <assert.h>
+
+#include <cstdio>
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <list>
+#include <memory>
+#include <utility>
+#include <algorithm>
+#include <unordered_map>
+#include <type_traits>
+
+#include "basic/stddef.h"
+#include "mmap_file.h"
+
+#if defined(_WIN32) || defined(WIN32) || defined(OS_WINDOWS) || defined(_WINDOWS_)
+#include <process.h>
+#else
+#include <unistd.h>
+#endif
+
+//
+// The binary file of a built trie:
+//
+//   FileHeader (64 bytes) | SectionEntry x section_count | sections ...
+//
+// The sections are the raw state arrays, every one is aligned to 64 bytes, and
+// all the offsets are from the file begin, so the file is position-independent:
+// it can be mapped read-only and the arrays are used in place, without fix-ups.
+// The checksum covers all the bytes after the header.
+//
+namespace trie_file {
+
+static const char           kMagic[8] = { 'T', 'R', 'I', 'E', 'F', 'I', 'L', 'E' };
+static const std::uint32_t  kFormatVersion = 1;
+static const std::uint32_t  kByteOrderMark = 0x01020304u;
+static const std::size_t    kSectionAlignment = 64;
+static const std::size_t    kMaxKindLength = 16;
+
+#pragma pack(push, 1)
+
+struct FileHeader {
+    char            magic[8];
+    std::uint32_t   version;
+    std::uint32_t   byte_order;
+    char            kind[kMaxKindLength];
+    std::uint32_t   section_count;
+    std::uint32_t   reserve;
+    std::uint64_t   file_size;
+    std::uint64_t   checksum;
+    std::uint64_t   dict_hash;
+};
+
+struct SectionEntry {
+    std::uint32_t   id;
+    std::uint32_t   elem_size;
+    std::uint64_t   offset;
+    std::uint64_t   count;
+};
+
+#pragma pack(pop)
+
+static_assert(sizeof(FileHeader) == 64, "trie_file::FileHeader must be 64 bytes");
+
+static inline
+std::uint64_t hash_mix(std::uint64_t hash, std::uint64_t value)
+{
+    hash ^= value;
+    hash *= 0x9E3779B97F4A7C15ull;
+    hash ^= (hash >> 29);
+    return hash;
+}
+
+//
+// A 64-bit hash of 8 bytes words, it's only used to find the broken or
+// truncated files, not the malicious ones.
+//
+static inline
+std::uint64_t hash_bytes(std::uint64_t hash, const void * data, std::size_t size)
+{
+    const char * bytes = (const char *)data;
+    std::size_t words = size / sizeof(std::uint64_t);
+    for (std::size_t i = 0; i < words; i++) {
+        std::uint64_t word;
+        std::memcpy(&word, bytes + i * sizeof(std::uint64_t), sizeof(word));
+        hash = hash_mix(hash, word);
+    }
+    std::size_t tail = size % sizeof(std::uint64_t);
+    if (tail != 0) {
+        std::uint64_t word = 0;
+        std::memcpy(&word, bytes + words * sizeof(std::uint64_t), tail);
+        hash = hash_mix(hash, word);
+    }
+    return hash_mix(hash, (std::uint64_t)size);
+}
+
+//
+// The hash of the dictionary keys in order, the trie only depends on them.
+//
+static inline
+std::uint64_t hash_dict(const std::vector<std::pair<std::string, int>> & dict_list)
+{
+    std::uint64_t hash = 0x6A09E667F3BCC908ull;
+    for (auto iter = dict_list.begin(); iter != dict_list.end(); ++iter) {
+        const std::string & key = iter->first;
+        hash = hash_bytes(hash, key.c_str(), key.size());
+    }
+    return hash_mix(hash, (std::uint64_t)dict_list.size());
+}
+
+//
+// An array which owns its elements like std::vector<T>, or is a read-only view
+// of the elements in a mapped trie file. Any resizing of a view copies it first,
+// but the elements of a view must not be written through operator [].
+//
+template <typename T>
+class MappedVector {
+public:
+    typedef T                   value_type;
+    typedef std::size_t         size_type;
+    typedef T *                 iterator;
+    typedef const T *           const_iterator;
+
+    static_assert(std::is_trivially_copyable<T>::value,
+                  "trie_file::MappedVector<T> needs a trivially copyable T");
+
+private:
+    T *             data_;
+    size_type       size_;
+    bool            is_view_;
+    std::vector<T>  vector_;
+
+public:
+    MappedVector() : data_(nullptr), size_(0), is_view_(false) {}
+
+    MappedVector(const MappedVector & src)
+        : data_(nullptr), size_(0), is_view_(src.is_view_), vector_(src.vector_) {
+        if (src.is_view_) {
+            this->data_ = src.data_;
+            this->size_ = src.size_;
+        } else {
+            this->sync();
+        }
+    }
+
+    MappedVector & operator = (const MappedVector & rhs) {
+        if (&rhs != this) {
+            this->vector_ = rhs.vector_;
+            this->is_view_ = rhs.is_view_;
+            if (rhs.is_view_) {
+                this->data_ = rhs.data_;
+                this->size_ = rhs.size_;
+            } else {
+                this->sync();
+            }
+        }
+        return *this;
+    }
+
+    ~MappedVector() {}
+
+    T * data() { return this->data_; }
+    const T * data() const { return this->data_; }
+
+    size_type size() const { return this->size_; }
+    bool empty() const { return (this->size_ == 0); }
+    bool is_view() const { return this->is_view_; }
+
+    iterator begin() { return this->data_; }
+    iterator end() { return (this->data_ + this->size_); }
+    const_iterator begin() const { return this->data_; }
+    const_iterator end() const { return (this->data_ + this->size_); }
+
+    T & operator [] (size_type index) {
+        assert(index < this->size_);
+        return this->data_[index];
+    }
+
+    const T & operator [] (size_type index) const {
+        assert(index < this->size_);
+        return this->data_[index];
+    }
+
+    void clear() {
+        this->is_view_ = false;
+        this->vector_.clear();
+        this->sync();
+    }
+
+    //
+    // Release the unused memory, a view is released by clear().
+    //
+    void shrink_to_fit() {
+        if (!this->is_view_) {
+            this->vector_.shrink_to_fit();
+            this->sync();
+        }
+    }
+
+    void reserve(size_type capacity) {
+        this->detach();
+        this->vector_.reserve(capacity);
+        this->sync();
+    }
+
+    void resize(size_type new_size) {
+        this->detach();
+        this->vector_.resize(new_size);
+        this->sync();
+    }
+
+    void resize(size_type new_size, const T & value) {
+        this->detach();
+        this->vector_.resize(new_size, value);
+        this->sync();
+    }
+
+    void push_back(const T & value) {
+        this->detach();
+        this->vector_.push_back(value);
+        this->sync();
+    }
+
+    void push_back(T && value) {
+        this->detach();
+        this->vector_.push_back(std::forward<T>(value));
+        this->sync();
+    }
+
+    void assign(const T * first, size_type count) {
+        this->is_view_ = false;
+        this->vector_.assign(first, first + count);
+        this->sync();
+    }
+
+    //
+    // Use the elements in place, the memory must live longer than this view.
+    //
+    void attach(const T * data, size_type count) {
+        this->vector_.clear();
+        this->vector_.shrink_to_fit();
+        this->data_ = const_cast<T *>(data);
+        this->size_ = count;
+        this->is_view_ = true;
+    }
+
+    //
+    // Copy a view into its own memory, then the elements can be written.
+    //
+    void detach() {
+        if (this->is_view_) {
+            this->vector_.assign(this->data_, this->data_ + this->size_);
+            this->is_view_ = false;
+            this->sync();
+        }
+    }
+
+private:
+    void sync() {
+        this->data_ = this->vector_.data();
+        this->size_ = this->vector_.size();
+    }
+};
+
+//
+// Write the sections of a trie into a file. The file is written to a temporary
+// name and then renamed, so the other processes never see a partial file.
+//
+class Writer {
+public:
+    typedef std::size_t size_type;
+
+private:
+    struct Section {
+        std::uint32_t   id;
+        std::uint32_t   elem_size;
+        const void *    data;
+        std::uint64_t   count;
+    };
+
+    std::string             kind_;
+    std::uint64_t           dict_hash_;
+    std::vector<Section>    sections_;
+    std::list<std::string>  buffers_;
+
+public:
+    Writer(const char * kind, std::uint64_t dict_hash)
+        : kind_(kind), dict_hash_(dict_hash) {
+        assert(this->kind_.size() < kMaxKindLength);
+    }
+
+    ~Writer() {}
+
+    void add(std::uint32_t id, const void * data, size_type elem_size, size_type count) {
+        Section section;
+        section.id = id;
+        section.elem_size = (std::uint32_t)elem_size;
+        section.data = data;
+        section.count = (std::uint64_t)count;
+        this->sections_.push_back(section);
+    }
+
+    template <typename T>
+    void add(std::uint32_t id, const MappedVector<T> & array) {
+        this->add(id, array.data(), sizeof(T), array.size());
+    }
+
+    template <typename T>
+    void add(std::uint32_t id, const std::vector<T> & array) {
+        this->add(id, array.data(), sizeof(T), array.size());
+    }
+
+    //
+    // The hash maps are written as the arrays of (key, value) sorted by key.
+    //
+    template <typename Key, typename Value>
+    void add(std::uint32_t id, const std::unordered_map<Key, Value> & map) {
+        typedef std::pair<Key, Value> pair_type;
+        std::vector<pair_type> pairs(map.begin(), map.end());
+        std::sort(pairs.begin(), pairs.end());
+        std::string buffer;
+        buffer.resize(pairs.size() * (sizeof(Key) + sizeof(Value)));
+        char * dest = &buffer[0];
+        for (auto iter = pairs.begin(); iter != pairs.end(); ++iter) {
+            std::memcpy(dest, &iter->first, sizeof(Key));
+            std::memcpy(dest + sizeof(Key), &iter->second, sizeof(Value));
+            dest += sizeof(Key) + sizeof(Value);
+        }
+        this->buffers_.push_back(std::move(buffer));
+        this->add(id, this->buffers_.back().data(), sizeof(Key) + sizeof(Value), pairs.size());
+    }
+
+    bool save(const std::string & path) {
+        std::string content;
+        this->serialize(content);
+
+        std::string temp_path = path + ".tmp." + std::to_string(get_process_id());
+        std::ofstream ofs;
+        ofs.open(temp_path, std::ios::out | std::ios::binary | std::ios::trunc);
+        if (!ofs.good())
+            return false;
+        ofs.write(content.c_str(), (std::streamsize)content.size());
+        ofs.close();
+        if (!ofs.good()) {
+            std::remove(temp_path.c_str());
+            return false;
+        }
+#if defined(_WIN32) || defined(WIN32) || defined(OS_WINDOWS) || defined(_WINDOWS_)
+        std::remove(path.c_str());
+#endif
+        if (std::rename(temp_path.c_str(), path.c_str()) != 0) {
+            std::remove(temp_path.c_str());
+            return false;
+        }
+        return true;
+    }
+
+private:
+    static int get_process_id() {
+#if defined(_WIN32) || defined(WIN32) || defined(OS_WINDOWS) || defined(_WINDOWS_)
+        return (int)::_getpid();
+#else
+        return (int)::getpid();
+#endif
+    }
+
+    static size_type align_up(size_type offset) {
+        return ((offset + kSectionAlignment - 1) & ~(kSectionAlignment - 1));
+    }
+
+    void serialize(std::string & content) {
+        size_type table_size = this->sections_.size() * sizeof(SectionEntry);
+        size_type offset = align_up(sizeof(FileHeader) + table_size);
+
+        std::vector<SectionEntry> entries;
+        for (auto iter = this->sections_.begin(); iter != this->sections_.end(); ++iter) {
+            SectionEntry entry;
+            entry.id = iter->id;
+            entry.elem_size = iter->elem_size;
+            entry.offset = (std::uint64_t)offset;
+            entry.count = iter->count;
+            entries.push_back(entry);
+            offset = align_up(offset + (size_type)(iter->elem_size * iter->count));
+        }
+
+        content.assign(offset, '\0');
+        if (!entries.empty()) {
+            std::memcpy(&content[sizeof(FileHeader)], entries.data(), table_size);
+        }
+        for (size_type i = 0; i < this->sections_.size(); i++) {
+            const Section & section = this->sections_[i];
+            size_type bytes = (size_type)(section.elem_size * section.count);
+            if (bytes != 0) {
+                std::memcpy(&content[(size_type)entries[i].offset], section.data, bytes);
+            }
+        }
+
+        FileHeader header;
+        std::memset(&header, 0, sizeof(header));
+        std::memcpy(header.magic, kMagic, sizeof(header.magic));
+        header.version = kFormatVersion;
+        header.byte_order = kByteOrderMark;
+        std::memcpy(header.kind, this->kind_.c_str(), this->kind_.size());
+        header.section_count = (std::uint32_t)this->sections_.size();
+        header.file_size = (std::uint64_t)content.size();
+        header.checksum = hash_bytes(0, content.c_str() + sizeof(FileHeader),
+                                     content.size() - sizeof(FileHeader));
+        header.dict_hash = this->dict_hash_;
+        std::memcpy(&content[0], &header, sizeof(header));
+    }
+
+    Writer(const Writer & src) = delete;
+    Writer & operator = (const Writer & rhs) = delete;
+};
+
+//
+// Open a trie file, the file is mapped read-only (the processes share the page
+// cache copy), or read into the memory. The sections are used in place.
+//
+class Reader {
+public:
+    typedef std::size_t size_type;
+
+private:
+    MmapFile            map_;
+    std::string         buffer_;
+    const char *        data_;
+    size_type           size_;
+    const FileHeader *  header_;
+    const SectionEntry * sections_;
+
+public:
+    Reader() : data_(nullptr), size_(0), header_(nullptr), sections_(nullptr) {}
+    ~Reader() {}
+
+    const FileHeader & header() const {
+        assert(this->header_ != nullptr);
+        return *this->header_;
+    }
+
+    bool open(const std::string & path, const char * kind,
+              bool use_mmap = true, bool verify = true) {
+        if (use_mmap) {
+            if (!this->map_.open(path, MmapFile::Random))
+                return false;
+            this->data_ = this->map_.data();
+            this->size_ = this->map_.size();
+        } else {
+            std::ifstream ifs;
+            ifs.open(path, std::ios::in | std::ios::binary);
+            if (!ifs.good())
+                return false;
+            ifs.seekg(0, std::ios::end);
+            std::streamoff file_size = ifs.tellg();
+            ifs.seekg(0, std::ios::beg);
+            if (file_size <= 0)
+                return false;
+            this->buffer_.resize((size_type)file_size);
+            ifs.read(&this->buffer_[0], file_size);
+            if (!ifs.good())
+                return false;
+            this->data_ = this->buffer_.c_str();
+            this->size_ = this->buffer_.size();
+        }
+
+        if (this->data_ == nullptr || this->size_ < sizeof(FileHeader))
+            return false;
+
+        const FileHeader * header = (const FileHeader *)this->data_;
+        if (std::memcmp(header->magic, kMagic, sizeof(header->magic)) != 0 ||
+            header->version != kFormatVersion ||
+            header->byte_order != kByteOrderMark ||
+            header->file_size != (std::uint64_t)this->size_ ||
+            std::strncmp(header->kind, kind, kMaxKindLength) != 0) {
+            return false;
+        }
+        size_type table_end = sizeof(FileHeader) + header->section_count * sizeof(SectionEntry);
+        if (table_end > this->size_)
+            return false;
+        if (verify) {
+            std::uint64_t checksum = hash_bytes(0, this->data_ + sizeof(FileHeader),
+                                                this->size_ - sizeof(FileHeader));
+            if (checksum != header->checksum)
+                return false;
+        }
+
+        this->header_ = header;
+        this->sections_ = (const SectionEntry *)(this->data_ + sizeof(FileHeader));
+        for (std::uint32_t i = 0; i < header->section_count; i++) {
+            const SectionEntry & entry = this->sections_[i];
+            if ((entry.offset % kSectionAlignment) != 0 ||
+                entry.offset + (std::uint64_t)entry.elem_size * entry.count > (std::uint64_t)this->size_)
+                return false;
+        }
+        return true;
+    }
+
+    const SectionEntry * find(std::uint32_t id, size_type elem_size) const {
+        for (std::uint32_t i = 0; i < this->header_->section_count; i++) {
+            const SectionEntry & entry = this->sections_[i];
+            if (entry.id == id)
+                return (entry.elem_size == (std::uint32_t)elem_size) ? &entry : nullptr;
+        }
+        return nullptr;
+    }
+
+    template <typename T>
+    bool attach(std::uint32_t id, MappedVector<T> & array) const {
+        const SectionEntry * entry = this->find(id, sizeof(T));
+        if (entry == nullptr)
+            return false;
+        array.attach((const T *)(this->data_ + entry->offset), (size_type)entry->count);
+        return true;
+    }
+
+    template <typename T>
+    bool read(std::uint32_t id, std::vector<T> & array) const {
+        const SectionEntry * entry = this->find(id, sizeof(T));
+        if (entry == nullptr)
+            return false;
+        const T * first = (const T *)(this->data_ + entry->offset);
+        array.assign(first, first + (size_type)entry->count);
+        return true;
+    }
+
+    template <typename Key, typename Value>
+    bool read(std::uint32_t id, std::unordered_map<Key, Value> & map) const {
+        const SectionEntry * entry = this->find(id, sizeof(Key) + sizeof(Value));
+        if (entry == nullptr)
+            return false;
+        map.clear();
+        const char * src = this->data_ + entry->offset;
+        for (std::uint64_t i = 0; i < entry->count; i++) {
+            Key key;
+            Value value;
+            std::memcpy(&key, src, sizeof(Key));
+            std::memcpy(&value, src + sizeof(Key), sizeof(Value));
+            map.insert(std::make_pair(key, value));
+            src += sizeof(Key) + sizeof(Value);
+        }
+        return true;
+    }
+
+private:
+    Reader(const Reader & src) = delete;
+    Reader & operator = (const Reader & rhs) = delete;
+};
+
+} // namespace trie_file
+
+#endif // TRIE_FILE_H
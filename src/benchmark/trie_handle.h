@@ -0,0 +1,238 @@
+
+#ifndef TRIE_HANDLE_H
+#define TRIE_HANDLE_H
+
+#if defined(_MSC_VER) && (_MSC_VER >= 1020)
+#pragma once
+#endif
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <assert.h>
+
+#include <cstdint>
+#include <cstddef>
+#include <atomic>
+#include <memory>
+#include <new>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <utility>
+
+#include "basic/stddef.h"
+
+#ifndef CACHE_LINE_SIZE
+#define CACHE_LINE_SIZE     64
+#endif
+
+//
+// The handle of the active trie, it can be swapped in a running process.
+//
+// The readers are lock-free: a reader publishes the global epoch in its own slot
+// on enter, loads the trie pointer and clears the slot on leave. The writer
+// stores the new pointer, bumps the epoch and retires the old trie, which is
+// deleted when no reader slot holds an epoch older than the swap. The readers
+// only match on the trie, a published trie is never changed.
+//
+template <typename TrieT>
+class TrieHandle {
+public:
+    typedef TrieT       trie_type;
+    typedef std::size_t size_type;
+
+    static const std::uint64_t kQuiescent = 0;
+
+private:
+    // One cache line per reader.
+    struct ReaderSlot {
+        std::atomic<std::uint64_t> epoch;
+        char padding[CACHE_LINE_SIZE - sizeof(std::atomic<std::uint64_t>)];
+
+        ReaderSlot() : epoch(kQuiescent) {}
+    };
+
+    struct RetiredTrie {
+        trie_type *     trie;
+        std::uint64_t   epoch;
+    };
+
+    alignas(CACHE_LINE_SIZE) std::atomic<trie_type *> trie_;
+    alignas(CACHE_LINE_SIZE) std::atomic<std::uint64_t> epoch_;
+    alignas(CACHE_LINE_SIZE) std::atomic<size_type> reader_count_;
+    size_type max_readers_;
+    ReaderSlot * slots_;
+    std::unique_ptr<char[]> slot_buf_;
+
+    std::mutex writer_mutex_;
+    std::vector<RetiredTrie> retired_list_;
+
+public:
+    //
+    // The scoped read access of one reader, the trie is alive until it's destroyed.
+    //
+    class ReadGuard {
+    private:
+        TrieHandle *        handle_;
+        size_type           reader_id_;
+        trie_type *         trie_;
+
+    public:
+        ReadGuard(TrieHandle & handle, size_type reader_id)
+            : handle_(&handle), reader_id_(reader_id) {
+            this->trie_ = handle.enter(reader_id);
+        }
+
+        ~ReadGuard() {
+            this->handle_->leave(this->reader_id_);
+        }
+
+        trie_type * get() const { return this->trie_; }
+
+        trie_type & operator * () const { return *this->trie_; }
+        trie_type * operator -> () const { return this->trie_; }
+
+    private:
+        ReadGuard(const ReadGuard & src) = delete;
+        ReadGuard & operator = (const ReadGuard & rhs) = delete;
+    };
+
+    TrieHandle(trie_type * trie, size_type max_readers = 64)
+        : trie_(trie), epoch_(1), reader_count_(0), max_readers_(max_readers) {
+        assert(max_readers > 0);
+        // The new of an over-aligned type needs C++17, so align the slots by hand.
+        this->slot_buf_.reset(new char[sizeof(ReaderSlot) * max_readers + CACHE_LINE_SIZE]);
+        std::uintptr_t slot_addr = (std::uintptr_t)this->slot_buf_.get();
+        slot_addr = (slot_addr + CACHE_LINE_SIZE - 1) & ~(std::uintptr_t)(CACHE_LINE_SIZE - 1);
+        this->slots_ = (ReaderSlot *)slot_addr;
+        for (size_type i = 0; i < max_readers; i++) {
+            new (&this->slots_[i]) ReaderSlot();
+        }
+    }
+
+    ~TrieHandle() {
+        // All the readers must have left.
+        std::lock_guard<std::mutex> lock(this->writer_mutex_);
+        for (auto iter = this->retired_list_.begin(); iter != this->retired_list_.end(); ++iter) {
+            delete iter->trie;
+        }
+        this->retired_list_.clear();
+        delete this->trie_.load(std::memory_order_relaxed);
+
+        for (size_type i = 0; i < this->max_readers_; i++) {
+            this->slots_[i].~ReaderSlot();
+        }
+    }
+
+    size_type max_readers() const {
+        return this->max_readers_;
+    }
+
+    std::uint64_t epoch() const {
+        return this->epoch_.load(std::memory_order_acquire);
+    }
+
+    size_type retired_count() {
+        std::lock_guard<std::mutex> lock(this->writer_mutex_);
+        return this->retired_list_.size();
+    }
+
+    //
+    // Every reader thread takes its own slot once, return -1 if the slots are used up.
+    //
+    size_type register_reader() {
+        size_type reader_id = this->reader_count_.fetch_add(1);
+        if (likely(reader_id < this->max_readers_))
+            return reader_id;
+        this->reader_count_.fetch_sub(1);
+        return size_type(-1);
+    }
+
+    trie_type * enter(size_type reader_id) {
+        assert(reader_id < this->max_readers_);
+        ReaderSlot & slot = this->slots_[reader_id];
+        assert(slot.epoch.load(std::memory_order_relaxed) == kQuiescent);
+        // The slot store must be visible before the trie load, see swap().
+        slot.epoch.store(this->epoch_.load(std::memory_order_seq_cst), std::memory_order_seq_cst);
+        return this->trie_.load(std::memory_order_seq_cst);
+    }
+
+    void leave(size_type reader_id) {
+        assert(reader_id < this->max_readers_);
+        this->slots_[reader_id].epoch.store(kQuiescent, std::memory_order_release);
+    }
+
+    //
+    // Publish the new trie, the old one is retired and deleted by reclaim()
+    // after the readers that may hold it have left.
+    //
+    void swap(trie_type * new_trie) {
+        assert(new_trie != nullptr);
+        std::lock_guard<std::mutex> lock(this->writer_mutex_);
+        trie_type * old_trie = this->trie_.exchange(new_trie, std::memory_order_seq_cst);
+        // The readers entered at this epoch or later have seen new_trie.
+        std::uint64_t epoch = this->epoch_.fetch_add(1, std::memory_order_seq_cst) + 1;
+        if (old_trie != nullptr) {
+            RetiredTrie retired;
+            retired.trie = old_trie;
+            retired.epoch = epoch;
+            this->retired_list_.push_back(retired);
+        }
+        this->reclaim_retired();
+    }
+
+    //
+    // Delete the retired tries that no reader can hold, return the count still retired.
+    //
+    size_type reclaim() {
+        std::lock_guard<std::mutex> lock(this->writer_mutex_);
+        return this->reclaim_retired();
+    }
+
+    //
+    // Wait until all the retired tries are deleted.
+    //
+    void synchronize() {
+        while (this->reclaim() != 0) {
+            std::this_thread::yield();
+        }
+    }
+
+private:
+    std::uint64_t min_reader_epoch() const {
+        std::uint64_t min_epoch = std::uint64_t(-1);
+        size_type reader_count = this->reader_count_.load(std::memory_order_acquire);
+        if (reader_count > this->max_readers_)
+            reader_count = this->max_readers_;
+        for (size_type i = 0; i < reader_count; i++) {
+            std::uint64_t epoch = this->slots_[i].epoch.load(std::memory_order_seq_cst);
+            if (epoch != kQuiescent && epoch < min_epoch)
+                min_epoch = epoch;
+        }
+        return min_epoch;
+    }
+
+    size_type reclaim_retired() {
+        if (this->retired_list_.empty())
+            return 0;
+
+        std::uint64_t min_epoch = this->min_reader_epoch();
+        size_type keep = 0;
+        for (size_type i = 0; i < this->retired_list_.size(); i++) {
+            RetiredTrie & retired = this->retired_list_[i];
+            if (retired.epoch <= min_epoch) {
+                delete retired.trie;
+            } else {
+                this->retired_list_[keep++] = retired;
+            }
+        }
+        this->retired_list_.resize(keep);
+        return keep;
+    }
+
+    TrieHandle(const TrieHandle & src) = delete;
+    TrieHandle & operator = (const TrieHandle & rhs) = delete;
+};
+
+#endif // TRIE_HANDLE_H
@@ -117,7 +117,7 @@ std::size_t utf8_encode(std::uint32_t unicode, char * utf8_output)
             // 0x00010000 - 0x001FFFFF (in fact 0x0010FFFF)
             // 21 bits, 4 bytes: 11110xxx 10xxxxxx 10xxxxxx 10xxxxxx
             *(utf8 + 0) = (uint8_t)(((unicode & 0x001C0000u) >> 18u) | 0xF0);
-            *(utf8 + 1) = (uint8_t)(((unicode & 0x00003F00u) >> 12u) | 0x80);
+            *(utf8 + 1) = (uint8_t)(((unicode & 0x0003F000u) >> 12u) | 0x80);
             *(utf8 + 2) = (uint8_t)(((unicode & 0x00000FC0u) >> 6u ) | 0x80);
             *(utf8 + 3) = (uint8_t)(((unicode & 0x0000003Fu) >> 0u ) | 0x80);
             return std::size_t(4);
@@ -0,0 +1,170 @@
+
+#ifndef VALUE_ARENA_H
+#define VALUE_ARENA_H
+
+#if defined(_MSC_VER) && (_MSC_VER >= 1020)
+#pragma once
+#endif
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <string.h>
+#include <assert.h>
+
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <unordered_map>
+
+#include "basic/stddef.h"
+
+namespace detail {
+
+template <typename T>
+static inline
+T load_unaligned(const void * src)
+{
+    T value;
+    std::memcpy(&value, src, sizeof(T));
+    return value;
+}
+
+template <typename T>
+static inline
+void store_unaligned(void * dest, T value)
+{
+    std::memcpy(dest, &value, sizeof(T));
+}
+
+//
+// Copy a short string with two overlapped loads and stores of the widest
+// fitting size, there is no byte loop and at most one branch per size class.
+//
+static inline
+void copy_short_string(void * dest, const void * src, std::size_t length)
+{
+    uint8_t * d = (uint8_t *)dest;
+    const uint8_t * s = (const uint8_t *)src;
+    if (likely(length >= 8)) {
+        if (likely(length <= 16)) {
+            std::uint64_t head = load_unaligned<std::uint64_t>(s);
+            std::uint64_t tail = load_unaligned<std::uint64_t>(s + length - 8);
+            store_unaligned<std::uint64_t>(d, head);
+            store_unaligned<std::uint64_t>(d + length - 8, tail);
+        } else if (length <= 32) {
+            std::uint64_t head0 = load_unaligned<std::uint64_t>(s);
+            std::uint64_t head1 = load_unaligned<std::uint64_t>(s + 8);
+            std::uint64_t tail0 = load_unaligned<std::uint64_t>(s + length - 16);
+            std::uint64_t tail1 = load_unaligned<std::uint64_t>(s + length - 8);
+            store_unaligned<std::uint64_t>(d, head0);
+            store_unaligned<std::uint64_t>(d + 8, head1);
+            store_unaligned<std::uint64_t>(d + length - 16, tail0);
+            store_unaligned<std::uint64_t>(d + length - 8, tail1);
+        } else {
+            std::memcpy(d, s, length);
+        }
+    } else if (length >= 4) {
+        std::uint32_t head = load_unaligned<std::uint32_t>(s);
+        std::uint32_t tail = load_unaligned<std::uint32_t>(s + length - 4);
+        store_unaligned<std::uint32_t>(d, head);
+        store_unaligned<std::uint32_t>(d + length - 4, tail);
+    } else if (length >= 2) {
+        std::uint16_t head = load_unaligned<std::uint16_t>(s);
+        std::uint16_t tail = load_unaligned<std::uint16_t>(s + length - 2);
+        store_unaligned<std::uint16_t>(d, head);
+        store_unaligned<std::uint16_t>(d + length - 2, tail);
+    } else if (length == 1) {
+        *d = *s;
+    }
+}
+
+} // namespace detail
+
+//
+// All the replacement values are stored in one contiguous arena, and looked up
+// by pattern_id. The same value text is only stored once, so the hot values
+// share the cache lines.
+//
+class ValueArena {
+public:
+    typedef std::size_t size_type;
+
+#pragma pack(push, 1)
+    struct ValueInfo {
+        std::uint32_t offset;
+        std::uint32_t length;
+    };
+#pragma pack(pop)
+
+private:
+    std::string                                 arena_;
+    std::vector<ValueInfo>                      values_;
+    std::unordered_map<std::string, ValueInfo>  value_map_;
+    size_type                                   max_length_;
+
+public:
+    ValueArena() : max_length_(0) {}
+    ~ValueArena() {}
+
+    size_type size() const { return this->values_.size(); }
+    size_type arena_size() const { return this->arena_.size(); }
+    size_type max_length() const { return this->max_length_; }
+
+    void clear() {
+        this->arena_.clear();
+        this->values_.clear();
+        this->value_map_.clear();
+        this->max_length_ = 0;
+    }
+
+    //
+    // Append the value of the next pattern_id.
+    //
+    void append(const char * value, size_type length) {
+        std::string value_text(value, length);
+        auto iter = this->value_map_.find(value_text);
+        if (iter != this->value_map_.end()) {
+            this->values_.push_back(iter->second);
+        } else {
+            ValueInfo info;
+            info.offset = (std::uint32_t)this->arena_.size();
+            info.length = (std::uint32_t)length;
+            this->arena_.append(value, length);
+            this->values_.push_back(info);
+            this->value_map_.insert(std::make_pair(value_text, info));
+            if (length > this->max_length_)
+                this->max_length_ = length;
+        }
+    }
+
+    void append(const std::string & value) {
+        this->append(value.c_str(), value.size());
+    }
+
+    const char * value(std::uint32_t pattern_id) const {
+        assert(pattern_id < (std::uint32_t)this->values_.size());
+        return (this->arena_.c_str() + this->values_[pattern_id].offset);
+    }
+
+    size_type length(std::uint32_t pattern_id) const {
+        assert(pattern_id < (std::uint32_t)this->values_.size());
+        return (size_type)this->values_[pattern_id].length;
+    }
+
+    //
+    // Write the value of pattern_id to output, return the value length.
+    //
+    template <typename T>
+    size_type write(T * output, std::uint32_t pattern_id) const {
+        assert(pattern_id < (std::uint32_t)this->values_.size());
+        const ValueInfo & info = this->values_[pattern_id];
+        detail::copy_short_string((void *)output, this->arena_.c_str() + info.offset,
+                                  (size_type)info.length);
+        return (size_type)info.length;
+    }
+};
+
+#endif // VALUE_ARENA_H
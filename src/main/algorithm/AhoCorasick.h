@@ -18,10 +18,6 @@
 
 #include "StringMatch.h"
 #include "algorithm/AlgorithmWrapper.h"
-#include "jstd/scoped_ptr.h"
-#include "jstd/vector.h"
-
-#define USE_PLACEMENT_NEW   1
 
 //
 // Article:
@@ -37,91 +33,36 @@
 
 namespace StringMatch {
 
+//
+// The nodes of AhoCorasickImpl live in one growable arena and link each other by
+// 32-bit indices. The root has a dense 256 entries transition table, the deeper
+// nodes (and the wide chars of the root) have a sparse edge list in another arena,
+// most of them have one child.
+//
 struct ACNode {
-    typedef std::size_t size_type;
-    static const size_type kMaxAscii = 256;
-
-    ACNode * fail;
-    Long cnt;
-    ACNode * next[kMaxAscii];
-
-    ACNode(ACNode * _fail = nullptr)  { init(_fail); }
-    ~ACNode() { destroy(); }
-
-    void init(ACNode * _fail = nullptr) {
-        this->fail = _fail;
-        this->cnt = 0;
-#if 1
-        memset((void *)&this->next[0], 0, kMaxAscii * sizeof(ACNode *));
-#else
-        for (size_type i = 0; i < kMaxAscii; ++i) {
-            this->next[i] = nullptr;
-        }
-#endif
-    }
-
-    void destroy() {
-#if USE_PLACEMENT_NEW
-  #if 0
-        for (size_type i = 0; i < kMaxAscii; ++i) {
-            if (this->next[i] != nullptr) {
-                this->next[i]->~ACNode();
-                this->next[i] = nullptr;
-            }
-        }
-  #endif
-#else
-        for (size_type i = 0; i < kMaxAscii; ++i) {
-            if (this->next[i] != nullptr) {
-                delete next[i];
-                this->next[i] = nullptr;
-            }
-        }
-#endif
-    }
+    typedef std::uint32_t ident_t;
+
+    ident_t fail;
+    ident_t first_edge;
+    Long    cnt;
+    // The id of the pattern ends here, and the nearest node on the fail chain
+    // which a pattern ends at (the output link), see add_pattern() and scan().
+    ident_t pattern_id;
+    ident_t output;
+
+    ACNode(ident_t _fail = 0)
+        : fail(_fail), first_edge(0), cnt(0), pattern_id(0), output(0) {}
 };
 
-struct MemoryPool {
-public:
-    typedef std::size_t size_type;
-    typedef ACNode      node_type;
-
-    static const size_type kMaxSize = 16384;
-
-private:
-    bool inited_;
-    std::vector<node_type *> nodes_;
-
-public:
-    MemoryPool() : inited_(false) { init(); }
-    ~MemoryPool() { destroy(); }
-
-    void init() {
-        if (!this->inited_) {
-            this->nodes_.reserve(kMaxSize);
-            for (size_type i = 0; i < kMaxSize; ++i) {
-                this->nodes_.emplace_back(new node_type());
-            }
-            this->inited_ = true;
-        }
-    }
+struct ACEdge {
+    typedef std::uint32_t ident_t;
 
-    void destroy() {
-        if (this->inited_) {
-            for (size_type i = 0; i < kMaxSize; ++i) {
-                if (this->nodes_[i] != nullptr) {
-                    delete this->nodes_[i];
-                    this->nodes_[i] = nullptr;
-                }
-            }
-            this->inited_ = false;
-        }
-    }
+    ident_t next_edge;
+    ident_t child;
+    std::uint32_t label;
 
-    void * get(size_type i) {
-        assert(i < kMaxSize);
-        return (void *)this->nodes_[i];
-    }
+    ACEdge(std::uint32_t _label = 0, ident_t _child = 0, ident_t _next_edge = 0)
+        : next_edge(_next_edge), child(_child), label(_label) {}
 };
 
 template <typename CharTy>
@@ -133,198 +74,241 @@ public:
     typedef typename jstd::uchar_traits<CharTy>::type
                                     uchar_type;
     typedef ACNode                  node_type;
+    typedef ACEdge                  edge_type;
+    typedef ACNode::ident_t         ident_t;
 
     static const size_type kMaxAscii = 256;
 
-    static MemoryPool memory_pool;
-    static int pool_idx;
+    // Index 0 is the null node and the null edge.
+    static const ident_t kInvalidIdent = 0;
+    static const ident_t kRootIdent = 1;
+
+    // The nodes created since the last reset_counter(), all instances.
+    static int node_counter;
 
 private:
-    jstd::scoped_ptr<node_type> root_;
-    jstd::vector<node_type *> queue_;
+    std::vector<node_type>  nodes_;
+    std::vector<edge_type>  edges_;
+    std::vector<ident_t>    root_next_;
+    std::vector<ident_t>    queue_;
 
 public:
-    AhoCorasickImpl() : root_(nullptr) {
+    AhoCorasickImpl() {
         this->init();
-        AhoCorasickImpl::memory_pool.init();
     }
     ~AhoCorasickImpl() {
         this->destroy();
     }
 
     static void reset_counter() {
-        AhoCorasickImpl::pool_idx = 0;
+        AhoCorasickImpl::node_counter = 0;
     }
 
     static int get_counter() {
-        return AhoCorasickImpl::pool_idx;
+        return AhoCorasickImpl::node_counter;
     }
 
     static const char * name() { return "AhoCorasick"; }
     static bool need_preprocessing() { return true; }
 
     bool is_alive() const {
-        return (this->root_.get() != nullptr);
+        return (this->nodes_.size() > kRootIdent);
+    }
+
+    size_type node_count() const {
+        return (this->nodes_.size() - 1);
     }
 
     void init() {
-        this->root_.reset(new node_type());
-        this->queue_.reserve(63);
+        this->nodes_.clear();
+        this->nodes_.reserve(64);
+        // The null node and the root.
+        this->nodes_.emplace_back();
+        this->nodes_.emplace_back();
+        this->edges_.clear();
+        this->edges_.reserve(64);
+        // The null edge.
+        this->edges_.emplace_back();
+        this->root_next_.assign(kMaxAscii, ident_t(kInvalidIdent));
+        this->queue_.clear();
     }
 
     void destroy() {
-        this->root_.reset();
+        std::vector<node_type>().swap(this->nodes_);
+        std::vector<edge_type>().swap(this->edges_);
+        std::vector<ident_t>().swap(this->root_next_);
+        std::vector<ident_t>().swap(this->queue_);
     }
 
-#if 1
-    void build_trie(const char_type * pattern, size_type length) {
-        node_type * root = this->root_.get();
-        node_type * node = root;
-        assert(node != nullptr);
-
-        for (size_type i = 0; i < length; ++i) {
-            uchar_type ch = (uchar_type)*pattern++;
-            assert(node != nullptr);
-            if (likely(node->next[ch] == nullptr)) {
-#if USE_PLACEMENT_NEW
-                void * next_ptr = AhoCorasickImpl::memory_pool.get(AhoCorasickImpl::pool_idx);
-                node_type * next = new (next_ptr) node_type();
-                assert((void *)next == next_ptr);
-                AhoCorasickImpl::pool_idx++;
-#else
-                node_type * next = new node_type();
-#endif
-                node->next[ch] = next;
-                assert(next != nullptr);
-                node = next;
-            }
-            else {
-                node = node->next[ch];
+    ident_t next_node(ident_t node, uchar_type ch) const {
+        assert(node != kInvalidIdent && node < this->nodes_.size());
+        if (likely(node == kRootIdent && (size_type)ch < kMaxAscii)) {
+            return this->root_next_[ch];
+        } else {
+            ident_t edge = this->nodes_[node].first_edge;
+            while (likely(edge != kInvalidIdent)) {
+                const edge_type & cur_edge = this->edges_[edge];
+                if (likely(cur_edge.label == (std::uint32_t)ch))
+                    return cur_edge.child;
+                edge = cur_edge.next_edge;
             }
+            return kInvalidIdent;
         }
+    }
+
+    void build_trie(const char_type * pattern, size_type length) {
+        ident_t node = this->insert_trie(pattern, length);
 
         // Record the leaf node.
-        node->cnt++;
+        this->nodes_[node].cnt++;
     }
 
-    void build_automation(const char_type * pattern, size_type length) {
-        // First step: build the trie tree.
-        build_trie(pattern, length);
+    //
+    // Add one pattern of the multi-pattern automaton, return the pattern id stored
+    // at its leaf: pattern_id, or the id of the same pattern added before.
+    // The automaton must be built by build() before scan().
+    //
+    ident_t add_pattern(const char_type * pattern, size_type length, ident_t pattern_id) {
+        if (this->nodes_.size() <= kRootIdent)
+            this->init();
+
+        ident_t node = this->insert_trie(pattern, length);
+        node_type & leaf = this->nodes_[node];
+        if (likely(leaf.cnt <= 0)) {
+            leaf.cnt = 1;
+            leaf.pattern_id = pattern_id;
+        }
+        return leaf.pattern_id;
+    }
 
-        // Second step: build the automation.
-        node_type * root = this->root_.get();
-        this->queue_.emplace_back(root);
+    //
+    // Report every occurrence of the patterns: on_match(end, pattern_id), end is
+    // the text offset after the match. At the same end, the longer pattern is
+    // reported first. Return the count of the reported matches, it stops when
+    // on_match() returns false.
+    //
+    template <typename Callback>
+    size_type scan(const char_type * text, size_type text_len, Callback && on_match) const {
+        assert(text != nullptr || text_len == 0);
+        size_type count = 0;
+        if (unlikely(!this->is_alive()))
+            return count;
+
+        const node_type * nodes = this->nodes_.data();
+        ident_t node = kRootIdent;
+
+        for (size_type i = 0; i < text_len; ++i) {
+            uchar_type ch = (uchar_type)text[i];
+            ident_t next;
+            while (likely((next = this->next_node(node, ch)) == kInvalidIdent && node != kRootIdent)) {
+                node = nodes[node].fail;
+            }
+            node = (next != kInvalidIdent) ? next : ident_t(kRootIdent);
+
+            ident_t output = (nodes[node].cnt > 0) ? node : nodes[node].output;
+            while (output != kInvalidIdent) {
+                count++;
+                if (!on_match(i + 1, (size_type)nodes[output].pattern_id))
+                    return count;
+                output = nodes[output].output;
+            }
+        }
+        return count;
+    }
+
+    void build() {
+        this->queue_.clear();
+        this->queue_.push_back(ident_t(kRootIdent));
 
         size_type head = 0;
         while (likely(head < this->queue_.size())) {
-            node_type * cur = this->queue_[head++];
-            for (size_type i = 0; i < kMaxAscii; ++i) {
-                node_type * next = cur->next[i];
-                if (likely(next == nullptr)) {
-                    continue;
-                }
-                else {
-                    if (likely(cur == root)) {
-                        next->fail = root;
-                        this->queue_.emplace_back(next);
-                    }
-                    else {
-                        node_type * node = cur->fail;
-                        do {
-                            if (likely(node != nullptr)) {
-                                if (likely(node->next[i] == nullptr)) {
-                                    node = node->fail;
-                                }
-                                else {
-                                    next->fail = node->next[i];
-                                    break;
-                                }
-                            }
-                            else {
-                                next->fail = root;
-                                break;
-                            }
-                        } while (1);
-                        this->queue_.emplace_back(next);
+            ident_t cur = this->queue_[head++];
+            if (likely(cur == kRootIdent)) {
+                for (size_type i = 0; i < kMaxAscii; ++i) {
+                    ident_t next = this->root_next_[i];
+                    if (likely(next != kInvalidIdent)) {
+                        this->set_fail_link(cur, (uchar_type)i, next);
                     }
                 }
             }
+            // The wide chars of the root are in the edge list too.
+            ident_t edge = this->nodes_[cur].first_edge;
+            while (likely(edge != kInvalidIdent)) {
+                const edge_type cur_edge = this->edges_[edge];
+                this->set_fail_link(cur, (uchar_type)cur_edge.label, cur_edge.child);
+                edge = cur_edge.next_edge;
+            }
         }
     }
-#else
-    void build_trie(const char_type * pattern, size_type length) {
-        node_type * root = this->root_.get();
-        node_type * node = root;
-        assert(node != nullptr);
+
+private:
+    ident_t insert_trie(const char_type * pattern, size_type length) {
+        ident_t node = kRootIdent;
 
         for (size_type i = 0; i < length; ++i) {
             uchar_type ch = (uchar_type)*pattern++;
-            assert(node != nullptr);
-            if (likely(node->next[ch] == nullptr)) {
-#if USE_PLACEMENT_NEW
-                void * next_ptr = AhoCorasickImpl::memory_pool.get(AhoCorasickImpl::pool_idx);
-                node_type * next = new (next_ptr) node_type();
-                assert((void *)next == next_ptr);
-                AhoCorasickImpl::pool_idx++;
-#else
-                node_type * next = new node_type();
-#endif
-                node->next[ch] = next;
-                assert(next != nullptr);
+            ident_t next = this->next_node(node, ch);
+            if (likely(next == kInvalidIdent)) {
+                next = (ident_t)this->nodes_.size();
+                this->nodes_.emplace_back();
+                AhoCorasickImpl::node_counter++;
+                if (likely(node == kRootIdent && (size_type)ch < kMaxAscii)) {
+                    this->root_next_[ch] = next;
+                } else {
+                    ident_t edge = (ident_t)this->edges_.size();
+                    this->edges_.emplace_back((std::uint32_t)ch, next, this->nodes_[node].first_edge);
+                    this->nodes_[node].first_edge = edge;
+                }
             }
-            node = node->next[ch];
+            node = next;
         }
+        return node;
+    }
 
-        // Record the leaf node.
-        node->cnt++;
+    void set_fail_link(ident_t cur, uchar_type ch, ident_t next) {
+        if (likely(cur == kRootIdent)) {
+            this->nodes_[next].fail = kRootIdent;
+        }
+        else {
+            ident_t node = this->nodes_[cur].fail;
+            do {
+                if (likely(node != kInvalidIdent)) {
+                    ident_t fail = this->next_node(node, ch);
+                    if (likely(fail == kInvalidIdent)) {
+                        node = this->nodes_[node].fail;
+                    }
+                    else {
+                        this->nodes_[next].fail = fail;
+                        break;
+                    }
+                }
+                else {
+                    this->nodes_[next].fail = kRootIdent;
+                    break;
+                }
+            } while (1);
+        }
+
+        node_type & child = this->nodes_[next];
+        const node_type & fail_node = this->nodes_[child.fail];
+        child.output = (child.fail != kRootIdent && fail_node.cnt > 0) ? child.fail : fail_node.output;
+        this->queue_.push_back(next);
     }
 
+public:
     void build_automation(const char_type * pattern, size_type length) {
         // First step: build the trie tree.
         build_trie(pattern, length);
 
         // Second step: build the automation.
-        node_type * root = this->root_.get();
-        this->queue_.push_back(root);
-
-        size_type head = 0;
-        while (likely(head < this->queue_.size())) {
-            node_type * node = nullptr;
-            node_type * cur = this->queue_[head++];
-            for (size_type i = 0; i < kMaxAscii; ++i) {
-                if (likely(cur->next[i] == nullptr)) {
-                    continue;
-                }
-                else {
-                    if (likely(cur == root)) {
-                        cur->next[i]->fail = root;
-                    }
-                    else {
-                        node = cur->fail;
-                        while (likely(node != nullptr)) {
-                            if (likely(node->next[i] == nullptr)) {
-                                node = node->fail;
-                            }
-                            else {
-                                cur->next[i]->fail = node->next[i];
-                                break;
-                            }
-                        }
-                        if (likely(node == nullptr)) {
-                            cur->next[i]->fail = root;
-                        }
-                    }
-                    this->queue_.push_back(cur->next[i]);
-                }
-            }
-        }
+        this->build();
     }
-#endif
 
     /* Preprocessing */
     bool preprocessing(const char_type * pattern, size_type length) {
-        bool success = false;
         assert(pattern != nullptr);
+        if (this->nodes_.size() <= kRootIdent)
+            this->init();
 
         this->build_automation(pattern, length);
         return true;
@@ -337,29 +321,28 @@ public:
         assert(text != nullptr);
         assert(pattern != nullptr);
 
-        if (likely(pattern_len <= text_len)) {
-            node_type * root = this->root_.get();
-            node_type * node = root;
-            assert(root != nullptr);
+        if (likely(pattern_len <= text_len && this->is_alive())) {
+            const node_type * nodes = this->nodes_.data();
+            ident_t node = kRootIdent;
 
             const char_type * text_start = text;
             const char_type * text_end = text + text_len;
             while (likely(text < text_end)) {
                 uchar_type ch = (uchar_type)*text;
                 do {
-                    node_type * next = node->next[ch];
-                    if (likely(next == nullptr)) {
+                    ident_t next = this->next_node(node, ch);
+                    if (likely(next == kInvalidIdent)) {
                         // Dismatch
-                        if (likely(node == root)) {
+                        if (likely(node == kRootIdent)) {
                             text++;
                             break;
                         }
                         else {
-                            if (likely(node->fail != nullptr)) {
-                                node = node->fail;
+                            if (likely(nodes[node].fail != kInvalidIdent)) {
+                                node = nodes[node].fail;
                             }
                             else {
-                                node = root;
+                                node = kRootIdent;
                                 text++;
                                 break;
                             }
@@ -367,9 +350,8 @@ public:
                     }
                     else {
                         // Matched one char
-                        assert(next != nullptr);
                         node = next;
-                        if (likely(node->cnt <= 0)) {
+                        if (likely(nodes[node].cnt <= 0)) {
                             // Isn't a leaf node.
                             text++;
                             break;
@@ -394,31 +376,30 @@ public:
         assert(text != nullptr);
         assert(pattern != nullptr);
 
-        if (likely(pattern_len <= text_len)) {
-            ACNode * root = this->root_.get();
-            ACNode * node = root;
-            assert(root != nullptr);
+        if (likely(pattern_len <= text_len && this->is_alive())) {
+            const node_type * nodes = this->nodes_.data();
+            ident_t node = kRootIdent;
 
             const char_type * text_start = text;
             const char_type * text_end = text + text_len;
             while (likely(text < text_end)) {
                 uchar_type ch = (uchar_type)*text;
-                while (likely(node->next[ch] == nullptr && node != root)) {
-                    if (likely(node->fail != nullptr)) {
-                        node = node->fail;
+                ident_t next;
+                while (likely((next = this->next_node(node, ch)) == kInvalidIdent && node != kRootIdent)) {
+                    if (likely(nodes[node].fail != kInvalidIdent)) {
+                        node = nodes[node].fail;
                     }
                     else {
-                        node = root;
-                        break;
+                        node = kRootIdent;
                     }
                 }
-                node = node->next[ch];
-                if (likely(node == nullptr)) {
-                    node = root;
+                node = next;
+                if (likely(node == kInvalidIdent)) {
+                    node = kRootIdent;
                     text++;
                 }
                 else {
-                    if (likely(node->cnt <= 0)) {
+                    if (likely(nodes[node].cnt <= 0)) {
                         text++;
                     }
                     else {
@@ -435,13 +416,8 @@ public:
 };
 
 template <typename T>
-MemoryPool AhoCorasickImpl<T>::memory_pool;
-
-template <typename T>
-int AhoCorasickImpl<T>::pool_idx = 0;
+int AhoCorasickImpl<T>::node_counter = 0;
 
 } // namespace StringMatch
 
-#undef USE_PLACEMENT_NEW
-
 #endif // STRING_MATCH_AHO_CORASICK_H
@@ -20,6 +20,7 @@
 #include <tuple>
 #include <type_traits>
 #include <utility>
+#include <vector>
 
 #include "StringMatch.h"
 #include "jstd/char_traits.h"
@@ -396,12 +397,177 @@ Long AlgorithmWrapper<AlgorithmTy>::Pattern::match(
     return this->match(matcher.c_str(), matcher.size());
 }
 
+//
+// A set of patterns compiled into one Aho-Corasick automaton, the text is scanned
+// once for all the patterns instead of one Pattern::match() per pattern.
+//
+template <typename CharTy>
+class BasicPatternSet {
+public:
+    typedef AhoCorasickImpl<CharTy>             algorithm_type;
+    typedef typename algorithm_type::char_type  char_type;
+    typedef typename algorithm_type::size_type  size_type;
+    typedef typename algorithm_type::ident_t    ident_t;
+    typedef std::basic_string<char_type>        string_type;
+    typedef BasicStringRef<char_type>           stringref_type;
+
+    static const size_type kInvalidId = size_type(-1);
+
+private:
+    std::vector<string_type> patterns_;
+    algorithm_type algorithm_;
+    bool compiled_;
+
+public:
+    BasicPatternSet() : compiled_(false) {
+    }
+    ~BasicPatternSet() {
+    }
+
+    size_type size() const { return this->patterns_.size(); }
+    bool empty() const { return this->patterns_.empty(); }
+    bool has_compiled() const { return this->compiled_; }
+
+    const string_type & pattern(size_type pattern_id) const {
+        assert(pattern_id < this->patterns_.size());
+        return this->patterns_[pattern_id];
+    }
+
+    void clear() {
+        this->patterns_.clear();
+        this->algorithm_.init();
+        this->compiled_ = false;
+    }
+
+    // PatternSet::add(), return the pattern id, or kInvalidId if the pattern is empty.
+    // The same pattern added again gets the id of the first one.
+    size_type add(const char_type * pattern, size_type length) {
+        assert(pattern != nullptr || length == 0);
+        if (unlikely(length == 0))
+            return kInvalidId;
+        ident_t new_id = (ident_t)this->patterns_.size();
+        ident_t pattern_id = this->algorithm_.add_pattern(pattern, length, new_id);
+        if (likely(pattern_id == new_id))
+            this->patterns_.push_back(string_type(pattern, length));
+        this->compiled_ = false;
+        return (size_type)pattern_id;
+    }
+
+    size_type add(const char_type * pattern) {
+        return this->add(pattern, detail::strlen(pattern));
+    }
+
+    template <size_t N>
+    size_type add(const char_type (&pattern)[N]) {
+        return this->add(pattern, N - 1);
+    }
+
+    size_type add(const string_type & pattern) {
+        return this->add(pattern.c_str(), pattern.size());
+    }
+
+    size_type add(const stringref_type & pattern) {
+        return this->add(pattern.c_str(), pattern.size());
+    }
+
+    // PatternSet::compile(), build the automaton after the patterns are added.
+    bool compile() {
+        this->algorithm_.build();
+        this->compiled_ = !this->patterns_.empty();
+        return this->compiled_;
+    }
+
+    // PatternSet::find_first(), return the position of the first match: the match
+    // ends first, the longest one of them. pattern_id is the matched pattern.
+    Long find_first(const char_type * text, size_type length,
+                    size_type * pattern_id = nullptr) const {
+        Long index_of = Status::NotFound;
+        if (likely(this->compiled_)) {
+            this->algorithm_.scan(text, length, [&](size_type end, size_type id) -> bool {
+                index_of = (Long)(end - this->patterns_[id].size());
+                if (pattern_id != nullptr)
+                    *pattern_id = id;
+                return false;
+            });
+        }
+        return index_of;
+    }
+
+    template <size_t N>
+    Long find_first(const char_type (&text)[N], size_type * pattern_id = nullptr) const {
+        return this->find_first(text, N - 1, pattern_id);
+    }
+
+    Long find_first(const string_type & text, size_type * pattern_id = nullptr) const {
+        return this->find_first(text.c_str(), text.size(), pattern_id);
+    }
+
+    Long find_first(const stringref_type & text, size_type * pattern_id = nullptr) const {
+        return this->find_first(text.c_str(), text.size(), pattern_id);
+    }
+
+    // PatternSet::find_all(), on_match(pos, pattern_id) is called for every match,
+    // in the order of the match end. Return the count of the matches.
+    template <typename Callback>
+    size_type find_all(const char_type * text, size_type length, Callback && on_match) const {
+        if (unlikely(!this->compiled_))
+            return 0;
+        return this->algorithm_.scan(text, length, [&](size_type end, size_type id) -> bool {
+            on_match((Long)(end - this->patterns_[id].size()), id);
+            return true;
+        });
+    }
+
+    template <size_t N, typename Callback>
+    size_type find_all(const char_type (&text)[N], Callback && on_match) const {
+        return this->find_all(text, N - 1, std::forward<Callback>(on_match));
+    }
+
+    template <typename Callback>
+    size_type find_all(const string_type & text, Callback && on_match) const {
+        return this->find_all(text.c_str(), text.size(), std::forward<Callback>(on_match));
+    }
+
+    template <typename Callback>
+    size_type find_all(const stringref_type & text, Callback && on_match) const {
+        return this->find_all(text.c_str(), text.size(), std::forward<Callback>(on_match));
+    }
+
+    // PatternSet::count(), the count of all the matches (overlapped).
+    size_type count(const char_type * text, size_type length) const {
+        if (unlikely(!this->compiled_))
+            return 0;
+        return this->algorithm_.scan(text, length, [](size_type, size_type) -> bool {
+            return true;
+        });
+    }
+
+    size_type count(const char_type * text) const {
+        return this->count(text, detail::strlen(text));
+    }
+
+    template <size_t N>
+    size_type count(const char_type (&text)[N]) const {
+        return this->count(text, N - 1);
+    }
+
+    size_type count(const string_type & text) const {
+        return this->count(text.c_str(), text.size());
+    }
+
+    size_type count(const stringref_type & text) const {
+        return this->count(text.c_str(), text.size());
+    }
+}; // class BasicPatternSet<CharTy>
+
 namespace AnsiString {
     typedef AlgorithmWrapper< AhoCorasickImpl<char> >       AhoCorasick;
+    typedef BasicPatternSet<char>                           PatternSet;
 }
 
 namespace UnicodeString {
     typedef AlgorithmWrapper< AhoCorasickImpl<wchar_t> >    AhoCorasick;
+    typedef BasicPatternSet<wchar_t>                        PatternSet;
 }
 
 } // namespace StringMatch
@@ -217,6 +217,21 @@ void StringMatch_usage_examples()
             Long pos = AnsiString::Kmp::match(matcher, pattern);
         }
     }
+
+    // Usage 7: all the keywords in one pass.
+    {
+        AnsiString::PatternSet pattern_set;
+        pattern_set.add("sample");
+        pattern_set.add("example");
+        if (pattern_set.compile()) {
+            size_t pattern_id;
+            Long pos = pattern_set.find_first("Here is a sample example.", &pattern_id);
+            size_t count = pattern_set.find_all("Here is a sample example.",
+                [](Long pos, size_t pattern_id) {
+                    // Do something.
+                });
+        }
+    }
 }
 
 template <typename AlgorithmTy>
@@ -507,6 +522,74 @@ void StringMatch_benchmark()
 #endif
 }
 
+//
+// Find the end of the first keyword of every search text: N Pattern::match() calls
+// and take the smallest end, vs. one pass of PatternSet::find_first().
+//
+template <typename AlgorithmTy>
+void StringMatch_PatternSet_benchmark()
+{
+    typedef typename AlgorithmTy::Pattern pattern_type;
+
+    static const size_t iters = kIterations / (kSearchTexts * kPatterns) + 1;
+
+    test::StopWatch sw;
+    Long pattern_sum, pattern_set_sum;
+    double pattern_time, pattern_set_time;
+
+    StringRef texts[kSearchTexts];
+    for (size_t i = 0; i < kSearchTexts; ++i) {
+        texts[i].set_data(SearchTexts[i], ::strlen(SearchTexts[i]));
+    }
+
+    pattern_type pattern[kPatterns];
+    AnsiString::PatternSet pattern_set;
+    for (size_t i = 0; i < kPatterns; ++i) {
+        pattern[i].preprocessing(Patterns[i]);
+        pattern_set.add(Patterns[i]);
+    }
+    pattern_set.compile();
+
+    pattern_sum = 0;
+    sw.start();
+    for (size_t loop = 0; loop < iters; ++loop) {
+        for (size_t i = 0; i < kSearchTexts; ++i) {
+            Long first_end = Status::NotFound;
+            for (size_t j = 0; j < kPatterns; ++j) {
+                Long index_of = pattern[j].match(texts[i].c_str(), texts[i].size());
+                if (index_of != Status::NotFound) {
+                    Long end = index_of + (Long)pattern[j].size();
+                    if (first_end == Status::NotFound || end < first_end)
+                        first_end = end;
+                }
+            }
+            pattern_sum += first_end;
+        }
+    }
+    sw.stop();
+    pattern_time = sw.getMillisec();
+
+    pattern_set_sum = 0;
+    sw.start();
+    for (size_t loop = 0; loop < iters; ++loop) {
+        for (size_t i = 0; i < kSearchTexts; ++i) {
+            size_t pattern_id;
+            Long index_of = pattern_set.find_first(texts[i].c_str(), texts[i].size(), &pattern_id);
+            if (index_of != Status::NotFound)
+                pattern_set_sum += index_of + (Long)pattern_set.pattern(pattern_id).size();
+            else
+                pattern_set_sum += index_of;
+        }
+    }
+    sw.stop();
+    pattern_set_time = sw.getMillisec();
+
+    printf("  %-22s   %-12" PRIdPTR "     %8.3f ms\n", AlgorithmTy::name(),
+           (intptr_t)pattern_sum, pattern_time);
+    printf("  %-22s   %-12" PRIdPTR "     %8.3f ms\n", "PatternSet",
+           (intptr_t)pattern_set_sum, pattern_set_time);
+}
+
 void print_arch_type()
 {
 #if defined(WIN64) || defined(_WIN64) || defined(_M_X64) || defined(_M_AMD64) \
@@ -600,6 +683,8 @@ int main(int argc, char * argv[])
 #if ENABLE_AHOCORASICK_TEST
         StringMatch_benchmark<AnsiString::AhoCorasick>();
 #endif
+        printf("\n");
+        StringMatch_PatternSet_benchmark<AnsiString::Sunday>();
 
         printf("-------------------------------------------------------------------------------------------------\n");
         //printf("  ps: (*) indicates that not included the preprocessing time.\n");